@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+typedef uint32_t AssetID;
+
+// 32 bit FNV-1a of the asset name. constexpr so that literal names are hashed
+// at compile time, e.g. getMesh(assetID("monkey")).
+constexpr AssetID assetID(const char* name)
+{
+	uint32_t hash = 2166136261u;
+	while (*name)
+	{
+		hash ^= static_cast<uint8_t>(*name++);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+inline AssetID assetID(const std::string& name)
+{
+	return assetID(name.c_str());
+}
@@ -0,0 +1,313 @@
+#include "assetManager.h"
+#include "../vulkan/vkEngine.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+
+void AssetManager::init(VulkanEngine* engine, JobSystem* jobs, const std::string& root)
+{
+	this->engine = engine;
+	this->jobs = jobs;
+	this->root = root;
+
+	if (!this->root.empty() && this->root.back() != '/' && this->root.back() != '\\')
+		this->root += '/';
+}
+
+void AssetManager::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		requests.clear();
+	}
+
+	jobs->wait(loadCounter);
+	results.clear();
+	resultScratch.clear();
+}
+
+// Every queued request has one job, jobs take whichever request is next so
+// that they only need to capture this.
+void AssetManager::loadNext()
+{
+	LoadRequest request;
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		if (requests.empty())
+			return;
+
+		request = std::move(requests.front());
+		requests.pop_front();
+	}
+
+	LoadResult result;
+	result.record = request.record;
+	result.serial = request.serial;
+	result.success = result.mesh.loadFromOBJ(request.path.c_str(), jobs);
+	// Triangles for ray queries, audio occlusion casts against them.
+	if (result.success)
+		result.mesh.buildBVH();
+
+	std::lock_guard<std::mutex> lock(resultMutex);
+	results.push_back(std::move(result));
+}
+
+uint32_t AssetManager::findOrAddRecord(AssetID id)
+{
+	auto it = recordIndex.find(id);
+	if (it != recordIndex.end())
+		return it->second;
+
+	uint32_t record = static_cast<uint32_t>(records.size());
+	records.emplace_back();
+	recordIndex[id] = record;
+	return record;
+}
+
+MeshHandle AssetManager::reserveMesh(uint32_t record, Mesh&& mesh)
+{
+	MeshHandle handle = engine->meshes.add(std::move(mesh));
+	if (handle.index() >= recordOfMesh.size())
+		recordOfMesh.resize(handle.index() + 1, noRecord);
+
+	recordOfMesh[handle.index()] = record;
+	records[record].mesh = handle;
+	return handle;
+}
+
+MeshHandle AssetManager::loadMesh(AssetID id, const std::string& path, const std::vector<AssetID>& dependencies)
+{
+	uint32_t record = findOrAddRecord(id);
+	AssetRecord& asset = records[record];
+	asset.refCount++;
+
+	if (asset.state != ASSET_UNLOADED)
+		return asset.mesh;
+
+	asset.state = ASSET_LOADING;
+	asset.dataLoaded = false;
+	asset.pendingDependencies = 0;
+	asset.path = resolvePath(path);
+	asset.dependencies.clear();
+	reserveMesh(record, Mesh());
+
+	bool dependencyFailed = false;
+	for (AssetID dependencyID : dependencies)
+	{
+		auto it = recordIndex.find(dependencyID);
+		if (it == recordIndex.end() || records[it->second].state == ASSET_UNLOADED)
+		{
+			std::cerr << "Asset " << path << " depends on an asset that was never requested" << std::endl;
+			continue;
+		}
+
+		uint32_t dependency = it->second;
+		records[dependency].refCount++;
+		records[record].dependencies.push_back(dependency);
+
+		if (records[dependency].state == ASSET_FAILED)
+		{
+			dependencyFailed = true;
+		}
+		else if (records[dependency].state != ASSET_READY)
+		{
+			records[record].pendingDependencies++;
+			records[dependency].dependents.push_back(record);
+		}
+	}
+
+	if (dependencyFailed)
+	{
+		fail(record);
+		return records[record].mesh;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		requests.push_back({ record, records[record].serial, records[record].path });
+	}
+	jobs->run([this] { loadNext(); }, &loadCounter);
+
+	return records[record].mesh;
+}
+
+MeshHandle AssetManager::addMesh(AssetID id, Mesh&& mesh)
+{
+	uint32_t record = findOrAddRecord(id);
+	if (records[record].state != ASSET_UNLOADED)
+	{
+		records[record].refCount++;
+		return records[record].mesh;
+	}
+
+	engine->uploadMesh(mesh);
+
+	AssetRecord& asset = records[record];
+	asset.refCount = 1;
+	asset.dataLoaded = true;
+	asset.pendingDependencies = 0;
+	asset.state = ASSET_READY;
+	asset.path.clear();
+	asset.dependencies.clear();
+
+	return reserveMesh(record, std::move(mesh));
+}
+
+void AssetManager::acquire(AssetID id)
+{
+	auto it = recordIndex.find(id);
+	if (it != recordIndex.end() && records[it->second].state != ASSET_UNLOADED)
+		records[it->second].refCount++;
+}
+
+void AssetManager::release(AssetID id)
+{
+	auto it = recordIndex.find(id);
+	if (it == recordIndex.end())
+		return;
+
+	AssetRecord& asset = records[it->second];
+	if (asset.state == ASSET_UNLOADED || asset.refCount == 0)
+		return;
+
+	if (--asset.refCount == 0)
+		unload(it->second);
+}
+
+void AssetManager::unload(uint32_t record)
+{
+	AssetRecord& asset = records[record];
+
+	if (asset.state == ASSET_READY)
+		engine->unloadMesh(asset.mesh);
+	else
+		engine->meshes.remove(asset.mesh);
+
+	if (asset.mesh.index() < recordOfMesh.size())
+		recordOfMesh[asset.mesh.index()] = noRecord;
+
+	asset.state = ASSET_UNLOADED;
+	asset.mesh = MeshHandle();
+	asset.dataLoaded = false;
+	asset.serial++;
+
+	std::vector<uint32_t> dependencies = std::move(asset.dependencies);
+	asset.dependencies.clear();
+
+	for (uint32_t dependency : dependencies)
+	{
+		std::vector<uint32_t>& dependents = records[dependency].dependents;
+		dependents.erase(std::remove(dependents.begin(), dependents.end(), record), dependents.end());
+
+		if (--records[dependency].refCount == 0)
+			unload(dependency);
+	}
+}
+
+MeshHandle AssetManager::getMesh(AssetID id) const
+{
+	auto it = recordIndex.find(id);
+	if (it == recordIndex.end())
+		return MeshHandle();
+	else
+		return records[it->second].mesh;
+}
+
+AssetState AssetManager::getState(AssetID id) const
+{
+	auto it = recordIndex.find(id);
+	if (it == recordIndex.end())
+		return ASSET_UNLOADED;
+	else
+		return records[it->second].state;
+}
+
+bool AssetManager::isReady(MeshHandle mesh) const
+{
+	uint32_t index = mesh.index();
+	if (index >= recordOfMesh.size() || recordOfMesh[index] == noRecord)
+		return engine->meshes.contains(mesh);
+
+	const AssetRecord& asset = records[recordOfMesh[index]];
+	return asset.state == ASSET_READY && asset.mesh == mesh;
+}
+
+void AssetManager::finish(uint32_t record, uint32_t& readyCount)
+{
+	AssetRecord& asset = records[record];
+	if (asset.state != ASSET_LOADING || !asset.dataLoaded || asset.pendingDependencies > 0)
+		return;
+
+	asset.state = ASSET_READY;
+	readyCount++;
+
+	std::vector<uint32_t> dependents = std::move(asset.dependents);
+	records[record].dependents.clear();
+
+	for (uint32_t dependent : dependents)
+	{
+		if (records[dependent].pendingDependencies > 0)
+			records[dependent].pendingDependencies--;
+		finish(dependent, readyCount);
+	}
+}
+
+void AssetManager::fail(uint32_t record)
+{
+	AssetRecord& asset = records[record];
+	if (asset.state != ASSET_LOADING)
+		return;
+
+	std::cerr << "Failed to load asset " << asset.path << std::endl;
+	asset.state = ASSET_FAILED;
+
+	std::vector<uint32_t> dependents = std::move(asset.dependents);
+	records[record].dependents.clear();
+
+	for (uint32_t dependent : dependents)
+		fail(dependent);
+}
+
+uint32_t AssetManager::update(size_t uploadBudget)
+{
+	{
+		std::lock_guard<std::mutex> lock(resultMutex);
+		if (results.empty() && resultScratch.empty())
+			return 0;
+
+		// Results left over from the previous call go first.
+		resultScratch.insert(resultScratch.end(), std::make_move_iterator(results.begin()), std::make_move_iterator(results.end()));
+		results.clear();
+	}
+
+	uint32_t readyCount = 0;
+	size_t uploaded = 0;
+	size_t finished = 0;
+	for (; finished < resultScratch.size(); finished++)
+	{
+		LoadResult& result = resultScratch[finished];
+		AssetRecord& asset = records[result.record];
+		if (asset.serial != result.serial || asset.state != ASSET_LOADING)
+			continue;
+
+		if (!result.success)
+		{
+			fail(result.record);
+			continue;
+		}
+
+		size_t bytes = result.mesh.vertices.size() * sizeof(Vertex) + result.mesh.indices.size() * sizeof(uint32_t);
+		if (uploaded > 0 && uploaded + bytes > uploadBudget)
+			break;
+		uploaded += bytes;
+
+		engine->uploadMesh(result.mesh);
+		engine->meshes[asset.mesh] = std::move(result.mesh);
+		asset.dataLoaded = true;
+
+		finish(result.record, readyCount);
+	}
+
+	resultScratch.erase(resultScratch.begin(), resultScratch.begin() + finished);
+	return readyCount;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "assetID.h"
+#include "../scene/renderScene.h"
+#include "../vulkan/vkMesh.h"
+#include "../core/jobSystem.h"
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+class VulkanEngine;
+
+enum AssetState : uint8_t
+{
+	ASSET_UNLOADED,
+	ASSET_LOADING,
+	ASSET_READY,
+	ASSET_FAILED
+};
+
+struct AssetRecord
+{
+	AssetState state = ASSET_UNLOADED;
+	bool dataLoaded = false;
+	uint32_t refCount = 0;
+	uint32_t pendingDependencies = 0;
+	// Bumped on every unload so results of abandoned loads can be dropped.
+	uint32_t serial = 0;
+
+	MeshHandle mesh;
+	std::string path;
+	std::vector<uint32_t> dependencies;
+	std::vector<uint32_t> dependents;
+};
+
+// Loads meshes as jobs on the engine's job system. A load returns a mesh handle
+// right away, the mesh is uploaded and marked ready by update() on the main
+// thread once parsing is done and every dependency is ready. Assets are
+// reference counted and unloaded when the last reference is released.
+class AssetManager
+{
+	struct LoadRequest
+	{
+		uint32_t record;
+		uint32_t serial;
+		std::string path;
+	};
+
+	struct LoadResult
+	{
+		uint32_t record;
+		uint32_t serial;
+		bool success;
+		Mesh mesh;
+	};
+
+	static constexpr uint32_t noRecord = 0xFFFFFFFF;
+
+	VulkanEngine* engine;
+	std::string root;
+
+	std::vector<AssetRecord> records;
+	std::unordered_map<AssetID, uint32_t> recordIndex;
+	std::vector<uint32_t> recordOfMesh;
+
+	JobSystem* jobs;
+	JobCounter loadCounter;
+	std::mutex requestMutex;
+	std::deque<LoadRequest> requests;
+
+	std::mutex resultMutex;
+	std::vector<LoadResult> results;
+	std::vector<LoadResult> resultScratch;
+
+	uint32_t findOrAddRecord(AssetID id);
+	MeshHandle reserveMesh(uint32_t record, Mesh&& mesh);
+	void finish(uint32_t record, uint32_t& readyCount);
+	void fail(uint32_t record);
+	void unload(uint32_t record);
+	void loadNext();
+
+public:
+	void init(VulkanEngine* engine, JobSystem* jobs, const std::string& root);
+	void cleanup();
+
+	// Starts loading the OBJ at path, relative to the asset root, and takes a
+	// reference. Dependencies must have been requested already; the asset is
+	// not ready before all of them are, and keeps a reference to each.
+	MeshHandle loadMesh(AssetID id, const std::string& path, const std::vector<AssetID>& dependencies = {});
+
+	// Registers a mesh built in code, uploads it and marks it ready.
+	MeshHandle addMesh(AssetID id, Mesh&& mesh);
+
+	void acquire(AssetID id);
+	void release(AssetID id);
+
+	MeshHandle getMesh(AssetID id) const;
+	AssetState getState(AssetID id) const;
+	bool isReady(MeshHandle mesh) const;
+
+	std::string resolvePath(const std::string& path) const { return root + path; }
+
+	// Finishes completed loads, returns how many assets became ready. Stops
+	// once uploadBudget bytes of mesh data were uploaded, the remaining loads
+	// are finished on later calls. At least one load is finished per call.
+	uint32_t update(size_t uploadBudget = SIZE_MAX);
+};
@@ -0,0 +1,642 @@
+#include "objParser.h"
+#include "../core/jobSystem.h"
+#include "../core/mappedFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace
+{
+	// Indices as written in the file, 1-based. Relative ones are made 1-based
+	// within the chunk first and get the chunk's base added once it is known.
+	struct Corner
+	{
+		int32_t position;
+		int32_t normal;
+	};
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		// Three per triangle.
+		std::vector<Corner> corners;
+		std::vector<uint32_t> relativePositions;
+		std::vector<uint32_t> relativeNormals;
+		bool failed = false;
+
+		// Corners with and without a normal, and with a normal index that
+		// differs from the position index.
+		bool withNormal = false;
+		bool withoutNormal = false;
+		bool splitNormal = false;
+
+		uint64_t positionBase = 0;
+		uint64_t normalBase = 0;
+
+		std::vector<Vertex> vertices;
+		// Position index of every vertex, for generating normals.
+		std::vector<uint32_t> vertexPositions;
+		std::vector<uint32_t> indices;
+
+		uint64_t vertexBase = 0;
+		uint64_t indexBase = 0;
+	};
+
+	struct FaceCorner
+	{
+		int64_t position;
+		int64_t normal;
+		bool relativePosition;
+		bool relativeNormal;
+	};
+
+	const double powersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool isDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+	inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline void skipSpace(const char*& p, const char* end)
+	{
+		while (p < end && isSpace(*p))
+			p++;
+	}
+
+	// Eight ASCII digits at once, SWAR on a little endian 64 bit load.
+	inline bool parseEightDigits(const char* p, uint32_t& value)
+	{
+		uint64_t chunk;
+		memcpy(&chunk, p, sizeof(chunk));
+
+		if ((((chunk & 0xF0F0F0F0F0F0F0F0ull) | (((chunk + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4))) != 0x3333333333333333ull)
+			return false;
+
+		chunk = (chunk & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+		chunk = (chunk & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+		value = static_cast<uint32_t>((chunk & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32);
+		return true;
+	}
+
+	// Accumulates up to 19 significant digits, later integer digits only
+	// scale the exponent and later fraction digits are dropped.
+	inline void readDigits(const char*& p, const char* end, uint64_t& mantissa, int& digits, int& exponent, bool fraction)
+	{
+		uint32_t eight;
+		while (end - p >= 8 && digits <= 11 && parseEightDigits(p, eight))
+		{
+			mantissa = mantissa * 100000000 + eight;
+			digits += 8;
+			p += 8;
+			if (fraction)
+				exponent -= 8;
+		}
+
+		while (p < end && isDigit(*p))
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				digits++;
+				if (fraction)
+					exponent--;
+			}
+			else if (!fraction)
+			{
+				exponent++;
+			}
+			p++;
+		}
+	}
+
+	// Anything the fast path does not understand, such as inf or nan.
+	bool parseFloatSlow(const char*& p, const char* end, float& value)
+	{
+		char token[64];
+		size_t length = 0;
+		while (p + length < end && length < sizeof(token) - 1 && !isSpace(p[length]) && p[length] != '\n')
+		{
+			token[length] = p[length];
+			length++;
+		}
+		token[length] = '\0';
+
+		char* parsedEnd;
+		value = strtof(token, &parsedEnd);
+		if (parsedEnd == token)
+			return false;
+
+		p += parsedEnd - token;
+		return true;
+	}
+
+	bool parseFloat(const char*& p, const char* end, float& value)
+	{
+		const char* start = p;
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+
+		const char* integerStart = p;
+		readDigits(p, end, mantissa, digits, exponent, false);
+		bool hasDigits = p != integerStart;
+
+		if (p < end && *p == '.')
+		{
+			p++;
+			const char* fractionStart = p;
+			readDigits(p, end, mantissa, digits, exponent, true);
+			hasDigits = hasDigits || p != fractionStart;
+		}
+
+		if (!hasDigits)
+		{
+			p = start;
+			return parseFloatSlow(p, end, value);
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* exponentStart = p++;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+			{
+				negativeExponent = *p == '-';
+				p++;
+			}
+
+			if (p < end && isDigit(*p))
+			{
+				int written = 0;
+				while (p < end && isDigit(*p))
+				{
+					if (written < 10000)
+						written = written * 10 + (*p - '0');
+					p++;
+				}
+				exponent += negativeExponent ? -written : written;
+			}
+			else
+			{
+				p = exponentStart;
+			}
+		}
+
+		double result = static_cast<double>(mantissa);
+		if (mantissa != 0)
+		{
+			if (exponent < 0)
+				result = -exponent <= 22 ? result / powersOfTen[-exponent] : result * std::pow(10.0, exponent);
+			else if (exponent > 0)
+				result = exponent <= 22 ? result * powersOfTen[exponent] : result * std::pow(10.0, exponent);
+		}
+
+		value = static_cast<float>(negative ? -result : result);
+		return true;
+	}
+
+	bool parseInt(const char*& p, const char* end, int64_t& value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			p++;
+		}
+
+		if (p >= end || !isDigit(*p))
+			return false;
+
+		int64_t result = 0;
+		while (p < end && isDigit(*p))
+			result = result * 10 + (*p++ - '0');
+
+		value = negative ? -result : result;
+		return true;
+	}
+
+	bool parseVector(const char*& p, const char* end, glm::vec3& v)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			skipSpace(p, end);
+			if (!parseFloat(p, end, v[i]))
+				return false;
+		}
+		return true;
+	}
+
+	bool parseFace(const char*& p, const char* end, Chunk& chunk, std::vector<FaceCorner>& face)
+	{
+		face.clear();
+
+		int64_t positionCount = static_cast<int64_t>(chunk.positions.size());
+		int64_t normalCount = static_cast<int64_t>(chunk.normals.size());
+
+		while (true)
+		{
+			skipSpace(p, end);
+			if (p >= end || *p == '#')
+				break;
+
+			FaceCorner corner{};
+			int64_t texcoord;
+
+			if (!parseInt(p, end, corner.position) || corner.position == 0)
+				return false;
+
+			if (p < end && *p == '/')
+			{
+				p++;
+				if (p < end && *p != '/' && !parseInt(p, end, texcoord))
+					return false;
+
+				if (p < end && *p == '/')
+				{
+					p++;
+					if (!parseInt(p, end, corner.normal) || corner.normal == 0)
+						return false;
+				}
+			}
+
+			if (p < end && !isSpace(*p))
+				return false;
+
+			// -1 is the last one written so far.
+			if (corner.position < 0)
+			{
+				corner.position += positionCount + 1;
+				corner.relativePosition = true;
+			}
+			if (corner.normal < 0)
+			{
+				corner.normal += normalCount + 1;
+				corner.relativeNormal = true;
+			}
+
+			if (corner.position < INT32_MIN || corner.position > INT32_MAX || corner.normal < INT32_MIN || corner.normal > INT32_MAX)
+				return false;
+
+			face.push_back(corner);
+		}
+
+		for (size_t i = 1; i + 1 < face.size(); i++)
+		{
+			const FaceCorner* triangle[3] = { &face[0], &face[i], &face[i + 1] };
+			for (const FaceCorner* corner : triangle)
+			{
+				uint32_t index = static_cast<uint32_t>(chunk.corners.size());
+				if (corner->relativePosition)
+					chunk.relativePositions.push_back(index);
+				if (corner->relativeNormal)
+					chunk.relativeNormals.push_back(index);
+
+				chunk.corners.push_back({ static_cast<int32_t>(corner->position), static_cast<int32_t>(corner->normal) });
+			}
+		}
+
+		return true;
+	}
+
+	void parseChunk(Chunk& chunk)
+	{
+		std::vector<FaceCorner> face;
+
+		const char* p = chunk.begin;
+		while (p < chunk.end && !chunk.failed)
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(p, '\n', chunk.end - p));
+			if (!lineEnd)
+				lineEnd = chunk.end;
+
+			skipSpace(p, lineEnd);
+
+			if (lineEnd - p >= 2 && p[0] == 'v' && isSpace(p[1]))
+			{
+				p += 2;
+				glm::vec3 position;
+				chunk.failed = !parseVector(p, lineEnd, position);
+				chunk.positions.push_back(position);
+			}
+			else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+			{
+				p += 3;
+				glm::vec3 normal;
+				chunk.failed = !parseVector(p, lineEnd, normal);
+				chunk.normals.push_back(normal);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'f' && isSpace(p[1]))
+			{
+				p += 2;
+				chunk.failed = !parseFace(p, lineEnd, chunk, face);
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+
+	template<typename F>
+	void forEachChunk(JobSystem* jobs, std::vector<Chunk>& chunks, F&& function)
+	{
+		uint32_t count = static_cast<uint32_t>(chunks.size());
+		if (!jobs)
+		{
+			for (uint32_t i = 0; i < count; i++)
+				function(i);
+			return;
+		}
+
+		jobs->parallelFor(count, 1, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++)
+				function(i);
+		});
+	}
+
+	// Chunk holding the index, looked for in the given chunk first since
+	// faces mostly refer to nearby data.
+	const Chunk& chunkOf(const std::vector<Chunk>& chunks, uint32_t hint, uint64_t index, uint64_t Chunk::* base, size_t (*count)(const Chunk&))
+	{
+		const Chunk& own = chunks[hint];
+		if (index >= own.*base && index < own.*base + count(own))
+			return own;
+
+		auto it = std::upper_bound(chunks.begin(), chunks.end(), index, [&](uint64_t value, const Chunk& chunk) {
+			return value < chunk.*base;
+		});
+		return *(it - 1);
+	}
+
+	size_t positionCount(const Chunk& chunk) { return chunk.positions.size(); }
+	size_t normalCount(const Chunk& chunk) { return chunk.normals.size(); }
+}
+
+bool parseOBJ(const char* path, Mesh& mesh, JobSystem* jobs)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		std::cerr << "OBJ Error: cannot open " << path << std::endl;
+		return false;
+	}
+
+	const char* data = file.data();
+	const char* dataEnd = data + file.size();
+
+	// A few chunks per thread so that uneven chunks still balance out.
+	uint32_t threads = jobs ? jobs->threadCount() : 1;
+	size_t chunkSize = std::max<size_t>(file.size() / (threads * 4), 1 << 20);
+
+	std::vector<Chunk> chunks;
+	for (const char* begin = data; begin < dataEnd;)
+	{
+		const char* end = begin + std::min<size_t>(chunkSize, dataEnd - begin);
+		const char* newline = end < dataEnd ? static_cast<const char*>(memchr(end, '\n', dataEnd - end)) : nullptr;
+		end = newline ? newline + 1 : dataEnd;
+
+		chunks.emplace_back();
+		chunks.back().begin = begin;
+		chunks.back().end = end;
+		begin = end;
+	}
+
+	forEachChunk(jobs, chunks, [&](uint32_t i) { parseChunk(chunks[i]); });
+
+	uint64_t positionTotal = 0;
+	uint64_t normalTotal = 0;
+	for (Chunk& chunk : chunks)
+	{
+		if (chunk.failed)
+		{
+			std::cerr << "OBJ Error: malformed line in " << path << std::endl;
+			return false;
+		}
+
+		chunk.positionBase = positionTotal;
+		chunk.normalBase = normalTotal;
+		positionTotal += chunk.positions.size();
+		normalTotal += chunk.normals.size();
+	}
+
+	if (positionTotal > INT32_MAX || normalTotal > INT32_MAX)
+	{
+		std::cerr << "OBJ Error: too many positions in " << path << std::endl;
+		return false;
+	}
+
+	forEachChunk(jobs, chunks, [&](uint32_t i) {
+		Chunk& chunk = chunks[i];
+
+		for (uint32_t corner : chunk.relativePositions)
+			chunk.corners[corner].position += static_cast<int32_t>(chunk.positionBase);
+		for (uint32_t corner : chunk.relativeNormals)
+			chunk.corners[corner].normal += static_cast<int32_t>(chunk.normalBase);
+
+		for (const Corner& corner : chunk.corners)
+		{
+			if (corner.position < 1 || corner.position > static_cast<int64_t>(positionTotal) || corner.normal < 0 || corner.normal > static_cast<int64_t>(normalTotal))
+			{
+				chunk.failed = true;
+				return;
+			}
+
+			chunk.withNormal |= corner.normal != 0;
+			chunk.withoutNormal |= corner.normal == 0;
+			chunk.splitNormal |= corner.normal != 0 && corner.normal != corner.position;
+		}
+	});
+
+	bool withNormal = false;
+	bool withoutNormal = false;
+	bool splitNormal = false;
+	uint64_t indexTotal = 0;
+	for (Chunk& chunk : chunks)
+	{
+		if (chunk.failed)
+		{
+			std::cerr << "OBJ Error: face index out of range in " << path << std::endl;
+			return false;
+		}
+
+		withNormal |= chunk.withNormal;
+		withoutNormal |= chunk.withoutNormal;
+		splitNormal |= chunk.splitNormal;
+
+		chunk.indexBase = indexTotal;
+		indexTotal += chunk.corners.size();
+	}
+
+	mesh.indices.resize(indexTotal);
+	std::vector<uint32_t> vertexPositions;
+
+	if (!splitNormal && !(withNormal && withoutNormal))
+	{
+		// Every position has at most one normal, the common case for
+		// exported meshes, so vertices map one to one onto positions and
+		// need no merging.
+		mesh.vertices.resize(positionTotal);
+
+		forEachChunk(jobs, chunks, [&](uint32_t i) {
+			Chunk& chunk = chunks[i];
+
+			Vertex* vertices = mesh.vertices.data() + chunk.positionBase;
+			for (size_t j = 0; j < chunk.positions.size(); j++)
+			{
+				uint64_t position = chunk.positionBase + j;
+				vertices[j].position = chunk.positions[j];
+
+				if (withNormal && position < normalTotal)
+				{
+					const Chunk& normalChunk = chunkOf(chunks, i, position, &Chunk::normalBase, normalCount);
+					vertices[j].normal = normalChunk.normals[position - normalChunk.normalBase];
+				}
+				else
+				{
+					vertices[j].normal = glm::vec3(0.f);
+				}
+			}
+
+			uint32_t* indices = mesh.indices.data() + chunk.indexBase;
+			for (size_t j = 0; j < chunk.corners.size(); j++)
+				indices[j] = static_cast<uint32_t>(chunk.corners[j].position - 1);
+		});
+	}
+	else
+	{
+		// Merge corners with the same position and normal into one vertex.
+		// Merging is per chunk, so a vertex shared across a chunk boundary is
+		// stored once per chunk.
+		forEachChunk(jobs, chunks, [&](uint32_t i) {
+			Chunk& chunk = chunks[i];
+
+			std::unordered_map<uint64_t, uint32_t> vertexOf;
+			chunk.indices.reserve(chunk.corners.size());
+
+			for (const Corner& corner : chunk.corners)
+			{
+				int64_t position = static_cast<int64_t>(corner.position) - 1;
+				int64_t normal = static_cast<int64_t>(corner.normal) - 1;
+
+				uint64_t key = (static_cast<uint64_t>(position) << 32) | static_cast<uint32_t>(normal);
+				auto it = vertexOf.find(key);
+				if (it != vertexOf.end())
+				{
+					chunk.indices.push_back(it->second);
+					continue;
+				}
+
+				Vertex vertex;
+				const Chunk& positionChunk = chunkOf(chunks, i, position, &Chunk::positionBase, positionCount);
+				vertex.position = positionChunk.positions[position - positionChunk.positionBase];
+
+				if (normal >= 0)
+				{
+					const Chunk& normalChunk = chunkOf(chunks, i, normal, &Chunk::normalBase, normalCount);
+					vertex.normal = normalChunk.normals[normal - normalChunk.normalBase];
+				}
+				else
+				{
+					vertex.normal = glm::vec3(0.f);
+				}
+
+				uint32_t index = static_cast<uint32_t>(chunk.vertices.size());
+				vertexOf.emplace(key, index);
+				chunk.vertices.push_back(vertex);
+				chunk.vertexPositions.push_back(static_cast<uint32_t>(position));
+				chunk.indices.push_back(index);
+			}
+
+			chunk.corners = std::vector<Corner>();
+		});
+
+		uint64_t vertexTotal = 0;
+		for (Chunk& chunk : chunks)
+		{
+			chunk.vertexBase = vertexTotal;
+			vertexTotal += chunk.vertices.size();
+		}
+
+		if (vertexTotal > UINT32_MAX)
+		{
+			std::cerr << "OBJ Error: too many vertices in " << path << std::endl;
+			return false;
+		}
+
+		mesh.vertices.resize(vertexTotal);
+		vertexPositions.resize(vertexTotal);
+
+		forEachChunk(jobs, chunks, [&](uint32_t i) {
+			Chunk& chunk = chunks[i];
+			uint32_t vertexBase = static_cast<uint32_t>(chunk.vertexBase);
+
+			std::copy(chunk.vertices.begin(), chunk.vertices.end(), mesh.vertices.begin() + chunk.vertexBase);
+			std::copy(chunk.vertexPositions.begin(), chunk.vertexPositions.end(), vertexPositions.begin() + chunk.vertexBase);
+
+			uint32_t* indices = mesh.indices.data() + chunk.indexBase;
+			for (size_t j = 0; j < chunk.indices.size(); j++)
+				indices[j] = chunk.indices[j] + vertexBase;
+		});
+	}
+
+	chunks.clear();
+	chunks.shrink_to_fit();
+
+	// Vertices without a normal, or with a zero one, get the area weighted
+	// average of the faces touching their position.
+	bool missingNormals = std::any_of(mesh.vertices.begin(), mesh.vertices.end(), [](const Vertex& vertex) {
+		return vertex.normal == glm::vec3(0.f);
+	});
+
+	if (missingNormals)
+	{
+		// Without merging, vertex and position indices are the same.
+		auto positionOf = [&](uint32_t vertex) {
+			return vertexPositions.empty() ? vertex : vertexPositions[vertex];
+		};
+
+		std::vector<glm::vec3> faceNormals(positionTotal, glm::vec3(0.f));
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			uint32_t a = mesh.indices[i + 0];
+			uint32_t b = mesh.indices[i + 1];
+			uint32_t c = mesh.indices[i + 2];
+
+			glm::vec3 normal = glm::cross(mesh.vertices[b].position - mesh.vertices[a].position, mesh.vertices[c].position - mesh.vertices[a].position);
+			faceNormals[positionOf(a)] += normal;
+			faceNormals[positionOf(b)] += normal;
+			faceNormals[positionOf(c)] += normal;
+		}
+
+		for (size_t i = 0; i < mesh.vertices.size(); i++)
+		{
+			Vertex& vertex = mesh.vertices[i];
+			if (vertex.normal != glm::vec3(0.f))
+				continue;
+
+			glm::vec3 normal = faceNormals[positionOf(static_cast<uint32_t>(i))];
+			float length = glm::length(normal);
+			vertex.normal = length > 0.f ? normal / length : glm::vec3(0.f, 1.f, 0.f);
+		}
+	}
+
+	for (Vertex& vertex : mesh.vertices)
+		vertex.color = vertex.normal;
+
+	mesh.computeBounds();
+	return true;
+}
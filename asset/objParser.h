@@ -0,0 +1,11 @@
+#pragma once
+#include "../vulkan/vkMesh.h"
+
+class JobSystem;
+
+// Parses a Wavefront OBJ into an indexed mesh. The file is memory mapped and
+// split at line boundaries into chunks that are parsed in parallel on jobs,
+// or on the calling thread without a job system. Only positions, normals and
+// faces are read; faces are triangulated as fans and vertices without a
+// normal get one averaged from the faces around their position.
+bool parseOBJ(const char* path, Mesh& mesh, JobSystem* jobs);
@@ -1,47 +1,721 @@
 #include "audio.h"
+#include "stream.h"
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <iostream>
 #include "libsndfile/sndfile.h"
-#include "openal/alext.h"
+#include "sdl/SDL.h"
+#include <cstring>
 #include <thread>
 #include "util.h"
 
-void Audio::init()
+// How long the audio thread sleeps once it ran out of commands. Streams are
+// refilled about this often.
+static constexpr std::chrono::milliseconds threadPeriod(2);
+
+void Audio::init(AudioOutput output)
 {
-	device = alcOpenDevice(NULL);
-	
-	if (device)
+	this->output = output;
+
+	if (output != AUDIO_OUTPUT_DEVICE && !openLoopback())
 	{
-		context = alcCreateContext(device, NULL);
-		alcMakeContextCurrent(context);
+		std::cout << "ALC_SOFT_loopback not available, using the default device" << std::endl;
+		this->output = AUDIO_OUTPUT_DEVICE;
+	}
+
+	if (this->output == AUDIO_OUTPUT_DEVICE)
+	{
+		device = alcOpenDevice(NULL);
+	
+		if (device)
+		{
+			context = alcCreateContext(device, NULL);
+			alcMakeContextCurrent(context);
+		}
 	}
 
+	mixer.init(sampleRate);
+
+	util::Extensions& extensions = util::extensions();
+	extensions.multichannel = alIsExtensionPresent("AL_EXT_MCFORMATS") == AL_TRUE;
+	extensions.float32 = alIsExtensionPresent("AL_EXT_float32") == AL_TRUE;
+	extensions.ima4 = alIsExtensionPresent("AL_EXT_IMA4") == AL_TRUE;
+
 	if (alIsExtensionPresent("EAX2.0") == AL_FALSE)
 		std::cout << "EAX2.0 not available" << std::endl;
+
+	if (alIsExtensionPresent("AL_SOFT_deferred_updates"))
+	{
+		deferUpdates = reinterpret_cast<LPALDEFERUPDATESSOFT>(alGetProcAddress("alDeferUpdatesSOFT"));
+		processUpdates = reinterpret_cast<LPALPROCESSUPDATESSOFT>(alGetProcAddress("alProcessUpdatesSOFT"));
+	}
+	if (!deferUpdates || !processUpdates)
+	{
+		std::cout << "AL_SOFT_deferred_updates not available" << std::endl;
+		deferUpdates = nullptr;
+		processUpdates = nullptr;
+	}
+
+	voices.init();
+	dirty = AUDIO_DIRTY_POS | AUDIO_DIRTY_VELOCITY | AUDIO_DIRTY_ORIENTATION | AUDIO_DIRTY_GAIN;
+
+	// From here on only the audio thread calls into OpenAL, until cleanup()
+	// stopped it.
+	thread = std::thread(&Audio::threadLoop, this);
 }
 
 void Audio::cleanup()
 {
+	if (thread.joinable())
+	{
+		AudioCommand command;
+		command.type = AUDIO_COMMAND_QUIT;
+		send(command);
+		while (!pendingCommands.empty())
+		{
+			flushCommands();
+			std::this_thread::yield();
+		}
+		thread.join();
+	}
+
+	if (outputDevice)
+	{
+		SDL_CloseAudioDevice(outputDevice);
+		outputDevice = 0;
+	}
+
+	mixer.cleanup();
+	streams.clear();
+	voices.cleanup();
+	sounds.cleanup();
+	playSerials.clear();
+	pendingEvents.clear();
+	pendingCommands.clear();
+	emitterStates.clear();
+	freeEmitters.clear();
+
 	alcMakeContextCurrent(context);
 	alcDestroyContext(context);
 	alcCloseDevice(device);
 }
 
+void Audio::update(float dt)
+{
+	AudioEvent event;
+	while (events.pop(event))
+	{
+		if (event.type == AUDIO_EVENT_FINISHED)
+		{
+			EmitterState& state = emitterStates[event.target];
+			if (state.serial == event.serial)
+				state.playing = false;
+		}
+		else if (event.type == AUDIO_EVENT_UNDERRUN)
+		{
+			streamUnderruns++;
+		}
+	}
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_UPDATE;
+	command.values[0] = dt;
+	send(command);
+}
+
+void Audio::finish()
+{
+	if (!thread.joinable())
+		return;
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_FENCE;
+	command.integer = static_cast<int32_t>(++fenceSerial);
+	send(command);
+
+	while (completedFence.load(std::memory_order_acquire) != fenceSerial)
+	{
+		flushCommands();
+		std::this_thread::yield();
+	}
+}
+
+void Audio::send(const AudioCommand& command)
+{
+	// Commands that didn't fit go first, so the order is kept.
+	if (!pendingCommands.empty())
+		flushCommands();
+
+	if (pendingCommands.empty() && commands.push(command))
+		return;
+	pendingCommands.push_back(command);
+}
+
+void Audio::flushCommands()
+{
+	size_t sent = 0;
+	while (sent < pendingCommands.size() && commands.push(pendingCommands[sent]))
+		sent++;
+	pendingCommands.erase(pendingCommands.begin(), pendingCommands.begin() + sent);
+}
+
+void Audio::post(const AudioEvent& event)
+{
+	if (pendingEvents.empty() && events.push(event))
+		return;
+	pendingEvents.push_back(event);
+}
+
+void Audio::threadLoop()
+{
+	AudioCommand command;
+	while (true)
+	{
+		while (commands.pop(command))
+		{
+			if (command.type == AUDIO_COMMAND_QUIT)
+			{
+				if (deferring)
+					endFrame(0.f);
+				for (AudioStream* stream : streams)
+					stream->destroySource();
+				return;
+			}
+
+			// Everything up to the end of the frame reaches OpenAL at once.
+			if (!deferring)
+			{
+				if (deferUpdates)
+					deferUpdates();
+				else
+					alcSuspendContext(context);
+				deferring = true;
+			}
+
+			if (command.type == AUDIO_COMMAND_UPDATE)
+				endFrame(command.values[0]);
+			else
+				execute(command);
+		}
+
+		updateStreams();
+
+		size_t sent = 0;
+		while (sent < pendingEvents.size() && events.push(pendingEvents[sent]))
+			sent++;
+		pendingEvents.erase(pendingEvents.begin(), pendingEvents.begin() + sent);
+
+		std::this_thread::sleep_for(threadPeriod);
+	}
+}
+
+void Audio::endFrame(float dt)
+{
+	commitListener();
+
+	voices.update(listenerPos, dt);
+	for (EmitterID id : voices.getFinished())
+	{
+		AudioEvent event;
+		event.type = AUDIO_EVENT_FINISHED;
+		event.target = id;
+		event.serial = playSerials[id];
+		post(event);
+	}
+
+	if (processUpdates)
+		processUpdates();
+	else
+		alcProcessContext(context);
+	deferring = false;
+
+	mixer.setListener(listenerPos, listenerFront, listenerUp);
+
+	// Nothing pulls the null output, render what the frame played so sources
+	// advance like they would on a device.
+	if (output == AUDIO_OUTPUT_NULL)
+	{
+		nullFrames += static_cast<double>(dt) * sampleRate;
+		uint32_t frames = static_cast<uint32_t>(nullFrames);
+		nullFrames -= frames;
+
+		nullBuffer.resize(static_cast<size_t>(frames) * 2);
+		if (frames > 0)
+			render(nullBuffer.data(), frames);
+	}
+}
+
+void Audio::updateStreams()
+{
+	for (AudioStream* stream : streams)
+	{
+		uint32_t underruns = stream->getUnderruns();
+		stream->update();
+
+		if (stream->getUnderruns() != underruns)
+		{
+			AudioEvent event;
+			event.type = AUDIO_EVENT_UNDERRUN;
+			event.stream = stream;
+			post(event);
+		}
+	}
+}
+
+void Audio::execute(const AudioCommand& command)
+{
+	EmitterID id = command.target;
+
+	switch (command.type)
+	{
+	case AUDIO_COMMAND_FENCE:
+		completedFence.store(static_cast<uint32_t>(command.integer), std::memory_order_release);
+		break;
+
+	case AUDIO_COMMAND_LISTENER_POS:
+		if (command.vectors[0] != listenerPos)
+		{
+			listenerPos = command.vectors[0];
+			dirty |= AUDIO_DIRTY_POS;
+		}
+		break;
+	case AUDIO_COMMAND_LISTENER_VELOCITY:
+		if (command.vectors[0] != listenerVelocity)
+		{
+			listenerVelocity = command.vectors[0];
+			dirty |= AUDIO_DIRTY_VELOCITY;
+		}
+		break;
+	case AUDIO_COMMAND_LISTENER_ORIENTATION:
+		if (command.vectors[0] != listenerFront || command.vectors[1] != listenerUp)
+		{
+			listenerFront = command.vectors[0];
+			listenerUp = command.vectors[1];
+			dirty |= AUDIO_DIRTY_ORIENTATION;
+		}
+		break;
+	case AUDIO_COMMAND_GLOBAL_GAIN:
+		if (command.values[0] != gain)
+		{
+			gain = command.values[0];
+			dirty |= AUDIO_DIRTY_GAIN;
+		}
+		break;
+
+	case AUDIO_COMMAND_ADD_EMITTER:
+		if (id >= playSerials.size())
+			playSerials.resize(id + 1, 0);
+		voices.addEmitter(id);
+		break;
+	case AUDIO_COMMAND_REMOVE_EMITTER:
+		voices.removeEmitter(id);
+		break;
+	case AUDIO_COMMAND_SET_SOUND:
+	{
+		SoundID sound = static_cast<SoundID>(command.integer);
+		voices.setBuffer(id, sounds.upload(sound), sounds.getDuration(sound));
+		break;
+	}
+	case AUDIO_COMMAND_PLAY:
+		playSerials[id] = static_cast<uint32_t>(command.integer);
+		voices.play(id);
+		break;
+	case AUDIO_COMMAND_PAUSE:
+		voices.pause(id);
+		break;
+	case AUDIO_COMMAND_POS:
+		voices.setPos(id, command.vectors[0]);
+		break;
+	case AUDIO_COMMAND_VELOCITY:
+		voices.setVelocity(id, command.vectors[0]);
+		break;
+	case AUDIO_COMMAND_GAIN:
+		voices.setGain(id, command.values[0]);
+		break;
+	case AUDIO_COMMAND_LOOPING:
+		voices.setLooping(id, command.integer != 0);
+		break;
+	case AUDIO_COMMAND_PRIORITY:
+		voices.setPriority(id, command.integer);
+		break;
+	case AUDIO_COMMAND_DISTANCES:
+		voices.setDistances(id, command.values[0], command.values[1]);
+		break;
+	case AUDIO_COMMAND_OCCLUSION:
+		voices.setOcclusion(id, command.values[0]);
+		break;
+	case AUDIO_COMMAND_UPLOAD_SOUND:
+		sounds.upload(command.target);
+		break;
+	case AUDIO_COMMAND_RELEASE_SOUND:
+		sounds.release(command.target);
+		break;
+
+	case AUDIO_COMMAND_ADD_STREAM:
+		if (std::find(streams.begin(), streams.end(), command.stream) == streams.end() && command.stream->createSource())
+			streams.push_back(command.stream);
+		break;
+	case AUDIO_COMMAND_REMOVE_STREAM:
+		if (std::find(streams.begin(), streams.end(), command.stream) != streams.end())
+		{
+			command.stream->destroySource();
+			streams.erase(std::remove(streams.begin(), streams.end(), command.stream), streams.end());
+		}
+		break;
+	case AUDIO_COMMAND_PLAY_STREAM:
+		command.stream->play();
+		break;
+	case AUDIO_COMMAND_PAUSE_STREAM:
+		command.stream->pause();
+		break;
+	case AUDIO_COMMAND_STREAM_POS:
+		command.stream->setPos(command.vectors[0]);
+		break;
+	}
+}
+
+bool Audio::openLoopback()
+{
+	if (!alcIsExtensionPresent(NULL, "ALC_SOFT_loopback"))
+		return false;
+
+	auto loopbackOpenDevice = reinterpret_cast<LPALCLOOPBACKOPENDEVICESOFT>(alcGetProcAddress(NULL, "alcLoopbackOpenDeviceSOFT"));
+	auto isRenderFormatSupported = reinterpret_cast<LPALCISRENDERFORMATSUPPORTEDSOFT>(alcGetProcAddress(NULL, "alcIsRenderFormatSupportedSOFT"));
+	renderSamples = reinterpret_cast<LPALCRENDERSAMPLESSOFT>(alcGetProcAddress(NULL, "alcRenderSamplesSOFT"));
+	if (!loopbackOpenDevice || !isRenderFormatSupported || !renderSamples)
+		return false;
+
+	device = loopbackOpenDevice(NULL);
+	if (!device)
+		return false;
+
+	if (!isRenderFormatSupported(device, static_cast<ALCsizei>(sampleRate), ALC_STEREO_SOFT, ALC_FLOAT_SOFT))
+	{
+		alcCloseDevice(device);
+		device = nullptr;
+		return false;
+	}
+
+	ALCint attributes[] = {
+		ALC_FORMAT_CHANNELS_SOFT, ALC_STEREO_SOFT,
+		ALC_FORMAT_TYPE_SOFT, ALC_FLOAT_SOFT,
+		ALC_FREQUENCY, static_cast<ALCint>(sampleRate),
+		0
+	};
+	context = alcCreateContext(device, attributes);
+	alcMakeContextCurrent(context);
+
+	if (output == AUDIO_OUTPUT_NULL)
+		return true;
+
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+	{
+		std::cerr << "Audio Error: " << SDL_GetError() << std::endl;
+		return true;
+	}
+
+	SDL_AudioSpec want = {};
+	want.freq = static_cast<int>(sampleRate);
+	want.format = AUDIO_F32SYS;
+	want.channels = 2;
+	want.samples = 512;
+	want.callback = &Audio::outputCallback;
+	want.userdata = this;
+
+	SDL_AudioSpec have;
+	outputDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+	if (!outputDevice)
+	{
+		std::cerr << "Audio Error: " << SDL_GetError() << std::endl;
+		return true;
+	}
+
+	SDL_PauseAudioDevice(outputDevice, 0);
+	return true;
+}
+
+void Audio::outputCallback(void* userdata, uint8_t* stream, int length)
+{
+	Audio* audio = static_cast<Audio*>(userdata);
+	audio->render(reinterpret_cast<float*>(stream), static_cast<uint32_t>(length) / (2 * sizeof(float)));
+}
+
+void Audio::render(float* out, uint32_t frames)
+{
+	if (renderSamples)
+		renderSamples(device, out, static_cast<ALCsizei>(frames));
+	else
+		memset(out, 0, frames * 2 * sizeof(float));
+
+	mixer.mix(out, frames);
+}
+
+void Audio::commitListener()
+{
+	if (dirty & AUDIO_DIRTY_POS)
+		alListener3f(AL_POSITION, listenerPos.x, listenerPos.y, listenerPos.z);
+
+	if (dirty & AUDIO_DIRTY_VELOCITY)
+		alListener3f(AL_VELOCITY, listenerVelocity.x, listenerVelocity.y, listenerVelocity.z);
+
+	if (dirty & AUDIO_DIRTY_ORIENTATION)
+	{
+		ALfloat orientation[6] = { listenerFront.x, listenerFront.y, listenerFront.z, listenerUp.x, listenerUp.y, listenerUp.z };
+		alListenerfv(AL_ORIENTATION, orientation);
+	}
+
+	if (dirty & AUDIO_DIRTY_GAIN)
+		alListenerf(AL_GAIN, gain);
+
+	dirty = 0;
+}
+
+void Audio::addStream(AudioStream* stream)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_ADD_STREAM;
+	command.stream = stream;
+	send(command);
+}
+
+void Audio::removeStream(AudioStream* stream)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_REMOVE_STREAM;
+	command.stream = stream;
+	send(command);
+}
+
+void Audio::playStream(AudioStream* stream)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_PLAY_STREAM;
+	command.stream = stream;
+	send(command);
+}
+
+void Audio::pauseStream(AudioStream* stream)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_PAUSE_STREAM;
+	command.stream = stream;
+	send(command);
+}
+
+void Audio::setStreamPos(AudioStream* stream, glm::vec3 pos)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_STREAM_POS;
+	command.stream = stream;
+	command.vectors[0] = pos;
+	send(command);
+}
+
+EmitterID Audio::addEmitter()
+{
+	EmitterID id;
+	if (!freeEmitters.empty())
+	{
+		id = freeEmitters.back();
+		freeEmitters.pop_back();
+	}
+	else
+	{
+		id = static_cast<EmitterID>(emitterStates.size());
+		emitterStates.emplace_back();
+	}
+
+	// The serial carries over, late events for the previous emitter with
+	// this id don't match.
+	uint32_t serial = emitterStates[id].serial;
+	emitterStates[id] = EmitterState();
+	emitterStates[id].serial = serial;
+	emitterStates[id].alive = true;
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_ADD_EMITTER;
+	command.target = id;
+	send(command);
+	return id;
+}
+
+void Audio::removeEmitter(EmitterID id)
+{
+	if (id >= emitterStates.size() || !emitterStates[id].alive)
+		return;
+
+	emitterStates[id].alive = false;
+	emitterStates[id].playing = false;
+	freeEmitters.push_back(id);
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_REMOVE_EMITTER;
+	command.target = id;
+	send(command);
+}
+
+void Audio::setEmitterSound(EmitterID id, SoundID sound)
+{
+	emitterStates[id].hasSound = sound != SoundCache::noSound;
+	emitterStates[id].playing = false;
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_SET_SOUND;
+	command.target = id;
+	command.integer = static_cast<int32_t>(sound);
+	send(command);
+}
+
+void Audio::uploadSound(SoundID sound)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_UPLOAD_SOUND;
+	command.target = sound;
+	send(command);
+}
+
+void Audio::releaseSound(SoundID sound)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_RELEASE_SOUND;
+	command.target = sound;
+	send(command);
+}
+
+void Audio::playEmitter(EmitterID id)
+{
+	EmitterState& state = emitterStates[id];
+	if (!state.hasSound)
+		return;
+
+	// Sent even if it looks playing, the finish may not be reported yet.
+	state.playing = true;
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_PLAY;
+	command.target = id;
+	command.integer = static_cast<int32_t>(++state.serial);
+	send(command);
+}
+
+void Audio::pauseEmitter(EmitterID id)
+{
+	emitterStates[id].playing = false;
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_PAUSE;
+	command.target = id;
+	send(command);
+}
+
+void Audio::setEmitterPos(EmitterID id, glm::vec3 pos)
+{
+	if (pos == emitterStates[id].pos)
+		return;
+	emitterStates[id].pos = pos;
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_POS;
+	command.target = id;
+	command.vectors[0] = pos;
+	send(command);
+}
+
+void Audio::setEmitterVelocity(EmitterID id, glm::vec3 velocity)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_VELOCITY;
+	command.target = id;
+	command.vectors[0] = velocity;
+	send(command);
+}
+
+void Audio::setEmitterGain(EmitterID id, float gain)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_GAIN;
+	command.target = id;
+	command.values[0] = gain;
+	send(command);
+}
+
+void Audio::setEmitterLooping(EmitterID id, bool looping)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_LOOPING;
+	command.target = id;
+	command.integer = looping ? 1 : 0;
+	send(command);
+}
+
+void Audio::setEmitterPriority(EmitterID id, int32_t priority)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_PRIORITY;
+	command.target = id;
+	command.integer = priority;
+	send(command);
+}
+
+void Audio::setEmitterDistances(EmitterID id, float referenceDistance, float maxDistance)
+{
+	emitterStates[id].maxDistance = maxDistance;
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_DISTANCES;
+	command.target = id;
+	command.values[0] = referenceDistance;
+	command.values[1] = maxDistance;
+	send(command);
+}
+
+void Audio::setEmitterOcclusion(EmitterID id, float occlusion)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_OCCLUSION;
+	command.target = id;
+	command.values[0] = occlusion;
+	send(command);
+}
+
 glm::vec3 Audio::getListenerPos()
 {
-	return listenerPos;
+	return queuedListenerPos;
 }
 
 void Audio::setListenerPos(glm::vec3 listenerPos)
 {
-	this->listenerPos = listenerPos;
+	if (listenerPos == queuedListenerPos)
+		return;
+	queuedListenerPos = listenerPos;
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_LISTENER_POS;
+	command.vectors[0] = listenerPos;
+	send(command);
+}
+
+void Audio::setListenerVelocity(glm::vec3 velocity)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_LISTENER_VELOCITY;
+	command.vectors[0] = velocity;
+	send(command);
+}
+
+void Audio::setListenerOrientation(glm::vec3 front, glm::vec3 up)
+{
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_LISTENER_ORIENTATION;
+	command.vectors[0] = front;
+	command.vectors[1] = up;
+	send(command);
 }
 
 float Audio::getGlobalGain()
 {
-	float gain;
-	alGetListenerf(AL_GAIN, &gain);
-	return gain;
+	return queuedGain;
 }
 
 void Audio::setGlobalGain(float gain)
@@ -52,5 +726,12 @@ void Audio::setGlobalGain(float gain)
 	else if (vol > 5.f)
 		vol = 5.f;
 
-	alListenerf(AL_GAIN, vol);
-}
\ No newline at end of file
+	if (vol == queuedGain)
+		return;
+	queuedGain = vol;
+
+	AudioCommand command;
+	command.type = AUDIO_COMMAND_GLOBAL_GAIN;
+	command.values[0] = vol;
+	send(command);
+}
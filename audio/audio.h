@@ -1,23 +1,184 @@
 #pragma once
 #include "openal/al.h"
 #include "openal/alc.h"
+#include "openal/alext.h"
+#include <atomic>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 #include "glm/glm.hpp"
+#include "soundCache.h"
+#include "voiceManager.h"
+#include "mixer.h"
+#include "commands.h"
+#include "../core/spscRing.h"
 
+class AudioStream;
+
+enum AudioOutput
+{
+	// OpenAL plays on the default device.
+	AUDIO_OUTPUT_DEVICE,
+	// OpenAL renders through ALC_SOFT_loopback, the mixer adds its voices and
+	// SDL plays the result.
+	AUDIO_OUTPUT_LOOPBACK,
+	// Like loopback but the result is dropped, for runs without a sound card.
+	// Call render() to look at the output.
+	AUDIO_OUTPUT_NULL
+};
+
+// OpenAL runs on an audio thread started by init(). The game thread, the
+// one calling update(), only queues small commands for it and reads back
+// events, so it never waits on the driver. Commands are applied in order and
+// every update() ends a frame that is committed in one batch.
 class Audio
 {
+	// Game thread copy of an emitter, so questions don't go to the audio thread.
+	struct EmitterState
+	{
+		glm::vec3 pos = glm::vec3(0.f);
+		float maxDistance = 100.f;
+		// Counts plays, finish events of an earlier one are ignored.
+		uint32_t serial = 0;
+		bool hasSound = false;
+		bool playing = false;
+		bool alive = false;
+	};
+
 	ALCdevice* device;
 	ALCcontext* context;
 
-	glm::vec3 listenerPos;
+	AudioOutput output = AUDIO_OUTPUT_DEVICE;
+	uint32_t sampleRate = 48000;
+	LPALCRENDERSAMPLESSOFT renderSamples = nullptr;
+	// SDL_AudioDeviceID of the loopback output.
+	uint32_t outputDevice = 0;
+
+	// Thread safe, or only touched before the audio thread starts and after
+	// it stopped.
+	SoundCache sounds;
+	Mixer mixer;
+	SpscRing<AudioCommand, 4096> commands;
+	SpscRing<AudioEvent, 1024> events;
+	std::thread thread;
+	std::atomic<uint32_t> completedFence{ 0 };
+
+	// Audio thread.
+	// Frames the null output owes the simulation, and where they go.
+	double nullFrames = 0.0;
+	std::vector<float> nullBuffer;
+
+	// AL_SOFT_deferred_updates, the context is suspended instead without it.
+	LPALDEFERUPDATESSOFT deferUpdates = nullptr;
+	LPALPROCESSUPDATESSOFT processUpdates = nullptr;
+	bool deferring = false;
+
+	// Listener state is committed once per frame, dirty holds AudioDirtyFlags.
+	glm::vec3 listenerPos = glm::vec3(0.f);
+	glm::vec3 listenerVelocity = glm::vec3(0.f);
+	glm::vec3 listenerFront = glm::vec3(0.f, 0.f, -1.f);
+	glm::vec3 listenerUp = glm::vec3(0.f, 1.f, 0.f);
+	float gain = 1.f;
+	uint32_t dirty = 0;
+
+	VoiceManager voices;
+	std::vector<AudioStream*> streams;
+	std::vector<uint32_t> playSerials;
+	// Events that didn't fit in the ring, sent first next time.
+	std::vector<AudioEvent> pendingEvents;
+
+	// Game thread.
+	std::vector<AudioCommand> pendingCommands;
+	std::vector<EmitterState> emitterStates;
+	std::vector<EmitterID> freeEmitters;
+	glm::vec3 queuedListenerPos = glm::vec3(0.f);
+	float queuedGain = 1.f;
+	uint32_t fenceSerial = 0;
+	uint32_t streamUnderruns = 0;
+
+	void threadLoop();
+	void execute(const AudioCommand& command);
+	void endFrame(float dt);
+	void updateStreams();
+	void post(const AudioEvent& event);
+	void commitListener();
+
+	void send(const AudioCommand& command);
+	void flushCommands();
+
+	bool openLoopback();
+	static void outputCallback(void* userdata, uint8_t* stream, int length);
 
 public:
-	void init();
+	// Falls back to the default device if loopback is not available.
+	void init(AudioOutput output = AUDIO_OUTPUT_DEVICE);
+	// Stops the audio thread, then releases everything.
 	void cleanup();
 
+	// Ends the frame, must be called once per frame. Reads back events and
+	// has the audio thread commit every change since the last call in one
+	// batch.
+	void update(float dt);
+	// Waits until the audio thread ran every command sent so far. For
+	// teardown and loading, not for every frame.
+	void finish();
+
+	SoundCache& getSounds() { return sounds; }
+	// Only heard with the loopback and null outputs.
+	Mixer& getMixer() { return mixer; }
+
+	AudioOutput getOutput() const { return output; }
+	uint32_t getSampleRate() const { return sampleRate; }
+
+	// Renders frames of interleaved stereo float: OpenAL's mix plus the
+	// mixer's voices. Loopback and null outputs only.
+	void render(float* out, uint32_t frames);
+
+	// Streams are refilled by the audio thread, which also creates their
+	// source when they are added. Once added, a stream is only controlled
+	// through the functions below, call finish() after removing one before
+	// closing it.
+	void addStream(AudioStream* stream);
+	void removeStream(AudioStream* stream);
+	void playStream(AudioStream* stream);
+	void pauseStream(AudioStream* stream);
+	void setStreamPos(AudioStream* stream, glm::vec3 pos);
+	// Underruns reported back so far, over every stream.
+	uint32_t getStreamUnderruns() const { return streamUnderruns; }
+
+	// Emitters for speakers, see VoiceManager.
+	EmitterID addEmitter();
+	void removeEmitter(EmitterID id);
+	// The sound needs a cache reference until the emitter switches away from
+	// it. Its buffer is created on first use if uploadSound() didn't already.
+	void setEmitterSound(EmitterID id, SoundID sound);
+	// Has the audio thread create the buffer of a cached sound ahead of use.
+	void uploadSound(SoundID sound);
+	// Drops a sound cache reference once earlier commands let go of it.
+	void releaseSound(SoundID sound);
+	void playEmitter(EmitterID id);
+	void pauseEmitter(EmitterID id);
+	// As of the last update(), finished playback is reported with a delay.
+	bool isEmitterPlaying(EmitterID id) const { return emitterStates[id].playing; }
+	void setEmitterPos(EmitterID id, glm::vec3 pos);
+	void setEmitterVelocity(EmitterID id, glm::vec3 velocity);
+	void setEmitterGain(EmitterID id, float gain);
+	void setEmitterLooping(EmitterID id, bool looping);
+	void setEmitterPriority(EmitterID id, int32_t priority);
+	void setEmitterDistances(EmitterID id, float referenceDistance, float maxDistance);
+	void setEmitterOcclusion(EmitterID id, float occlusion);
+
+	// Ids below this may be emitters, for walking over them.
+	uint32_t getEmitterCount() const { return static_cast<uint32_t>(emitterStates.size()); }
+	bool isEmitter(EmitterID id) const { return emitterStates[id].alive; }
+	glm::vec3 getEmitterPos(EmitterID id) const { return emitterStates[id].pos; }
+	float getEmitterMaxDistance(EmitterID id) const { return emitterStates[id].maxDistance; }
+
 	glm::vec3 getListenerPos();
 	void setListenerPos(glm::vec3 listenerPos);
+	void setListenerVelocity(glm::vec3 velocity);
+	void setListenerOrientation(glm::vec3 front, glm::vec3 up);
 
 	float getGlobalGain();
 	void setGlobalGain(float gain);
-};
\ No newline at end of file
+};
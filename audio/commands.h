@@ -0,0 +1,78 @@
+#pragma once
+#include "glm/glm.hpp"
+#include <cstdint>
+
+class AudioStream;
+
+// Sent from the game thread to the audio thread.
+enum AudioCommandType
+{
+	// Ends the frame, the audio thread commits everything since the last one.
+	// values[0] is the frame time.
+	AUDIO_COMMAND_UPDATE,
+	AUDIO_COMMAND_QUIT,
+	// integer is the serial Audio::finish() waits for.
+	AUDIO_COMMAND_FENCE,
+
+	AUDIO_COMMAND_LISTENER_POS,
+	AUDIO_COMMAND_LISTENER_VELOCITY,
+	AUDIO_COMMAND_LISTENER_ORIENTATION,
+	AUDIO_COMMAND_GLOBAL_GAIN,
+
+	AUDIO_COMMAND_ADD_EMITTER,
+	AUDIO_COMMAND_REMOVE_EMITTER,
+	// integer is the sound, see SoundCache.
+	AUDIO_COMMAND_SET_SOUND,
+	// integer is the play serial sent back when the emitter finishes.
+	AUDIO_COMMAND_PLAY,
+	AUDIO_COMMAND_PAUSE,
+	AUDIO_COMMAND_POS,
+	AUDIO_COMMAND_VELOCITY,
+	AUDIO_COMMAND_GAIN,
+	AUDIO_COMMAND_LOOPING,
+	AUDIO_COMMAND_PRIORITY,
+	AUDIO_COMMAND_DISTANCES,
+	AUDIO_COMMAND_OCCLUSION,
+	// Creates the buffer of a decoded sound, target is the sound.
+	AUDIO_COMMAND_UPLOAD_SOUND,
+	// Drops a sound cache reference, target is the sound.
+	AUDIO_COMMAND_RELEASE_SOUND,
+
+	// The stream's source and buffers are created when it is added and
+	// deleted when it is removed.
+	AUDIO_COMMAND_ADD_STREAM,
+	AUDIO_COMMAND_REMOVE_STREAM,
+	AUDIO_COMMAND_PLAY_STREAM,
+	AUDIO_COMMAND_PAUSE_STREAM,
+	AUDIO_COMMAND_STREAM_POS
+};
+
+struct AudioCommand
+{
+	uint32_t type = AUDIO_COMMAND_UPDATE;
+	// The emitter, or the sound for AUDIO_COMMAND_UPLOAD_SOUND and
+	// AUDIO_COMMAND_RELEASE_SOUND.
+	uint32_t target = 0;
+	// Sound, serial, flag or priority.
+	int32_t integer = 0;
+	float values[2] = {};
+	glm::vec3 vectors[2] = {};
+	AudioStream* stream = nullptr;
+};
+
+// Sent from the audio thread back to the game thread.
+enum AudioEventType
+{
+	// An emitter reached the end of its sound, serial is the play it ends.
+	AUDIO_EVENT_FINISHED,
+	// A stream ran dry and was restarted.
+	AUDIO_EVENT_UNDERRUN
+};
+
+struct AudioEvent
+{
+	uint32_t type = AUDIO_EVENT_FINISHED;
+	uint32_t target = 0;
+	uint32_t serial = 0;
+	AudioStream* stream = nullptr;
+};
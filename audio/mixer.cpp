@@ -0,0 +1,265 @@
+#include "mixer.h"
+#include "libsndfile/sndfile.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Adds in[i] * left and in[i] * right to the stereo frame out[i]. Each lane
+// does one multiply and one add, in the same order as the scalar tail, so
+// results don't depend on the instruction set.
+static void mixStereo(float* out, const float* in, uint32_t frames, float left, float right)
+{
+	uint32_t i = 0;
+
+#if defined(__AVX__)
+	__m256 gains = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+	for (; i + 8 <= frames; i += 8)
+	{
+		__m256 samples = _mm256_loadu_ps(in + i);
+		// a a b b | e e f f and c c d d | g g h h, then put the halves in order.
+		__m256 low = _mm256_unpacklo_ps(samples, samples);
+		__m256 high = _mm256_unpackhi_ps(samples, samples);
+		__m256 first = _mm256_permute2f128_ps(low, high, 0x20);
+		__m256 second = _mm256_permute2f128_ps(low, high, 0x31);
+
+		float* dst = out + i * 2;
+		_mm256_storeu_ps(dst, _mm256_add_ps(_mm256_loadu_ps(dst), _mm256_mul_ps(first, gains)));
+		_mm256_storeu_ps(dst + 8, _mm256_add_ps(_mm256_loadu_ps(dst + 8), _mm256_mul_ps(second, gains)));
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	__m128 gains = _mm_setr_ps(left, right, left, right);
+	for (; i + 4 <= frames; i += 4)
+	{
+		__m128 samples = _mm_loadu_ps(in + i);
+		__m128 low = _mm_unpacklo_ps(samples, samples);
+		__m128 high = _mm_unpackhi_ps(samples, samples);
+
+		float* dst = out + i * 2;
+		_mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst), _mm_mul_ps(low, gains)));
+		_mm_storeu_ps(dst + 4, _mm_add_ps(_mm_loadu_ps(dst + 4), _mm_mul_ps(high, gains)));
+	}
+#endif
+
+	for (; i < frames; i++)
+	{
+		float l = in[i] * left;
+		float r = in[i] * right;
+		out[i * 2] += l;
+		out[i * 2 + 1] += r;
+	}
+}
+
+void Mixer::init(uint32_t sampleRate)
+{
+	this->sampleRate = sampleRate;
+}
+
+void Mixer::cleanup()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	sounds.clear();
+	voices.clear();
+	freeVoices.clear();
+}
+
+MixSoundID Mixer::loadSound(const char* fileName)
+{
+	SF_INFO info = {};
+	SNDFILE* file = sf_open(fileName, SFM_READ, &info);
+	if (!file)
+	{
+		std::cerr << "Audio Error: cannot open " << fileName << ": " << sf_strerror(nullptr) << std::endl;
+		return noSound;
+	}
+
+	std::vector<float> interleaved(static_cast<size_t>(std::max<sf_count_t>(info.frames, 0)) * info.channels);
+	sf_count_t frames = sf_readf_float(file, interleaved.data(), info.frames);
+	sf_close(file);
+
+	if (frames < 1 || info.samplerate < 1)
+	{
+		std::cerr << "Audio Error: no samples in " << fileName << std::endl;
+		return noSound;
+	}
+
+	std::vector<float> mono(static_cast<size_t>(frames));
+	for (sf_count_t i = 0; i < frames; i++)
+	{
+		float sum = 0.f;
+		for (int c = 0; c < info.channels; c++)
+			sum += interleaved[i * info.channels + c];
+		mono[i] = sum / static_cast<float>(info.channels);
+	}
+
+	if (static_cast<uint32_t>(info.samplerate) == sampleRate)
+		return addSound(std::move(mono));
+
+	// Linear resampling, once at load so mixing stays a straight copy.
+	double step = static_cast<double>(info.samplerate) / sampleRate;
+	size_t count = static_cast<size_t>(static_cast<double>(frames) / step);
+	std::vector<float> resampled(std::max<size_t>(count, 1));
+	for (size_t i = 0; i < resampled.size(); i++)
+	{
+		double source = i * step;
+		size_t index = std::min(static_cast<size_t>(source), mono.size() - 1);
+		size_t next = std::min(index + 1, mono.size() - 1);
+		float t = static_cast<float>(source - static_cast<double>(index));
+		resampled[i] = mono[index] + (mono[next] - mono[index]) * t;
+	}
+
+	return addSound(std::move(resampled));
+}
+
+MixSoundID Mixer::addSound(std::vector<float>&& samples)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	sounds.push_back(std::move(samples));
+	return static_cast<MixSoundID>(sounds.size() - 1);
+}
+
+MixVoiceID Mixer::addVoice(MixSoundID sound)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	MixVoiceID id;
+	if (!freeVoices.empty())
+	{
+		id = freeVoices.back();
+		freeVoices.pop_back();
+	}
+	else
+	{
+		id = static_cast<MixVoiceID>(voices.size());
+		voices.emplace_back();
+	}
+
+	voices[id] = Voice();
+	voices[id].sound = sound;
+	voices[id].alive = true;
+	return id;
+}
+
+void Mixer::removeVoice(MixVoiceID id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (id >= voices.size() || !voices[id].alive)
+		return;
+
+	voices[id].alive = false;
+	voices[id].playing = false;
+	freeVoices.push_back(id);
+}
+
+void Mixer::play(MixVoiceID id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (voices[id].sound < sounds.size())
+		voices[id].playing = true;
+}
+
+void Mixer::stop(MixVoiceID id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	voices[id].playing = false;
+	voices[id].position = 0;
+}
+
+void Mixer::setPos(MixVoiceID id, glm::vec3 pos)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	voices[id].pos = pos;
+}
+
+void Mixer::setGain(MixVoiceID id, float gain)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	voices[id].gain = gain;
+}
+
+void Mixer::setLooping(MixVoiceID id, bool looping)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	voices[id].looping = looping;
+}
+
+void Mixer::setListener(glm::vec3 pos, glm::vec3 front, glm::vec3 up)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	listenerPos = pos;
+
+	glm::vec3 right = glm::cross(front, up);
+	float length = glm::length(right);
+	if (length > 0.0001f)
+		listenerRight = right / length;
+}
+
+void Mixer::mix(float* out, uint32_t frames)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto start = std::chrono::steady_clock::now();
+
+	for (Voice& voice : voices)
+	{
+		if (!voice.playing)
+			continue;
+
+		const std::vector<float>& samples = sounds[voice.sound];
+		if (samples.empty())
+		{
+			voice.playing = false;
+			continue;
+		}
+
+		// Inverse distance clamped, like OpenAL's default model.
+		glm::vec3 offset = voice.pos - listenerPos;
+		float distance = glm::length(offset);
+		float clamped = std::min(std::max(distance, voice.referenceDistance), voice.maxDistance);
+		float gain = voice.gain * voice.referenceDistance / std::max(clamped, 0.0001f);
+
+		// Constant power pan, sounds on the listener are centered.
+		float pan = distance > 0.0001f ? glm::dot(offset / distance, listenerRight) : 0.f;
+		float angle = (pan + 1.f) * 0.25f * 3.14159265f;
+		float left = std::cos(angle) * gain;
+		float right = std::sin(angle) * gain;
+
+		uint32_t mixed = 0;
+		while (mixed < frames)
+		{
+			uint32_t available = static_cast<uint32_t>(samples.size()) - voice.position;
+			uint32_t count = std::min(available, frames - mixed);
+			mixStereo(out + mixed * 2, samples.data() + voice.position, count, left, right);
+
+			mixed += count;
+			voice.position += count;
+
+			if (voice.position < samples.size())
+				continue;
+
+			voice.position = 0;
+			if (!voice.looping)
+			{
+				voice.playing = false;
+				break;
+			}
+		}
+
+		mixedVoiceFrames += mixed;
+	}
+
+	mixSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double Mixer::getRealtimeVoices()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (mixSeconds <= 0.0)
+		return 0.0;
+
+	return static_cast<double>(mixedVoiceFrames) / sampleRate / mixSeconds;
+}
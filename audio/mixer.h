@@ -0,0 +1,81 @@
+#pragma once
+#include "glm/glm.hpp"
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+typedef uint32_t MixSoundID;
+typedef uint32_t MixVoiceID;
+
+// Software mixer for large voice counts, independent of the OpenAL source
+// limit. Mono sounds are attenuated by distance, panned with constant power
+// and added to an interleaved stereo float bus. Mixing is deterministic: the
+// same calls produce the same samples on every run.
+class Mixer
+{
+	struct Voice
+	{
+		MixSoundID sound = 0;
+		// Next frame of the sound to mix.
+		uint32_t position = 0;
+
+		glm::vec3 pos = glm::vec3(0.f);
+		float gain = 1.f;
+		float referenceDistance = 1.f;
+		float maxDistance = 100.f;
+
+		bool looping = false;
+		bool playing = false;
+		bool alive = false;
+	};
+
+	uint32_t sampleRate = 48000;
+
+	// mix() may run on the audio output thread, everything else on the main
+	// thread.
+	std::mutex mutex;
+
+	// Mono samples at sampleRate.
+	std::vector<std::vector<float>> sounds;
+	std::vector<Voice> voices;
+	std::vector<MixVoiceID> freeVoices;
+
+	glm::vec3 listenerPos = glm::vec3(0.f);
+	glm::vec3 listenerRight = glm::vec3(1.f, 0.f, 0.f);
+
+	// Work done by mix(), for getRealtimeVoices().
+	uint64_t mixedVoiceFrames = 0;
+	double mixSeconds = 0.0;
+
+public:
+	static constexpr MixSoundID noSound = 0xFFFFFFFF;
+
+	void init(uint32_t sampleRate);
+	void cleanup();
+
+	uint32_t getSampleRate() const { return sampleRate; }
+
+	// Decodes the file, mixes it down to mono and converts it to the mixer's
+	// rate. Returns noSound if it can't be read.
+	MixSoundID loadSound(const char* fileName);
+	// Mono samples already at the mixer's rate.
+	MixSoundID addSound(std::vector<float>&& samples);
+
+	MixVoiceID addVoice(MixSoundID sound);
+	void removeVoice(MixVoiceID id);
+
+	void play(MixVoiceID id);
+	void stop(MixVoiceID id);
+	void setPos(MixVoiceID id, glm::vec3 pos);
+	void setGain(MixVoiceID id, float gain);
+	void setLooping(MixVoiceID id, bool looping);
+
+	void setListener(glm::vec3 pos, glm::vec3 front, glm::vec3 up);
+
+	// Adds every playing voice to out, frames of interleaved stereo.
+	void mix(float* out, uint32_t frames);
+
+	// Voices that could be mixed in real time on one core, measured over
+	// every mix() so far.
+	double getRealtimeVoices();
+};
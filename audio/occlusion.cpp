@@ -0,0 +1,44 @@
+#include "occlusion.h"
+
+void AudioOcclusion::init(JobSystem* jobs, OcclusionQuery&& query)
+{
+	this->jobs = jobs;
+	this->query = std::move(query);
+}
+
+void AudioOcclusion::update(Audio& audio, glm::vec3 listenerPos)
+{
+	uint32_t count = audio.getEmitterCount();
+	batch.clear();
+	targets.clear();
+
+	if (cursor >= count)
+		cursor = 0;
+
+	// Continues from where the last update ran out of budget. Emitters that
+	// are silent or out of hearing range don't need a ray.
+	for (uint32_t visited = 0; visited < count && batch.size() < rayBudget; visited++)
+	{
+		EmitterID id = static_cast<EmitterID>(cursor);
+		cursor = (cursor + 1) % count;
+
+		if (!audio.isEmitter(id) || !audio.isEmitterPlaying(id))
+			continue;
+
+		glm::vec3 pos = audio.getEmitterPos(id);
+		if (glm::length(pos - listenerPos) > audio.getEmitterMaxDistance(id))
+			continue;
+
+		batch.push_back(id);
+		targets.push_back(pos);
+	}
+
+	blocked.assign(batch.size(), 0);
+	jobs->parallelFor(static_cast<uint32_t>(batch.size()), batchSize, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+			blocked[i] = query(listenerPos, targets[i]) ? 1 : 0;
+	});
+
+	for (size_t i = 0; i < batch.size(); i++)
+		audio.setEmitterOcclusion(batch[i], blocked[i] ? 1.f : 0.f);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "audio.h"
+#include "../core/jobSystem.h"
+#include "../core/inplaceFunction.h"
+#include "glm/glm.hpp"
+#include <vector>
+
+// Returns whether geometry lies between two points, called from job workers.
+typedef InplaceFunction<bool(glm::vec3 from, glm::vec3 to)> OcclusionQuery;
+
+// Casts rays from the listener to playing emitters and hands the results to
+// the audio thread. At most rayBudget rays are cast per update, beyond that
+// emitters take turns and each is refreshed every few updates, the voice
+// manager eases between results.
+class AudioOcclusion
+{
+	JobSystem* jobs = nullptr;
+	OcclusionQuery query;
+
+	std::vector<EmitterID> batch;
+	std::vector<glm::vec3> targets;
+	std::vector<uint8_t> blocked;
+	size_t cursor = 0;
+
+public:
+	uint32_t rayBudget = 64;
+	// Rays per job.
+	uint32_t batchSize = 16;
+
+	void init(JobSystem* jobs, OcclusionQuery&& query);
+
+	// Call on the thread that updates audio, before its update.
+	void update(Audio& audio, glm::vec3 listenerPos);
+};
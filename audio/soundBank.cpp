@@ -0,0 +1,218 @@
+#include "soundBank.h"
+#include "audio.h"
+#include "util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// OpenAL's default IMA4 block: a header sample and 64 encoded ones per
+// channel, in 36 bytes.
+constexpr uint32_t ima4BlockFrames = 65;
+constexpr uint32_t ima4ChannelBytes = 36;
+
+static const int32_t imaStepSize[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+	253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+	1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+	3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+	11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+	32767
+};
+
+static const int32_t imaCodeword[16] = { 1, 3, 5, 7, 9, 11, 13, 15, -1, -3, -5, -7, -9, -11, -13, -15 };
+static const int32_t imaIndexAdjust[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// Encodes interleaved PCM16 into OpenAL's IMA4 layout. Every nibble is picked
+// against OpenAL's own decoder, so the error never compounds.
+static void encodeIMA4(const std::vector<short>& samples, uint32_t channels, std::vector<uint8_t>& data)
+{
+	size_t frames = samples.size() / channels;
+	size_t blocks = (frames + ima4BlockFrames - 1) / ima4BlockFrames;
+	data.assign(blocks * ima4ChannelBytes * channels, 0);
+
+	int32_t index[2] = { 0, 0 };
+	uint8_t* dst = data.data();
+
+	for (size_t block = 0; block < blocks; block++)
+	{
+		size_t first = block * ima4BlockFrames;
+		// The last block repeats the final frame to fill up.
+		auto sampleAt = [&](size_t frame, uint32_t c) {
+			return static_cast<int32_t>(samples[std::min(frame, frames - 1) * channels + c]);
+		};
+
+		int32_t predicted[2];
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			predicted[c] = sampleAt(first, c);
+			dst[0] = static_cast<uint8_t>(predicted[c] & 0xFF);
+			dst[1] = static_cast<uint8_t>((predicted[c] >> 8) & 0xFF);
+			dst[2] = static_cast<uint8_t>(index[c]);
+			dst[3] = 0;
+			dst += 4;
+		}
+
+		for (uint32_t group = 0; group < (ima4BlockFrames - 1) / 8; group++)
+		{
+			for (uint32_t c = 0; c < channels; c++)
+			{
+				uint32_t code = 0;
+				for (uint32_t k = 0; k < 8; k++)
+				{
+					int32_t target = sampleAt(first + 1 + group * 8 + k, c);
+					int32_t step = imaStepSize[index[c]];
+
+					int32_t bestNibble = 0;
+					int32_t bestSample = 0;
+					int32_t bestError = INT32_MAX;
+					for (int32_t nibble = 0; nibble < 16; nibble++)
+					{
+						int32_t sample = std::min(std::max(predicted[c] + imaCodeword[nibble] * step / 8, -32768), 32767);
+						int32_t error = std::abs(target - sample);
+						if (error < bestError)
+						{
+							bestError = error;
+							bestNibble = nibble;
+							bestSample = sample;
+						}
+					}
+
+					predicted[c] = bestSample;
+					index[c] = std::min(std::max(index[c] + imaIndexAdjust[bestNibble], 0), 88);
+					code |= static_cast<uint32_t>(bestNibble) << (k * 4);
+				}
+
+				dst[0] = static_cast<uint8_t>(code);
+				dst[1] = static_cast<uint8_t>(code >> 8);
+				dst[2] = static_cast<uint8_t>(code >> 16);
+				dst[3] = static_cast<uint8_t>(code >> 24);
+				dst += 4;
+			}
+		}
+	}
+}
+
+static bool decodeSound(const std::string& path, SampleFormat format, DecodedSound& sound)
+{
+	SF_INFO info = {};
+	SNDFILE* file = sf_open(path.c_str(), SFM_READ, &info);
+	if (!file)
+	{
+		std::cerr << "Audio Error: cannot open " << path << ": " << sf_strerror(nullptr) << std::endl;
+		return false;
+	}
+
+	ALenum pcmFormat = util::soundFormat(file, info);
+	if (!pcmFormat || info.frames < 1)
+	{
+		std::cerr << "Audio Error: cannot play " << path << std::endl;
+		sf_close(file);
+		return false;
+	}
+
+	size_t samples = static_cast<size_t>(info.frames) * info.channels;
+	bool simple = info.channels <= 2 && (pcmFormat == AL_FORMAT_MONO16 || pcmFormat == AL_FORMAT_STEREO16);
+	sound.sampleRate = info.samplerate;
+
+	if (format == SAMPLE_FLOAT32 && simple)
+	{
+		sound.data.resize(samples * sizeof(float));
+		sf_count_t frames = sf_readf_float(file, reinterpret_cast<float*>(sound.data.data()), info.frames);
+		sound.frames = static_cast<size_t>(std::max<sf_count_t>(frames, 0));
+		sound.data.resize(sound.frames * info.channels * sizeof(float));
+		sound.format = info.channels == 1 ? AL_FORMAT_MONO_FLOAT32 : AL_FORMAT_STEREO_FLOAT32;
+	}
+	else
+	{
+		std::vector<short> pcm(samples);
+		sf_count_t frames = sf_readf_short(file, pcm.data(), info.frames);
+		sound.frames = static_cast<size_t>(std::max<sf_count_t>(frames, 0));
+		pcm.resize(sound.frames * info.channels);
+
+		if (format == SAMPLE_IMA4 && simple && !pcm.empty())
+		{
+			encodeIMA4(pcm, static_cast<uint32_t>(info.channels), sound.data);
+			sound.format = info.channels == 1 ? AL_FORMAT_MONO_IMA4 : AL_FORMAT_STEREO_IMA4;
+		}
+		else
+		{
+			sound.data.resize(pcm.size() * sizeof(short));
+			memcpy(sound.data.data(), pcm.data(), sound.data.size());
+			sound.format = pcmFormat;
+		}
+	}
+
+	sf_close(file);
+
+	if (sound.data.empty())
+	{
+		std::cerr << "Audio Error: no samples in " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool SoundBank::load(Audio* audio, JobSystem* jobs, const std::vector<std::string>& paths, SampleFormat format)
+{
+	unload();
+	this->audio = audio;
+
+	if (format == SAMPLE_FLOAT32 && !util::extensions().float32)
+	{
+		std::cout << "AL_EXT_float32 not available, sound bank uses 16 bit samples" << std::endl;
+		format = SAMPLE_PCM16;
+	}
+	else if (format == SAMPLE_IMA4 && !util::extensions().ima4)
+	{
+		std::cout << "AL_EXT_IMA4 not available, sound bank uses 16 bit samples" << std::endl;
+		format = SAMPLE_PCM16;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<DecodedSound> decoded(paths.size());
+	std::vector<uint8_t> succeeded(paths.size(), 0);
+	jobs->parallelFor(static_cast<uint32_t>(paths.size()), 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+			succeeded[i] = decodeSound(paths[i], format, decoded[i]) ? 1 : 0;
+	});
+
+	// Uploads are queued for the audio thread, this one never calls OpenAL.
+	bool complete = true;
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		if (!succeeded[i])
+		{
+			complete = false;
+			continue;
+		}
+
+		// A sound that was already cached keeps its samples, ours are dropped.
+		SoundID sound = audio->getSounds().adopt(paths[i], std::move(decoded[i]));
+		audio->uploadSound(sound);
+		residentBytes += audio->getSounds().getBytes(sound);
+		sounds.push_back(sound);
+
+		// Frees a decoded copy the cache didn't take right away.
+		decoded[i] = DecodedSound();
+	}
+
+	decodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Sound bank: " << sounds.size() << " sounds in " << decodeMilliseconds << " ms, " << residentBytes / 1024 << " KiB resident" << std::endl;
+
+	return complete;
+}
+
+void SoundBank::unload()
+{
+	for (SoundID sound : sounds)
+		audio->releaseSound(sound);
+
+	sounds.clear();
+	residentBytes = 0;
+	decodeMilliseconds = 0.0;
+}
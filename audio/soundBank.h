@@ -0,0 +1,44 @@
+#pragma once
+#include "openal/al.h"
+#include "soundCache.h"
+#include "../core/jobSystem.h"
+#include <string>
+#include <vector>
+
+class Audio;
+
+enum SampleFormat
+{
+	SAMPLE_PCM16,
+	// Needs AL_EXT_float32, falls back to SAMPLE_PCM16.
+	SAMPLE_FLOAT32,
+	// IMA ADPCM at a quarter of the size of PCM16, mono and stereo only.
+	// Needs AL_EXT_IMA4, falls back to SAMPLE_PCM16.
+	SAMPLE_IMA4
+};
+
+// A set of sounds decoded together on the job system's workers. Loaded
+// sounds are put in the audio cache, so speakers playing them find them
+// there, and stay resident until the bank is unloaded. Load and unload from
+// the thread that updates Audio.
+class SoundBank
+{
+	Audio* audio = nullptr;
+	std::vector<SoundID> sounds;
+
+	double decodeMilliseconds = 0.0;
+	size_t residentBytes = 0;
+
+public:
+	// Decodes every file in parallel and has the audio thread upload them
+	// afterwards. Returns false if any file failed to decode, the others are
+	// loaded regardless.
+	bool load(Audio* audio, JobSystem* jobs, const std::vector<std::string>& paths, SampleFormat format = SAMPLE_PCM16);
+	void unload();
+
+	uint32_t getSoundCount() const { return static_cast<uint32_t>(sounds.size()); }
+	// Wall time of the last load's decode, uploads finish later.
+	double getDecodeMilliseconds() const { return decodeMilliseconds; }
+	// Bytes of samples the bank's sounds hold.
+	size_t getResidentBytes() const { return residentBytes; }
+};
@@ -0,0 +1,158 @@
+#include "soundCache.h"
+#include "util.h"
+#include <algorithm>
+
+void SoundCache::cleanup()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& entry : entries)
+	{
+		if (entry.second.buffer)
+			alDeleteBuffers(1, &entry.second.buffer);
+	}
+	entries.clear();
+	paths.clear();
+}
+
+SoundID SoundCache::findOrAdd(const std::string& path)
+{
+	auto it = paths.find(path);
+	if (it != paths.end())
+		return it->second;
+
+	SoundID id = nextID++;
+	paths[path] = id;
+	entries[id].path = path;
+	return id;
+}
+
+SoundID SoundCache::acquire(const std::string& path)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	SoundID id = findOrAdd(path);
+	Entry& entry = entries[id];
+	entry.refCount++;
+
+	if (entry.bytes == 0 && !entry.loading)
+	{
+		entry.loading = true;
+		lock.unlock();
+
+		// Entries are only erased once nobody holds a reference.
+		DecodedSound decoded;
+		if (!util::decodeSound(path.c_str(), decoded))
+			decoded = DecodedSound();
+
+		lock.lock();
+		entry.duration = decoded.frames > 0 ? static_cast<float>(decoded.frames) / static_cast<float>(decoded.sampleRate) : 0.f;
+		entry.bytes = decoded.data.size();
+		entry.decoded = std::move(decoded);
+		entry.loading = false;
+		loaded.notify_all();
+	}
+	else
+	{
+		loaded.wait(lock, [&entry] { return !entry.loading; });
+	}
+
+	// A failed decode holds no samples, the next request tries again.
+	if (entry.bytes == 0)
+	{
+		if (--entry.refCount == 0)
+		{
+			entries.erase(id);
+			paths.erase(path);
+		}
+		return noSound;
+	}
+
+	return id;
+}
+
+SoundID SoundCache::adopt(const std::string& path, DecodedSound&& sound)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	SoundID id = findOrAdd(path);
+	Entry& entry = entries[id];
+	entry.refCount++;
+	loaded.wait(lock, [&entry] { return !entry.loading; });
+
+	if (entry.bytes == 0)
+	{
+		entry.duration = static_cast<float>(sound.frames) / static_cast<float>(std::max(sound.sampleRate, 1));
+		entry.bytes = sound.data.size();
+		entry.decoded = std::move(sound);
+	}
+	return id;
+}
+
+ALuint SoundCache::upload(SoundID id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = entries.find(id);
+	if (it == entries.end())
+		return 0;
+
+	Entry& entry = it->second;
+	if (entry.buffer || entry.decoded.data.empty())
+		return entry.buffer;
+
+	alGetError();
+	alGenBuffers(1, &entry.buffer);
+	alBufferData(entry.buffer, entry.decoded.format, entry.decoded.data.data(), static_cast<ALsizei>(entry.decoded.data.size()), entry.decoded.sampleRate);
+
+	ALenum err = alGetError();
+	if (err != AL_NO_ERROR)
+	{
+		std::cerr << "OpenAL Error: " << alGetString(err) << " in " << entry.path << std::endl;
+		if (entry.buffer && alIsBuffer(entry.buffer))
+			alDeleteBuffers(1, &entry.buffer);
+		entry.buffer = 0;
+	}
+
+	entry.decoded = DecodedSound();
+	return entry.buffer;
+}
+
+void SoundCache::release(SoundID id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = entries.find(id);
+	if (it != entries.end())
+		releaseEntry(it);
+}
+
+void SoundCache::releaseEntry(std::unordered_map<SoundID, Entry>::iterator it)
+{
+	if (it->second.refCount == 0 || --it->second.refCount > 0)
+		return;
+
+	if (it->second.buffer)
+		alDeleteBuffers(1, &it->second.buffer);
+	paths.erase(it->second.path);
+	entries.erase(it);
+}
+
+float SoundCache::getDuration(SoundID id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(id);
+	return it != entries.end() ? it->second.duration : 0.f;
+}
+
+size_t SoundCache::getBytes(SoundID id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(id);
+	return it != entries.end() ? it->second.bytes : 0;
+}
+
+uint32_t SoundCache::getBufferCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return static_cast<uint32_t>(entries.size());
+}
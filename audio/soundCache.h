@@ -0,0 +1,80 @@
+#pragma once
+#include "openal/al.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef uint32_t SoundID;
+
+// Samples decoded in memory, waiting for the audio thread to upload them.
+struct DecodedSound
+{
+	ALenum format = AL_NONE;
+	int32_t sampleRate = 0;
+	// Frames decoded, IMA4 data pads the last block beyond them.
+	size_t frames = 0;
+	std::vector<uint8_t> data;
+};
+
+// One OpenAL buffer per sound file, shared by every speaker playing it and
+// deleted when the last reference is released. Files are decoded on the
+// thread asking for them, buffers are only created and deleted on the audio
+// thread. acquire() and adopt() are safe from any thread, the rest belongs
+// to the audio thread.
+class SoundCache
+{
+	struct Entry
+	{
+		std::string path;
+		// Emptied once uploaded.
+		DecodedSound decoded;
+		ALuint buffer = 0;
+		// Seconds, recorded at decode since compressed formats don't say.
+		float duration = 0.f;
+		size_t bytes = 0;
+		uint32_t refCount = 0;
+		bool loading = false;
+	};
+
+	std::mutex mutex;
+	std::condition_variable loaded;
+	// Entries stay put in the map while the lock is released.
+	std::unordered_map<SoundID, Entry> entries;
+	std::unordered_map<std::string, SoundID> paths;
+	SoundID nextID = 1;
+
+	// Expects the lock held.
+	SoundID findOrAdd(const std::string& path);
+	void releaseEntry(std::unordered_map<SoundID, Entry>::iterator it);
+
+public:
+	static constexpr SoundID noSound = 0;
+
+	// After the audio thread stopped.
+	void cleanup();
+
+	// Returns the sound for path and takes a reference, or noSound if the
+	// file can't be decoded. The first caller decodes the file, concurrent
+	// callers for the same path wait for that decode instead of starting
+	// their own.
+	SoundID acquire(const std::string& path);
+
+	// Hands a sound decoded elsewhere to the cache and takes a reference. If
+	// path is already cached the cached sound is kept and sound is dropped.
+	SoundID adopt(const std::string& path, DecodedSound&& sound);
+
+	// Audio thread. Creates the buffer on first use and frees the decoded
+	// copy, returns 0 if OpenAL refused the data.
+	ALuint upload(SoundID id);
+	// Audio thread. Deletes the buffer with the last reference.
+	void release(SoundID id);
+
+	// Length in seconds, 0 if the sound isn't cached.
+	float getDuration(SoundID id);
+	// Bytes of samples the sound holds in memory or in OpenAL.
+	size_t getBytes(SoundID id);
+	uint32_t getBufferCount();
+};
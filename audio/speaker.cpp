@@ -1,26 +1,79 @@
 #include "speaker.h"
-#include "util.h"
+#include "audio.h"
 
-void Speaker::loadSound(char* fileName)
+void Speaker::init(Audio* audio)
 {
-	ALuint buffer = util::loadSound(fileName);
+	this->audio = audio;
+	emitter = audio->addEmitter();
+}
+
+void Speaker::cleanup()
+{
+	if (emitter != VoiceManager::noEmitter)
+	{
+		audio->removeEmitter(emitter);
+		emitter = VoiceManager::noEmitter;
+	}
 
-	source = 0;
-	alGenSources(1, &source);
-	alSourcei(source, AL_BUFFER, (ALint)buffer);
+	// Released by the audio thread after the emitter let go of it.
+	if (sound != SoundCache::noSound)
+	{
+		audio->releaseSound(sound);
+		sound = SoundCache::noSound;
+	}
+}
+
+bool Speaker::loadSound(const char* fileName)
+{
+	SoundID loaded = audio->getSounds().acquire(fileName);
+	if (loaded == SoundCache::noSound)
+		return false;
+
+	audio->setEmitterSound(emitter, loaded);
+
+	if (sound != SoundCache::noSound)
+		audio->releaseSound(sound);
+	sound = loaded;
+
+	return true;
 }
 
 void Speaker::play()
 {
-	alSourcePlay(source);
+	audio->playEmitter(emitter);
 }
 
 void Speaker::pause()
 {
-	alSourcePause(source);
+	audio->pauseEmitter(emitter);
+}
+
+bool Speaker::isPlaying()
+{
+	return audio->isEmitterPlaying(emitter);
 }
 
 void Speaker::setPos(glm::vec3 pos)
 {
-	alSource3f(source, AL_POSITION, pos.x, pos.z, pos.y);
-}
\ No newline at end of file
+	audio->setEmitterPos(emitter, pos);
+}
+
+void Speaker::setVelocity(glm::vec3 velocity)
+{
+	audio->setEmitterVelocity(emitter, velocity);
+}
+
+void Speaker::setGain(float gain)
+{
+	audio->setEmitterGain(emitter, gain);
+}
+
+void Speaker::setLooping(bool looping)
+{
+	audio->setEmitterLooping(emitter, looping);
+}
+
+void Speaker::setPriority(int32_t priority)
+{
+	audio->setEmitterPriority(emitter, priority);
+}
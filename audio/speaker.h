@@ -1,17 +1,38 @@
 #pragma once
 #include <openal/al.h>
 #include "glm/glm.hpp"
+#include "voiceManager.h"
+#include "soundCache.h"
 
+class Audio;
 
+// An emitter in the world. Speakers don't own an OpenAL source, the voice
+// manager lends them one while they are among the most audible. Calls are
+// queued for the audio thread, use a speaker from the thread that updates
+// Audio.
 class Speaker
 {
-	ALuint source;
+	Audio* audio = nullptr;
+	EmitterID emitter = VoiceManager::noEmitter;
+	// Holds a sound cache reference.
+	SoundID sound = SoundCache::noSound;
 
 public:
-	void loadSound(char* fileName);
+	void init(Audio* audio);
+	// Stops playback, removes the emitter and releases the sound.
+	void cleanup();
+
+	// Sounds come from the audio cache, speakers playing the same file share
+	// one buffer. A file not cached yet is decoded on the calling thread.
+	bool loadSound(const char* fileName);
 	
 	void play();
 	void pause();
+	bool isPlaying();
 
 	void setPos(glm::vec3 pos);
-};
\ No newline at end of file
+	void setVelocity(glm::vec3 velocity);
+	void setGain(float gain);
+	void setLooping(bool looping);
+	void setPriority(int32_t priority);
+};
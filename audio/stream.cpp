@@ -0,0 +1,249 @@
+#include "stream.h"
+#include "util.h"
+#include <iostream>
+
+bool AudioStream::open(const char* fileName, bool loop)
+{
+	close();
+
+	path = fileName;
+	this->loop = loop;
+
+	decoder = std::thread(&AudioStream::decodeLoop, this);
+	return true;
+}
+
+void AudioStream::close()
+{
+	if (decoder.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(decodeMutex);
+			quit = true;
+		}
+		decodeSignal.notify_all();
+		decoder.join();
+	}
+
+	if (file)
+		sf_close(file);
+
+	file = nullptr;
+	format = AL_NONE;
+	playing = false;
+	started = false;
+	moved = false;
+
+	for (uint32_t i = 0; i < chunkCount; i++)
+		chunks[i] = std::vector<short>();
+	decodedChunks = 0;
+	consumedChunks = 0;
+	ready = false;
+	failed = false;
+	endOfFile = false;
+	quit = false;
+}
+
+bool AudioStream::createSource()
+{
+	alGetError();
+	alGenSources(1, &source);
+	alGenBuffers(bufferCount, buffers);
+	if (alGetError() != AL_NO_ERROR)
+	{
+		std::cerr << "Audio Error: cannot create stream for " << path << std::endl;
+		destroySource();
+		return false;
+	}
+
+	for (uint32_t i = 0; i < bufferCount; i++)
+		freeBuffers[i] = buffers[i];
+	freeCount = bufferCount;
+	moved = true;
+	return true;
+}
+
+void AudioStream::destroySource()
+{
+	if (source)
+	{
+		alSourceStop(source);
+		alSourcei(source, AL_BUFFER, 0);
+		alDeleteSources(1, &source);
+	}
+	if (buffers[0])
+		alDeleteBuffers(bufferCount, buffers);
+
+	source = 0;
+	for (uint32_t i = 0; i < bufferCount; i++)
+		buffers[i] = 0;
+	freeCount = 0;
+	started = false;
+}
+
+void AudioStream::decodeLoop()
+{
+	file = sf_open(path.c_str(), SFM_READ, &info);
+	if (!file)
+	{
+		std::cerr << "Audio Error: cannot open " << path << ": " << sf_strerror(nullptr) << std::endl;
+		failed = true;
+		return;
+	}
+
+	format = util::soundFormat(file, info);
+	if (!format)
+	{
+		std::cerr << "Audio Error: unsupported channel count " << info.channels << " in " << path << std::endl;
+		failed = true;
+		return;
+	}
+
+	for (uint32_t i = 0; i < chunkCount; i++)
+		chunks[i].resize(static_cast<size_t>(chunkFrames) * info.channels);
+	ready = true;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(decodeMutex);
+			decodeSignal.wait(lock, [this] {
+				return quit || decodedChunks - consumedChunks < chunkCount;
+			});
+		}
+
+		if (quit)
+			return;
+
+		uint32_t slot = decodedChunks % chunkCount;
+		if (!decodeChunk(chunks[slot], chunkSizes[slot]))
+		{
+			endOfFile = true;
+			return;
+		}
+
+		decodedChunks++;
+	}
+}
+
+bool AudioStream::decodeChunk(std::vector<short>& chunk, uint32_t& size)
+{
+	sf_count_t frames = 0;
+	bool rewound = false;
+
+	while (frames < chunkFrames)
+	{
+		sf_count_t read = sf_readf_short(file, chunk.data() + frames * info.channels, chunkFrames - frames);
+		frames += read;
+
+		if (read > 0)
+		{
+			rewound = false;
+			continue;
+		}
+
+		// A file that gives nothing right after a rewind is empty.
+		if (!loop || rewound || sf_seek(file, 0, SEEK_SET) < 0)
+			break;
+		rewound = true;
+	}
+
+	size = static_cast<uint32_t>(frames * info.channels * sizeof(short));
+	return frames > 0;
+}
+
+void AudioStream::update()
+{
+	if (!source)
+		return;
+
+	if (moved)
+	{
+		alSource3f(source, AL_POSITION, pos.x, pos.y, pos.z);
+		moved = false;
+	}
+
+	if (!ready)
+		return;
+
+	ALint processed = 0;
+	alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+	while (processed > 0)
+	{
+		alSourceUnqueueBuffers(source, 1, &freeBuffers[freeCount]);
+		freeCount++;
+		processed--;
+	}
+
+	while (freeCount > 0)
+	{
+		if (decodedChunks == consumedChunks)
+		{
+			if (playing && !endOfFile)
+				lateChunks++;
+			break;
+		}
+
+		uint32_t slot = consumedChunks % chunkCount;
+		ALuint buffer = freeBuffers[--freeCount];
+		alBufferData(buffer, format, chunks[slot].data(), static_cast<ALsizei>(chunkSizes[slot]), info.samplerate);
+		alSourceQueueBuffers(source, 1, &buffer);
+
+		{
+			std::lock_guard<std::mutex> lock(decodeMutex);
+			consumedChunks++;
+		}
+		decodeSignal.notify_one();
+	}
+
+	if (!playing)
+		return;
+
+	ALint state = AL_STOPPED;
+	alGetSourcei(source, AL_SOURCE_STATE, &state);
+	if (state == AL_PLAYING)
+		return;
+
+	if (freeCount < bufferCount)
+	{
+		// The source stops on its own when the queue runs dry.
+		if (started && state == AL_STOPPED)
+			underruns++;
+
+		alSourcePlay(source);
+		started = true;
+	}
+	else if (endOfFile && decodedChunks == consumedChunks)
+	{
+		playing = false;
+		started = false;
+	}
+}
+
+void AudioStream::play()
+{
+	if (failed)
+		return;
+
+	// Playback starts in update() once the first chunks are queued.
+	playing = true;
+}
+
+void AudioStream::pause()
+{
+	if (!playing)
+		return;
+
+	playing = false;
+	if (source)
+		alSourcePause(source);
+}
+
+void AudioStream::setPos(glm::vec3 pos)
+{
+	if (pos == this->pos)
+		return;
+
+	this->pos = pos;
+	moved = true;
+}
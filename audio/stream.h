@@ -0,0 +1,92 @@
+#pragma once
+#include "openal/al.h"
+#include "libsndfile/sndfile.h"
+#include "glm/glm.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Plays a long sound without decoding it up front. A background thread opens
+// the file and decodes it chunk by chunk into a small ring, update() hands
+// decoded chunks to the OpenAL buffers the source has finished with. Memory
+// stays the same no matter how long the file is. Once added to Audio the
+// stream belongs to the audio thread, control it through Audio until it is
+// removed again.
+class AudioStream
+{
+	static constexpr uint32_t bufferCount = 4;
+	static constexpr uint32_t chunkCount = 3;
+	// Frames per chunk, about 0.19 s at 44.1 kHz.
+	static constexpr uint32_t chunkFrames = 8192;
+
+	ALuint source = 0;
+	ALuint buffers[bufferCount] = {};
+	// Buffers not queued on the source.
+	ALuint freeBuffers[bufferCount] = {};
+	uint32_t freeCount = 0;
+
+	std::string path;
+	bool loop = false;
+	bool playing = false;
+	// Committed by update().
+	glm::vec3 pos = glm::vec3(0.f);
+	bool moved = false;
+	bool started = false;
+
+	// Written by the decode thread before ready is set.
+	SNDFILE* file = nullptr;
+	SF_INFO info = {};
+	ALenum format = AL_NONE;
+
+	// Single producer ring, the decode thread fills chunks and update()
+	// consumes them. Both counters only grow.
+	std::vector<short> chunks[chunkCount];
+	uint32_t chunkSizes[chunkCount] = {};
+	std::atomic<uint32_t> decodedChunks{ 0 };
+	std::atomic<uint32_t> consumedChunks{ 0 };
+
+	std::atomic<bool> ready{ false };
+	std::atomic<bool> failed{ false };
+	std::atomic<bool> endOfFile{ false };
+	std::atomic<bool> quit{ false };
+
+	std::thread decoder;
+	std::mutex decodeMutex;
+	std::condition_variable decodeSignal;
+
+	// Read from other threads while the audio thread plays the stream.
+	std::atomic<uint32_t> underruns{ 0 };
+	std::atomic<uint32_t> lateChunks{ 0 };
+
+	void decodeLoop();
+	bool decodeChunk(std::vector<short>& chunk, uint32_t& size);
+
+public:
+	// Starts decoding in the background and returns right away. Doesn't touch
+	// OpenAL, the source is created once the stream is added to Audio.
+	bool open(const char* fileName, bool loop = false);
+	// The stream must not be added to Audio anymore.
+	void close();
+
+	// Called by the audio thread when the stream is added and removed.
+	bool createSource();
+	void destroySource();
+
+	// Refills finished buffers and restarts the source after an underrun.
+	// Called by the audio thread once the stream was added.
+	void update();
+
+	void play();
+	void pause();
+	bool isPlaying() const { return playing; }
+
+	void setPos(glm::vec3 pos);
+
+	// Times the source ran dry while playing and had to be restarted.
+	uint32_t getUnderruns() const { return underruns; }
+	// Buffers that were free but had no decoded chunk waiting.
+	uint32_t getLateChunks() const { return lateChunks; }
+};
@@ -1,91 +1,107 @@
 #pragma once
 #include "libsndfile/sndfile.h"
 #include "openal/alext.h"
+#include "soundCache.h"
 #include <climits>
 #include <iostream>
 
 namespace util
 {
-    static ALuint loadSound(const char* filename)
+    /* OpenAL extensions the decoders pick formats for. Filled in by Audio::init
+     * before the audio thread starts, so threads decoding sounds never ask
+     * OpenAL themselves.
+     */
+    struct Extensions
+    {
+        bool multichannel = false;
+        bool float32 = false;
+        bool ima4 = false;
+    };
+
+    inline Extensions& extensions()
+    {
+        static Extensions value;
+        return value;
+    }
+
+    /* Picks the 16 bit OpenAL format for the channel layout of a file, or
+     * AL_NONE when it can't be played. Quad and 5.1 to 7.1 need
+     * AL_EXT_MCFORMATS.
+     */
+    static ALenum soundFormat(SNDFILE* sndfile, const SF_INFO& sfinfo)
+    {
+        if (sfinfo.channels == 1)
+            return AL_FORMAT_MONO16;
+        if (sfinfo.channels == 2)
+            return AL_FORMAT_STEREO16;
+        if (sfinfo.channels == 3)
+        {
+            if (sf_command(sndfile, SFC_WAVEX_GET_AMBISONIC, NULL, 0) == SF_AMBISONIC_B_FORMAT)
+                return AL_FORMAT_BFORMAT2D_16;
+            return AL_NONE;
+        }
+        if (sfinfo.channels == 4 && sf_command(sndfile, SFC_WAVEX_GET_AMBISONIC, NULL, 0) == SF_AMBISONIC_B_FORMAT)
+            return AL_FORMAT_BFORMAT3D_16;
+
+        if (!extensions().multichannel)
+            return AL_NONE;
+
+        switch (sfinfo.channels)
+        {
+        case 4: return AL_FORMAT_QUAD16;
+        case 6: return AL_FORMAT_51CHN16;
+        case 7: return AL_FORMAT_61CHN16;
+        case 8: return AL_FORMAT_71CHN16;
+        }
+        return AL_NONE;
+    }
+
+    /* Decodes a whole file to 16 bit samples in memory. No OpenAL calls, the
+     * buffer is created later by the audio thread.
+     */
+    static bool decodeSound(const char* filename, DecodedSound& sound)
     {
-        ALenum err, format;
-        ALuint buffer;
         SNDFILE* sndfile;
         SF_INFO sfinfo;
-        short* membuf;
         sf_count_t num_frames;
-        ALsizei num_bytes;
 
         /* Open the audio file and check that it's usable. */
         sndfile = sf_open(filename, SFM_READ, &sfinfo);
         if (!sndfile)
         {
             fprintf(stderr, "Could not open audio in %s: %s\n", filename, sf_strerror(sndfile));
-            return 0;
+            return false;
         }
         if (sfinfo.frames < 1 || sfinfo.frames >(sf_count_t)(INT_MAX / sizeof(short)) / sfinfo.channels)
         {
             std::cout << "bad sample count" << std::endl;
             sf_close(sndfile);
-            return 0;
+            return false;
         }
 
-        /* Get the sound format, and figure out the OpenAL format */
-        format = AL_NONE;
-        if (sfinfo.channels == 1)
-            format = AL_FORMAT_MONO16;
-        else if (sfinfo.channels == 2)
-            format = AL_FORMAT_STEREO16;
-        else if (sfinfo.channels == 3)
-        {
-            if (sf_command(sndfile, SFC_WAVEX_GET_AMBISONIC, NULL, 0) == SF_AMBISONIC_B_FORMAT)
-                format = AL_FORMAT_BFORMAT2D_16;
-        }
-        else if (sfinfo.channels == 4)
-        {
-            if (sf_command(sndfile, SFC_WAVEX_GET_AMBISONIC, NULL, 0) == SF_AMBISONIC_B_FORMAT)
-                format = AL_FORMAT_BFORMAT3D_16;
-        }
-        if (!format)
+        sound.format = soundFormat(sndfile, sfinfo);
+        if (!sound.format)
         {
             fprintf(stderr, "Unsupported channel count: %d\n", sfinfo.channels);
             sf_close(sndfile);
-            return 0;
+            return false;
         }
 
         /* Decode the whole audio file to a buffer. */
-        membuf = static_cast<short*>(malloc((size_t)(sfinfo.frames * sfinfo.channels) * sizeof(short)));
+        sound.data.resize((size_t)(sfinfo.frames * sfinfo.channels) * sizeof(short));
 
-        num_frames = sf_readf_short(sndfile, membuf, sfinfo.frames);
+        num_frames = sf_readf_short(sndfile, reinterpret_cast<short*>(sound.data.data()), sfinfo.frames);
+        sf_close(sndfile);
         if (num_frames < 1)
         {
-            free(membuf);
-            sf_close(sndfile);
+            sound.data.clear();
             std::cout << "failed to read samples" << std::endl;
-            return 0;
-        }
-        num_bytes = (ALsizei)(num_frames * sfinfo.channels) * (ALsizei)sizeof(short);
-
-        /* Buffer the audio data into a new buffer object, then free the data and
-         * close the file.
-         */
-        buffer = 0;
-        alGenBuffers(1, &buffer);
-        alBufferData(buffer, format, membuf, num_bytes, sfinfo.samplerate);
-
-        free(membuf);
-        sf_close(sndfile);
-
-        /* Check if an error occured, and clean up if so. */
-        err = alGetError();
-        if (err != AL_NO_ERROR)
-        {
-            fprintf(stderr, "OpenAL Error: %s\n", alGetString(err));
-            if (buffer && alIsBuffer(buffer))
-                alDeleteBuffers(1, &buffer);
-            return 0;
+            return false;
         }
 
-        return buffer;
+        sound.sampleRate = sfinfo.samplerate;
+        sound.frames = (size_t)num_frames;
+        sound.data.resize((size_t)(num_frames * sfinfo.channels) * sizeof(short));
+        return true;
     }
 }
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include "voiceManager.h"
+#include "openal/alc.h"
+#include <algorithm>
+#include <cmath>
+
+// Gain of the inverse distance clamped model OpenAL uses by default.
+static float distanceGain(float distance, float referenceDistance, float maxDistance)
+{
+	distance = std::min(std::max(distance, referenceDistance), maxDistance);
+	return referenceDistance / std::max(distance, 0.0001f);
+}
+
+void VoiceManager::init(uint32_t maxVoices)
+{
+	alGetError();
+	for (uint32_t i = 0; i < maxVoices; i++)
+	{
+		ALuint source = 0;
+		alGenSources(1, &source);
+		if (alGetError() != AL_NO_ERROR)
+			break;
+
+		freeVoices.push_back(static_cast<uint32_t>(voices.size()));
+		voices.push_back(source);
+		voiceEmitters.push_back(noEmitter);
+	}
+
+	ALCdevice* device = alcGetContextsDevice(alcGetCurrentContext());
+	if (voices.empty() || !device || !alcIsExtensionPresent(device, "ALC_EXT_EFX"))
+		return;
+
+	genFilters = reinterpret_cast<LPALGENFILTERS>(alGetProcAddress("alGenFilters"));
+	deleteFilters = reinterpret_cast<LPALDELETEFILTERS>(alGetProcAddress("alDeleteFilters"));
+	filteri = reinterpret_cast<LPALFILTERI>(alGetProcAddress("alFilteri"));
+	filterf = reinterpret_cast<LPALFILTERF>(alGetProcAddress("alFilterf"));
+	if (!genFilters || !deleteFilters || !filteri || !filterf)
+		return;
+
+	filters.resize(voices.size());
+	genFilters(static_cast<ALsizei>(filters.size()), filters.data());
+	if (alGetError() != AL_NO_ERROR)
+	{
+		filters.clear();
+		return;
+	}
+
+	for (ALuint filter : filters)
+		filteri(filter, AL_FILTER_TYPE, AL_FILTER_LOWPASS);
+}
+
+void VoiceManager::cleanup()
+{
+	for (ALuint source : voices)
+	{
+		alSourceStop(source);
+		alSourcei(source, AL_BUFFER, 0);
+	}
+	if (!voices.empty())
+		alDeleteSources(static_cast<ALsizei>(voices.size()), voices.data());
+	if (!filters.empty())
+		deleteFilters(static_cast<ALsizei>(filters.size()), filters.data());
+
+	voices.clear();
+	filters.clear();
+	voiceEmitters.clear();
+	freeVoices.clear();
+	emitters.clear();
+	active.clear();
+	finished.clear();
+}
+
+void VoiceManager::addEmitter(EmitterID id)
+{
+	if (id >= emitters.size())
+		emitters.resize(id + 1);
+
+	// A removed emitter can still be listed until the next update.
+	bool listed = emitters[id].listed;
+	emitters[id] = Emitter();
+	emitters[id].alive = true;
+	emitters[id].listed = listed;
+}
+
+void VoiceManager::removeEmitter(EmitterID id)
+{
+	if (id >= emitters.size() || !emitters[id].alive)
+		return;
+
+	stopEmitter(id);
+	emitters[id].alive = false;
+	emitters[id].buffer = 0;
+}
+
+void VoiceManager::setBuffer(EmitterID id, ALuint buffer, float duration)
+{
+	stopEmitter(id);
+
+	Emitter& emitter = emitters[id];
+	emitter.buffer = buffer;
+	emitter.duration = buffer ? duration : 0.f;
+}
+
+void VoiceManager::play(EmitterID id)
+{
+	Emitter& emitter = emitters[id];
+	if (!emitter.buffer || emitter.playing)
+		return;
+
+	if (emitter.offset >= emitter.duration)
+		emitter.offset = 0.0;
+
+	emitter.playing = true;
+	if (!emitter.listed)
+	{
+		active.push_back(id);
+		emitter.listed = true;
+	}
+
+	// Starts right away if a voice is spare, update() ranks it otherwise.
+	if (!freeVoices.empty())
+		promote(id);
+}
+
+void VoiceManager::pause(EmitterID id)
+{
+	Emitter& emitter = emitters[id];
+	if (!emitter.playing)
+		return;
+
+	if (emitter.voice >= 0)
+		demote(id);
+	emitter.playing = false;
+}
+
+void VoiceManager::stopEmitter(EmitterID id)
+{
+	Emitter& emitter = emitters[id];
+	if (emitter.voice >= 0)
+		demote(id);
+
+	emitter.playing = false;
+	emitter.offset = 0.0;
+}
+
+void VoiceManager::setPos(EmitterID id, glm::vec3 pos)
+{
+	Emitter& emitter = emitters[id];
+	if (pos == emitter.pos)
+		return;
+
+	emitter.pos = pos;
+	emitter.dirty |= AUDIO_DIRTY_POS;
+}
+
+void VoiceManager::setVelocity(EmitterID id, glm::vec3 velocity)
+{
+	Emitter& emitter = emitters[id];
+	if (velocity == emitter.velocity)
+		return;
+
+	emitter.velocity = velocity;
+	emitter.dirty |= AUDIO_DIRTY_VELOCITY;
+}
+
+void VoiceManager::setGain(EmitterID id, float gain)
+{
+	Emitter& emitter = emitters[id];
+	if (gain == emitter.gain)
+		return;
+
+	emitter.gain = gain;
+	emitter.dirty |= AUDIO_DIRTY_GAIN;
+}
+
+void VoiceManager::setLooping(EmitterID id, bool looping)
+{
+	Emitter& emitter = emitters[id];
+	emitter.looping = looping;
+
+	if (emitter.voice >= 0)
+		alSourcei(voices[emitter.voice], AL_LOOPING, looping ? AL_TRUE : AL_FALSE);
+}
+
+void VoiceManager::setPriority(EmitterID id, int32_t priority)
+{
+	emitters[id].priority = priority;
+}
+
+void VoiceManager::setDistances(EmitterID id, float referenceDistance, float maxDistance)
+{
+	Emitter& emitter = emitters[id];
+	emitter.referenceDistance = referenceDistance;
+	emitter.maxDistance = maxDistance;
+
+	if (emitter.voice >= 0)
+	{
+		alSourcef(voices[emitter.voice], AL_REFERENCE_DISTANCE, referenceDistance);
+		alSourcef(voices[emitter.voice], AL_MAX_DISTANCE, maxDistance);
+	}
+}
+
+void VoiceManager::setOcclusion(EmitterID id, float occlusion)
+{
+	emitters[id].occlusionTarget = std::min(std::max(occlusion, 0.f), 1.f);
+}
+
+float VoiceManager::occlusionGain(const Emitter& emitter) const
+{
+	return 1.f - emitter.occlusion * (1.f - occludedGain);
+}
+
+void VoiceManager::applyGain(const Emitter& emitter, ALuint source)
+{
+	if (filters.empty())
+	{
+		alSourcef(source, AL_GAIN, emitter.gain * occlusionGain(emitter));
+		return;
+	}
+
+	// Filter properties are copied when attached, so it is attached again
+	// after every change.
+	ALuint filter = filters[emitter.voice];
+	filterf(filter, AL_LOWPASS_GAIN, occlusionGain(emitter));
+	filterf(filter, AL_LOWPASS_GAINHF, 1.f - emitter.occlusion * (1.f - occludedGainHF));
+	alSourcef(source, AL_GAIN, emitter.gain);
+	alSourcei(source, AL_DIRECT_FILTER, static_cast<ALint>(filter));
+}
+
+void VoiceManager::promote(EmitterID id)
+{
+	Emitter& emitter = emitters[id];
+
+	uint32_t voice = freeVoices.back();
+	freeVoices.pop_back();
+	voiceEmitters[voice] = id;
+	emitter.voice = static_cast<int32_t>(voice);
+	emitter.dirty = 0;
+
+	ALuint source = voices[voice];
+	alSourcei(source, AL_BUFFER, static_cast<ALint>(emitter.buffer));
+	alSourcei(source, AL_LOOPING, emitter.looping ? AL_TRUE : AL_FALSE);
+	applyGain(emitter, source);
+	alSourcef(source, AL_REFERENCE_DISTANCE, emitter.referenceDistance);
+	alSourcef(source, AL_MAX_DISTANCE, emitter.maxDistance);
+	alSource3f(source, AL_POSITION, emitter.pos.x, emitter.pos.y, emitter.pos.z);
+	alSource3f(source, AL_VELOCITY, emitter.velocity.x, emitter.velocity.y, emitter.velocity.z);
+	alSourcef(source, AL_SEC_OFFSET, static_cast<float>(emitter.offset));
+	alSourcePlay(source);
+}
+
+void VoiceManager::demote(EmitterID id)
+{
+	Emitter& emitter = emitters[id];
+	uint32_t voice = static_cast<uint32_t>(emitter.voice);
+	ALuint source = voices[voice];
+
+	ALfloat offset = 0.f;
+	alGetSourcef(source, AL_SEC_OFFSET, &offset);
+	emitter.offset = offset;
+
+	alSourceStop(source);
+	alSourcei(source, AL_BUFFER, 0);
+
+	voiceEmitters[voice] = noEmitter;
+	freeVoices.push_back(voice);
+	emitter.voice = -1;
+}
+
+void VoiceManager::update(glm::vec3 listenerPos, float dt)
+{
+	finished.clear();
+
+	// Voices that reached the end of a sound free up.
+	for (uint32_t voice = 0; voice < voices.size(); voice++)
+	{
+		EmitterID id = voiceEmitters[voice];
+		if (id == noEmitter)
+			continue;
+
+		ALint state = AL_STOPPED;
+		alGetSourcei(voices[voice], AL_SOURCE_STATE, &state);
+		if (state == AL_STOPPED)
+		{
+			demote(id);
+			emitters[id].playing = false;
+			emitters[id].offset = 0.0;
+			finished.push_back(id);
+		}
+	}
+
+	// Virtual emitters advance, everything audible competes for a voice.
+	candidates.clear();
+	size_t kept = 0;
+	for (size_t i = 0; i < active.size(); i++)
+	{
+		EmitterID id = active[i];
+		Emitter& emitter = emitters[id];
+
+		// Paused, stopped or removed since the last update.
+		if (!emitter.playing)
+		{
+			emitter.listed = false;
+			continue;
+		}
+
+		if (emitter.voice < 0)
+		{
+			emitter.offset += dt;
+			if (emitter.offset >= emitter.duration)
+			{
+				if (emitter.looping && emitter.duration > 0.f)
+				{
+					emitter.offset = std::fmod(emitter.offset, static_cast<double>(emitter.duration));
+				}
+				else
+				{
+					emitter.playing = false;
+					emitter.listed = false;
+					emitter.offset = 0.0;
+					finished.push_back(id);
+					continue;
+				}
+			}
+		}
+
+		active[kept++] = id;
+
+		if (emitter.occlusion != emitter.occlusionTarget)
+		{
+			float step = occlusionSpeed * dt;
+			float delta = emitter.occlusionTarget - emitter.occlusion;
+			emitter.occlusion = std::abs(delta) <= step ? emitter.occlusionTarget : emitter.occlusion + (delta > 0.f ? step : -step);
+			emitter.dirty |= AUDIO_DIRTY_OCCLUSION;
+		}
+
+		float audibility = emitter.gain * occlusionGain(emitter) * distanceGain(glm::length(emitter.pos - listenerPos), emitter.referenceDistance, emitter.maxDistance);
+		// Emitters that have a voice keep it unless something clearly beats
+		// them, so voices don't flip between equal emitters every frame.
+		if (emitter.voice >= 0)
+			audibility *= 1.25f;
+
+		if (audibility >= audibleGain)
+			candidates.push_back({ id, emitter.priority, audibility });
+	}
+	active.resize(kept);
+
+	size_t realCount = std::min(candidates.size(), voices.size());
+	auto louder = [](const Candidate& a, const Candidate& b) {
+		return a.priority != b.priority ? a.priority > b.priority : a.audibility > b.audibility;
+	};
+	if (realCount < candidates.size())
+		std::nth_element(candidates.begin(), candidates.begin() + realCount, candidates.end(), louder);
+
+	for (size_t i = 0; i < realCount; i++)
+		emitters[candidates[i].emitter].selected = true;
+
+	// Losers give up their voices before the winners take them.
+	for (uint32_t voice = 0; voice < voices.size(); voice++)
+	{
+		EmitterID id = voiceEmitters[voice];
+		if (id != noEmitter && !emitters[id].selected)
+			demote(id);
+	}
+
+	for (size_t i = 0; i < realCount; i++)
+	{
+		EmitterID id = candidates[i].emitter;
+		Emitter& emitter = emitters[id];
+		emitter.selected = false;
+
+		if (emitter.voice < 0)
+		{
+			promote(id);
+			continue;
+		}
+
+		ALuint source = voices[emitter.voice];
+		if (emitter.dirty & AUDIO_DIRTY_POS)
+			alSource3f(source, AL_POSITION, emitter.pos.x, emitter.pos.y, emitter.pos.z);
+		if (emitter.dirty & AUDIO_DIRTY_VELOCITY)
+			alSource3f(source, AL_VELOCITY, emitter.velocity.x, emitter.velocity.y, emitter.velocity.z);
+		if (emitter.dirty & (AUDIO_DIRTY_GAIN | AUDIO_DIRTY_OCCLUSION))
+			applyGain(emitter, source);
+		emitter.dirty = 0;
+	}
+}
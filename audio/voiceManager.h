@@ -0,0 +1,134 @@
+#pragma once
+#include "openal/al.h"
+#include "openal/efx.h"
+#include "glm/glm.hpp"
+#include <vector>
+
+typedef uint32_t EmitterID;
+
+// Which parameters changed since they were last handed to OpenAL.
+enum AudioDirtyFlags
+{
+	AUDIO_DIRTY_POS = 1,
+	AUDIO_DIRTY_VELOCITY = 2,
+	AUDIO_DIRTY_GAIN = 4,
+	AUDIO_DIRTY_ORIENTATION = 8,
+	AUDIO_DIRTY_OCCLUSION = 16
+};
+
+// Backs any number of emitters with a fixed pool of OpenAL sources. Every
+// update the most important audible emitters get a voice, the rest play on
+// virtually: their position in the sound keeps advancing without a source,
+// so they resume in the right place once promoted again. OpenAL work per
+// update is bounded by the pool size.
+class VoiceManager
+{
+	struct Emitter
+	{
+		ALuint buffer = 0;
+		float duration = 0.f;
+		// Seconds into the sound, only kept up to date while virtual.
+		double offset = 0.0;
+
+		glm::vec3 pos = glm::vec3(0.f);
+		glm::vec3 velocity = glm::vec3(0.f);
+		float gain = 1.f;
+		float referenceDistance = 1.f;
+		float maxDistance = 100.f;
+		int32_t priority = 0;
+		// 0 is a clear path to the listener, 1 fully blocked. The current
+		// value eases toward the target so occlusion changes don't click.
+		float occlusion = 0.f;
+		float occlusionTarget = 0.f;
+
+		int32_t voice = -1;
+		// AudioDirtyFlags, only tracked while the emitter has a voice.
+		uint32_t dirty = 0;
+		bool looping = false;
+		bool playing = false;
+		bool alive = false;
+		// In the active list.
+		bool listed = false;
+		// Won a voice in the current update.
+		bool selected = false;
+	};
+
+	struct Candidate
+	{
+		EmitterID emitter;
+		int32_t priority;
+		float audibility;
+	};
+
+	std::vector<ALuint> voices;
+	// One low-pass filter per voice, empty without ALC_EXT_EFX.
+	std::vector<ALuint> filters;
+	std::vector<EmitterID> voiceEmitters;
+	std::vector<uint32_t> freeVoices;
+
+	std::vector<Emitter> emitters;
+	// Emitters that are playing, real or virtual.
+	std::vector<EmitterID> active;
+	// Emitters that reached the end of their sound in the last update.
+	std::vector<EmitterID> finished;
+	std::vector<Candidate> candidates;
+
+	LPALGENFILTERS genFilters = nullptr;
+	LPALDELETEFILTERS deleteFilters = nullptr;
+	LPALFILTERI filteri = nullptr;
+	LPALFILTERF filterf = nullptr;
+
+	float occlusionGain(const Emitter& emitter) const;
+	void applyGain(const Emitter& emitter, ALuint source);
+	void promote(EmitterID id);
+	void demote(EmitterID id);
+	void stopEmitter(EmitterID id);
+
+public:
+	static constexpr EmitterID noEmitter = 0xFFFFFFFF;
+
+	// Emitters quieter than this don't get a voice.
+	float audibleGain = 0.001f;
+	// Gain and high frequency gain of a fully occluded emitter. Without EFX
+	// only the gain is applied.
+	float occludedGain = 0.4f;
+	float occludedGainHF = 0.1f;
+	// How far occlusion moves toward its target per second.
+	float occlusionSpeed = 4.f;
+
+	// Creates up to maxVoices sources, fewer if the device runs out.
+	void init(uint32_t maxVoices = 64);
+	void cleanup();
+
+	// Ids are handed out by the caller, so they can be picked on another
+	// thread. A removed id may be added again.
+	void addEmitter(EmitterID id);
+	void removeEmitter(EmitterID id);
+
+	// Switching buffers stops the emitter. duration is the buffer's length in
+	// seconds as recorded when it was uploaded.
+	void setBuffer(EmitterID id, ALuint buffer, float duration);
+	void play(EmitterID id);
+	void pause(EmitterID id);
+	bool isPlaying(EmitterID id) const { return emitters[id].playing; }
+
+	// Changes are committed by update(), unchanged values are skipped.
+	void setPos(EmitterID id, glm::vec3 pos);
+	void setVelocity(EmitterID id, glm::vec3 velocity);
+	void setGain(EmitterID id, float gain);
+	void setLooping(EmitterID id, bool looping);
+	// Higher priorities take voices first, audibility decides among equals.
+	void setPriority(EmitterID id, int32_t priority);
+	void setDistances(EmitterID id, float referenceDistance, float maxDistance);
+	// Fraction of the direct path that is blocked, from 0 to 1.
+	void setOcclusion(EmitterID id, float occlusion);
+
+	// Must be called every frame with the time since the last call.
+	void update(glm::vec3 listenerPos, float dt);
+
+	uint32_t getVoiceCount() const { return static_cast<uint32_t>(voices.size()); }
+	uint32_t getRealCount() const { return static_cast<uint32_t>(voices.size() - freeVoices.size()); }
+	uint32_t getActiveCount() const { return static_cast<uint32_t>(active.size()); }
+	bool hasFilters() const { return !filters.empty(); }
+	const std::vector<EmitterID>& getFinished() const { return finished; }
+};
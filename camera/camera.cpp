@@ -5,36 +5,49 @@
 void Camera::init(Input* inputptr)
 {
 	camPos = glm::vec3(0.f, 0.f, 0.f);
+	prevPos = camPos;
 	camFront = glm::vec3(0.f, 0.f, -1.f);
 	camUp = glm::vec3(0.f, 1.f, 0.f);
+	yaw = -90.f;
+	pitch = 0.f;
 	sensitiviy = 0.1f;
-	camSpeed = 0.25f;
+	camSpeed = 15.f;
 
 	input = inputptr;
 
-	input->registerMouseMotion([=](glm::vec2 delta) {
-		updateDir(delta);
-	});
+	if (input)
+	{
+		input->registerMouseMotion([=](glm::vec2 delta) {
+			updateDir(delta);
+		});
+	}
+}
+
+void Camera::update(float dt)
+{
+	prevPos = camPos;
 
-	input->registerKeyPress(SDLK_w, [=] {
-		camPos += camSpeed * camFront;
-	});
+	if (!input)
+		return;
 
-	input->registerKeyPress(SDLK_s, [=] {
-		camPos -= camSpeed * camFront;
-	});
+	glm::vec3 right = glm::normalize(glm::cross(camFront, camUp));
+	glm::vec3 move(0.f);
 
-	input->registerKeyPress(SDLK_a, [=] {
-		camPos -= glm::normalize(glm::cross(camFront, camUp)) * camSpeed;
-	});
+	if (input->isScancodeDown(SDL_SCANCODE_W))
+		move += camFront;
+	if (input->isScancodeDown(SDL_SCANCODE_S))
+		move -= camFront;
+	if (input->isScancodeDown(SDL_SCANCODE_A))
+		move -= right;
+	if (input->isScancodeDown(SDL_SCANCODE_D))
+		move += right;
 
-	input->registerKeyPress(SDLK_d, [=] {
-		camPos += glm::normalize(glm::cross(camFront, camUp)) * camSpeed;
-	});
+	camPos += move * camSpeed * dt;
 }
 
-void Camera::updatePos(glm::vec3 pos)
+void Camera::updatePos(glm::vec3 pos, bool interpolate)
 {
+	prevPos = interpolate ? camPos : pos;
 	camPos = pos;
 }
 
@@ -55,6 +68,18 @@ void Camera::updateDir(glm::vec2 mousePos)
 	camFront = glm::normalize(front);
 }
 
+void Camera::updateDir(const glm::quat& rotation)
+{
+	glm::vec3 front = rotation * glm::vec3(0.f, 0.f, -1.f);
+
+	// Keeps yaw and pitch in sync so mouse look continues from here.
+	pitch = glm::clamp(glm::degrees(asin(glm::clamp(front.y, -1.f, 1.f))), -89.f, 89.f);
+	if (front.x != 0.f || front.z != 0.f)
+		yaw = glm::degrees(atan2(front.z, front.x));
+
+	updateDir(glm::vec2(0.f));
+}
+
 glm::vec3 Camera::getPos()
 {
 	return camPos;
@@ -65,7 +90,8 @@ void Camera::updatePosRel(glm::vec3 relPos)
 	camPos += relPos;
 }
 
-glm::mat4 Camera::getView()
+glm::mat4 Camera::getView(float alpha)
 {
-	return glm::lookAt(camPos, camPos + camFront, camUp);
+	glm::vec3 pos = glm::mix(prevPos, camPos, alpha);
+	return glm::lookAt(pos, pos + camFront, camUp);
 }
\ No newline at end of file
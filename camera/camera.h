@@ -1,31 +1,46 @@
 #pragma once
 #include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
 #include "../input/input.h"
 
 class Camera
 {
 	glm::vec3 camPos;
+	glm::vec3 prevPos;
 	glm::vec3 camFront;
 	glm::vec3 camUp;
 
 	float yaw;
 	float pitch;
 	float sensitiviy;
+	// Units per second
 	float camSpeed;
 
 	Input* input;
 
 public:
+	// Cameras without input are only moved through updatePos() and
+	// updateDir(), e.g. those of additional views.
 	void init(Input* input);
 
-	void updatePos(glm::vec3 pos);
+	// Moves the camera from the held keys, called once per simulation tick.
+	void update(float dt);
+
+	// Moves the camera to pos. Jumps unless interpolate is set, then frames
+	// blend from the previous position like they do for update().
+	void updatePos(glm::vec3 pos, bool interpolate = false);
 	void updatePosRel(glm::vec3 relPos);
 	void updateDir(glm::vec2 mousePos);
+	// Looks along -z of the rotation, roll is ignored.
+	void updateDir(const glm::quat& rotation);
 	void updateDirDelta(glm::vec2 mousePos);
 
 	glm::vec3 getPos();
+	glm::vec3 getFront() { return camFront; };
+	glm::vec3 getUp() { return camUp; };
 	float getYaw() { return yaw; };
 	float getPitch() { return pitch; };
 
-	glm::mat4 getView();
+	// View at alpha of the way from the previous tick to the current one.
+	glm::mat4 getView(float alpha = 1.f);
 };
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "cameraPath.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+template<typename Key>
+static size_t findSegment(const std::vector<Key>& keys, float time)
+{
+	auto it = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const Key& key) {
+		return t < key.time;
+	});
+
+	size_t next = static_cast<size_t>(it - keys.begin());
+	return next == 0 ? 0 : next - 1;
+}
+
+template<typename Key>
+static float segmentAlpha(const std::vector<Key>& keys, size_t i, float time)
+{
+	if (i + 1 >= keys.size())
+		return 0.f;
+
+	float span = keys[i + 1].time - keys[i].time;
+	return span > 0.f ? glm::clamp((time - keys[i].time) / span, 0.f, 1.f) : 1.f;
+}
+
+static glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+{
+	float t2 = t * t;
+	float t3 = t2 * t;
+
+	return 0.5f * ((2.f * p1) +
+		(p2 - p0) * t +
+		(2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t2 +
+		(3.f * p1 - p0 - 3.f * p2 + p3) * t3);
+}
+
+glm::quat cameraRotation(float yaw, float pitch)
+{
+	// Camera looks down -z at yaw -90 and pitch 0.
+	glm::quat turn = glm::angleAxis(glm::radians(-(yaw + 90.f)), glm::vec3(0.f, 1.f, 0.f));
+	glm::quat tilt = glm::angleAxis(glm::radians(pitch), glm::vec3(1.f, 0.f, 0.f));
+	return glm::normalize(turn * tilt);
+}
+
+bool CameraPath::load(const char* path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		std::cerr << "Camera Path Error: cannot read " << path << std::endl;
+		return false;
+	}
+
+	std::vector<PositionKey> newPositions;
+	std::vector<RotationKey> newRotations;
+	CameraPathClock newClock = PATH_TIME;
+	float newStep = frameStep;
+	bool newLoop = false;
+
+	std::string line;
+	uint32_t lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.resize(comment);
+
+		std::istringstream stream(line);
+		std::string keyword;
+		if (!(stream >> keyword))
+			continue;
+
+		bool valid = true;
+		if (keyword == "loop" || keyword == "stop")
+		{
+			newLoop = keyword == "loop";
+		}
+		else if (keyword == "clock")
+		{
+			std::string mode;
+			stream >> mode;
+			if (mode == "time")
+				newClock = PATH_TIME;
+			else if (mode == "frame")
+			{
+				newClock = PATH_FRAME;
+				float step;
+				if (stream >> step)
+					newStep = step;
+				valid = newStep > 0.f;
+			}
+			else
+				valid = false;
+		}
+		else if (keyword == "pos")
+		{
+			PositionKey key;
+			valid = static_cast<bool>(stream >> key.time >> key.pos.x >> key.pos.y >> key.pos.z);
+			if (valid)
+				newPositions.push_back(key);
+		}
+		else if (keyword == "rot")
+		{
+			float keyTime, yaw, pitch;
+			valid = static_cast<bool>(stream >> keyTime >> yaw >> pitch);
+			if (valid)
+				newRotations.push_back({ keyTime, cameraRotation(yaw, pitch) });
+		}
+		else
+		{
+			valid = false;
+		}
+
+		if (!valid)
+		{
+			std::cerr << "Camera Path Error: " << path << ":" << lineNumber << ": cannot parse '" << line << "'" << std::endl;
+			return false;
+		}
+	}
+
+	auto byTime = [](const auto& a, const auto& b) { return a.time < b.time; };
+	std::stable_sort(newPositions.begin(), newPositions.end(), byTime);
+	std::stable_sort(newRotations.begin(), newRotations.end(), byTime);
+
+	positions = std::move(newPositions);
+	rotations = std::move(newRotations);
+	clock = newClock;
+	frameStep = newStep;
+	loop = newLoop;
+
+	duration = 0.f;
+	if (!positions.empty())
+		duration = std::max(duration, positions.back().time);
+	if (!rotations.empty())
+		duration = std::max(duration, rotations.back().time);
+
+	time = 0.f;
+	playing = false;
+	return true;
+}
+
+void CameraPath::play()
+{
+	time = 0.f;
+	playing = hasPos() || hasRot();
+}
+
+void CameraPath::advance(float dt)
+{
+	if (!playing)
+		return;
+
+	time += dt;
+	if (time < duration)
+		return;
+
+	if (loop && duration > 0.f)
+	{
+		time = std::fmod(time, duration);
+	}
+	else
+	{
+		time = duration;
+		playing = false;
+	}
+}
+
+glm::vec3 CameraPath::getPos() const
+{
+	size_t i = findSegment(positions, time);
+	size_t last = positions.size() - 1;
+
+	const glm::vec3& p0 = positions[i == 0 ? 0 : i - 1].pos;
+	const glm::vec3& p1 = positions[i].pos;
+	const glm::vec3& p2 = positions[std::min(i + 1, last)].pos;
+	const glm::vec3& p3 = positions[std::min(i + 2, last)].pos;
+
+	return catmullRom(p0, p1, p2, p3, segmentAlpha(positions, i, time));
+}
+
+glm::quat CameraPath::getRot() const
+{
+	size_t i = findSegment(rotations, time);
+	size_t next = std::min(i + 1, rotations.size() - 1);
+
+	return glm::slerp(rotations[i].rot, rotations[next].rot, segmentAlpha(rotations, i, time));
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include <vector>
+
+enum CameraPathClock
+{
+	// Advances with simulation time.
+	PATH_TIME,
+	// Advances frameStep every rendered frame, so every run renders the
+	// same views no matter how long frames take.
+	PATH_FRAME
+};
+
+// Keyframed camera flythrough. Positions follow a Catmull-Rom spline through
+// the position keys, orientations are slerped between the rotation keys.
+// Both tracks are optional and keyed independently. Path files are text:
+//   loop | stop
+//   clock time | clock frame [step seconds]
+//   pos <time> <x> <y> <z>
+//   rot <time> <yaw> <pitch>
+// with yaw and pitch in degrees as used by Camera, # starts a comment.
+class CameraPath
+{
+	struct PositionKey
+	{
+		float time;
+		glm::vec3 pos;
+	};
+
+	struct RotationKey
+	{
+		float time;
+		glm::quat rot;
+	};
+
+	std::vector<PositionKey> positions;
+	std::vector<RotationKey> rotations;
+	float duration = 0.f;
+	float time = 0.f;
+	bool playing = false;
+
+public:
+	CameraPathClock clock = PATH_TIME;
+	float frameStep = 1.f / 60.f;
+	bool loop = false;
+
+	bool load(const char* path);
+
+	// Starts from the first key.
+	void play();
+	void stop() { playing = false; }
+	bool isPlaying() const { return playing; }
+
+	// Moves playback forward, a path that doesn't loop stops at its end.
+	void advance(float dt);
+
+	bool hasPos() const { return !positions.empty(); }
+	bool hasRot() const { return !rotations.empty(); }
+	glm::vec3 getPos() const;
+	glm::quat getRot() const;
+};
+
+// Orientation of a camera looking along yaw and pitch, in degrees.
+glm::quat cameraRotation(float yaw, float pitch);
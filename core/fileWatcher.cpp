@@ -0,0 +1,98 @@
+#include "fileWatcher.h"
+#include <algorithm>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+void FileWatcher::init(const std::string& directory)
+{
+	this->directory = directory;
+	lastPoll = std::chrono::steady_clock::now();
+
+#ifdef __linux__
+	notifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (notifyFD >= 0 && inotify_add_watch(notifyFD, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		close(notifyFD);
+		notifyFD = -1;
+	}
+#endif
+}
+
+void FileWatcher::cleanup()
+{
+#ifdef __linux__
+	if (notifyFD >= 0)
+		close(notifyFD);
+#endif
+
+	notifyFD = -1;
+	files.clear();
+}
+
+int64_t FileWatcher::modifiedTime(const std::string& name) const
+{
+	struct stat info;
+	if (stat((directory + name).c_str(), &info) != 0)
+		return 0;
+
+	return static_cast<int64_t>(info.st_mtime);
+}
+
+void FileWatcher::watch(const std::string& name)
+{
+	if (files.find(name) == files.end())
+		files[name] = modifiedTime(name);
+}
+
+void FileWatcher::poll(std::vector<std::string>& changed)
+{
+	size_t first = changed.size();
+	auto report = [&](const std::string& name) {
+		if (std::find(changed.begin() + first, changed.end(), name) == changed.end())
+			changed.push_back(name);
+	};
+
+#ifdef __linux__
+	if (notifyFD >= 0)
+	{
+		alignas(inotify_event) char buffer[4096];
+		while (true)
+		{
+			ssize_t length = read(notifyFD, buffer, sizeof(buffer));
+			if (length <= 0)
+				break;
+
+			for (char* p = buffer; p < buffer + length;)
+			{
+				inotify_event* event = reinterpret_cast<inotify_event*>(p);
+				if (event->len > 0 && files.find(event->name) != files.end())
+					report(event->name);
+
+				p += sizeof(inotify_event) + event->len;
+			}
+		}
+
+		return;
+	}
+#endif
+
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastPoll < pollInterval)
+		return;
+
+	lastPoll = now;
+
+	for (auto& file : files)
+	{
+		int64_t time = modifiedTime(file.first);
+		if (time != file.second)
+		{
+			file.second = time;
+			report(file.first);
+		}
+	}
+}
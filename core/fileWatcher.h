@@ -0,0 +1,34 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Reports watched files in one directory that were written since the last
+// poll. Uses inotify on Linux and compares modification times elsewhere, or
+// when inotify is not available.
+class FileWatcher
+{
+	std::string directory;
+	int notifyFD = -1;
+
+	// Watched names and their modification time at the last poll.
+	std::unordered_map<std::string, int64_t> files;
+	std::chrono::steady_clock::time_point lastPoll;
+
+	int64_t modifiedTime(const std::string& name) const;
+
+public:
+	// Interval between modification time checks in the fallback.
+	std::chrono::milliseconds pollInterval{ 250 };
+
+	void init(const std::string& directory);
+	void cleanup();
+
+	// name is relative to the directory.
+	void watch(const std::string& name);
+
+	// Appends the name of every watched file that changed, each once.
+	void poll(std::vector<std::string>& changed);
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename Signature, size_t Capacity = 32>
+class InplaceFunction;
+
+// Move only replacement for std::function that keeps the callable inside its
+// own storage, so it never allocates. Callables larger than Capacity are
+// rejected at compile time.
+template<typename R, typename... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>
+{
+	typedef R (*Invoke)(void* callable, Args... args);
+	// Move constructs the callable at src into dst, or only destroys it when
+	// dst is null.
+	typedef void (*Manage)(void* dst, void* src);
+
+	alignas(std::max_align_t) unsigned char storage[Capacity];
+	Invoke invoke = nullptr;
+	Manage manage = nullptr;
+
+	void moveFrom(InplaceFunction& other)
+	{
+		if (other.manage)
+		{
+			other.manage(storage, other.storage);
+			invoke = other.invoke;
+			manage = other.manage;
+			other.invoke = nullptr;
+			other.manage = nullptr;
+		}
+	}
+
+public:
+	InplaceFunction() = default;
+
+	template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InplaceFunction>::value>::type>
+	InplaceFunction(F&& function)
+	{
+		typedef typename std::decay<F>::type T;
+		static_assert(sizeof(T) <= Capacity, "callable does not fit into InplaceFunction");
+		static_assert(alignof(T) <= alignof(std::max_align_t), "callable is over aligned");
+
+		new (storage) T(std::forward<F>(function));
+
+		invoke = [](void* callable, Args... args) -> R {
+			return (*static_cast<T*>(callable))(std::forward<Args>(args)...);
+		};
+		manage = [](void* dst, void* src) {
+			T* callable = static_cast<T*>(src);
+			if (dst)
+				new (dst) T(std::move(*callable));
+			callable->~T();
+		};
+	}
+
+	InplaceFunction(InplaceFunction&& other) noexcept
+	{
+		moveFrom(other);
+	}
+
+	InplaceFunction& operator=(InplaceFunction&& other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			moveFrom(other);
+		}
+		return *this;
+	}
+
+	InplaceFunction(const InplaceFunction&) = delete;
+	InplaceFunction& operator=(const InplaceFunction&) = delete;
+
+	~InplaceFunction() { reset(); }
+
+	void reset()
+	{
+		if (manage)
+			manage(nullptr, storage);
+
+		invoke = nullptr;
+		manage = nullptr;
+	}
+
+	explicit operator bool() const { return invoke != nullptr; }
+
+	R operator()(Args... args)
+	{
+		return invoke(storage, std::forward<Args>(args)...);
+	}
+};
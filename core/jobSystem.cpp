@@ -0,0 +1,309 @@
+#include "jobSystem.h"
+
+static thread_local uint32_t threadIndex = 0xFFFFFFFF;
+
+bool WorkQueue::push(Job* job)
+{
+	int64_t b = bottom.load(std::memory_order_relaxed);
+	int64_t t = top.load(std::memory_order_acquire);
+	if (b - t >= capacity)
+		return false;
+
+	jobs[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+	return true;
+}
+
+Job* WorkQueue::pop()
+{
+	int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = jobs[b & (capacity - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// Last job, race the thieves for it.
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job* WorkQueue::steal()
+{
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = bottom.load(std::memory_order_acquire);
+
+	if (t >= b)
+		return nullptr;
+
+	Job* job = jobs[t & (capacity - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+
+	return job;
+}
+
+void JobSystem::init(uint32_t workerCount)
+{
+	if (workerCount == 0)
+	{
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	quit = false;
+	sharedPool.init();
+
+	for (uint32_t i = 0; i <= workerCount; i++)
+	{
+		ThreadData* data = new ThreadData();
+		data->jobPool.init();
+		data->stealSeed = i * 2654435761u + 1;
+		threads.push_back(data);
+	}
+
+	threadIndex = 0;
+	for (uint32_t i = 1; i <= workerCount; i++)
+		workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+void JobSystem::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quit = true;
+	}
+	sleepSignal.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+
+	for (ThreadData* data : threads)
+	{
+		data->jobPool.cleanup();
+		delete data;
+	}
+	threads.clear();
+
+	sharedPool.cleanup();
+	sharedQueue.clear();
+	mainThreadQueue.clear();
+	threadIndex = 0xFFFFFFFF;
+}
+
+uint32_t JobSystem::currentThread() const
+{
+	return threadIndex < threads.size() ? threadIndex : threadCount();
+}
+
+void JobSystem::JobPool::init()
+{
+	jobs = new Job[jobPoolSize];
+	busy = new std::atomic<uint8_t>[jobPoolSize];
+	for (uint32_t i = 0; i < jobPoolSize; i++)
+		busy[i].store(0, std::memory_order_relaxed);
+	index = 0;
+}
+
+void JobSystem::JobPool::cleanup()
+{
+	delete[] jobs;
+	delete[] busy;
+	jobs = nullptr;
+	busy = nullptr;
+}
+
+Job* JobSystem::JobPool::allocate()
+{
+	for (uint32_t i = 0; i < slotProbes; i++)
+	{
+		uint32_t slot = index++ & (jobPoolSize - 1);
+		if (busy[slot].load(std::memory_order_acquire))
+			continue;
+
+		busy[slot].store(1, std::memory_order_relaxed);
+		jobs[slot].busy = &busy[slot];
+		jobs[slot].overflow = false;
+		return &jobs[slot];
+	}
+
+	return nullptr;
+}
+
+Job* JobSystem::allocateJob()
+{
+	uint32_t thread = currentThread();
+	if (thread < threads.size())
+		return threads[thread]->jobPool.allocate();
+
+	std::lock_guard<std::mutex> lock(sharedMutex);
+	return sharedPool.allocate();
+}
+
+void JobSystem::enqueue(Job* job)
+{
+	uint32_t thread = currentThread();
+	if (thread < threads.size())
+	{
+		// A full queue means the thread is far ahead of the workers, running
+		// the job right away is the cheapest form of back pressure.
+		if (!threads[thread]->queue.push(job))
+		{
+			execute(job);
+			return;
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		sharedQueue.push_back(job);
+	}
+
+	queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+	if (sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		sleepSignal.notify_one();
+	}
+}
+
+void JobSystem::execute(Job* job)
+{
+	JobCounter* counter = job->counter;
+	std::atomic<uint8_t>* busy = job->busy;
+	job->function(*job);
+
+	// The slot may be handed out again from here on.
+	if (busy)
+		busy->store(0, std::memory_order_release);
+	else if (job->overflow)
+		delete job;
+
+	if (counter)
+		finish(counter);
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+	// Decrements that leave jobs behind can't free the counter.
+	uint32_t count = counter->count.load(std::memory_order_relaxed);
+	while (count > 1)
+	{
+		if (counter->count.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+			return;
+	}
+
+	// Probably the last one. Reaching zero under the lock keeps waiters in
+	// isDone() until the waiting list was taken, the counter is not touched
+	// after the lock is released.
+	std::vector<Job*> released;
+	{
+		std::lock_guard<std::mutex> lock(counter->waitingMutex);
+		if (counter->count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			released.swap(counter->waiting);
+	}
+
+	for (Job* job : released)
+		enqueue(job);
+}
+
+Job* JobSystem::findJob(uint32_t thread)
+{
+	ThreadData* data = threads[thread];
+
+	Job* job = data->queue.pop();
+	if (!job)
+	{
+		uint32_t count = threadCount();
+		uint32_t start = data->stealSeed % count;
+		data->stealSeed = data->stealSeed * 1664525u + 1013904223u;
+
+		for (uint32_t i = 0; i < count && !job; i++)
+		{
+			uint32_t victim = (start + i) % count;
+			if (victim != thread)
+				job = threads[victim]->queue.steal();
+		}
+	}
+
+	if (!job)
+	{
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		if (!sharedQueue.empty())
+		{
+			job = sharedQueue.front();
+			sharedQueue.pop_front();
+		}
+	}
+
+	if (job)
+		queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+
+	return job;
+}
+
+void JobSystem::workerLoop(uint32_t thread)
+{
+	threadIndex = thread;
+
+	while (!quit.load(std::memory_order_relaxed))
+	{
+		Job* job = findJob(thread);
+		if (job)
+		{
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+		sleepSignal.wait(lock, [&] { return quit.load() || queuedJobs.load(std::memory_order_seq_cst) > 0; });
+		sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+void JobSystem::runMainThreadJobs()
+{
+	// Local copy, main thread jobs may wait and end up back in here.
+	std::vector<Job> jobs;
+	{
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+		if (mainThreadQueue.empty())
+			return;
+
+		jobs.swap(mainThreadQueue);
+	}
+
+	for (Job& job : jobs)
+		execute(&job);
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	uint32_t thread = currentThread();
+
+	while (!counter.isDone())
+	{
+		Job* job = thread < threads.size() ? findJob(thread) : nullptr;
+		if (job)
+			execute(job);
+		else if (thread == 0)
+			runMainThreadJobs();
+		else
+			std::this_thread::yield();
+	}
+}
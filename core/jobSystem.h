@@ -0,0 +1,239 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct Job;
+
+// Counts unfinished jobs. Jobs scheduled with a dependency on a counter are
+// held back until it reaches zero.
+struct JobCounter
+{
+	std::atomic<uint32_t> count{ 0 };
+
+	// The last decrement happens under this lock, see JobSystem::finish().
+	mutable std::mutex waitingMutex;
+	std::vector<Job*> waiting;
+
+	// Once this returns true the counter may be destroyed: taking the lock
+	// waits out the thread that brought it to zero.
+	bool isDone() const
+	{
+		if (count.load(std::memory_order_acquire) != 0)
+			return false;
+
+		std::lock_guard<std::mutex> lock(waitingMutex);
+		return true;
+	}
+};
+
+// One cache line. The callable is copied into data, so it must be trivially
+// copyable and small; capture pointers rather than containers.
+struct alignas(64) Job
+{
+	void (*function)(Job& job);
+	JobCounter* counter;
+	// Pool slot state, cleared once the job ran so the slot can be reused.
+	// Null for jobs outside the pools.
+	std::atomic<uint8_t>* busy;
+	// Allocated on its own because the pool was full, deleted once it ran.
+	bool overflow;
+	alignas(16) unsigned char data[32];
+};
+
+// Chase-Lev deque. The owning thread pushes and pops at the bottom, other
+// threads steal from the top.
+class WorkQueue
+{
+public:
+	static constexpr int64_t capacity = 4096;
+
+private:
+	std::atomic<int64_t> top{ 0 };
+	std::atomic<int64_t> bottom{ 0 };
+	std::atomic<Job*> jobs[capacity];
+
+public:
+	bool push(Job* job);
+	Job* pop();
+	Job* steal();
+};
+
+// Work stealing scheduler. Thread 0 is the thread that called init(), the
+// others are workers. Jobs may be scheduled from any thread; threads that
+// are not part of the system go through a shared locked queue.
+class JobSystem
+{
+	static constexpr uint32_t jobPoolSize = 4096;
+	// Slots looked at for a free one before a job runs inline instead.
+	static constexpr uint32_t slotProbes = 8;
+
+	// Ring of job storage. Slots are handed out in order and skipped while
+	// their job is still queued, parked on a dependency or running.
+	struct JobPool
+	{
+		Job* jobs = nullptr;
+		std::atomic<uint8_t>* busy = nullptr;
+		uint32_t index = 0;
+
+		void init();
+		void cleanup();
+		Job* allocate();
+	};
+
+	struct ThreadData
+	{
+		WorkQueue queue;
+		JobPool jobPool;
+		uint32_t stealSeed;
+	};
+
+	std::vector<ThreadData*> threads;
+	std::vector<std::thread> workers;
+
+	// Storage and queue for jobs scheduled from foreign threads.
+	std::mutex sharedMutex;
+	JobPool sharedPool;
+	std::deque<Job*> sharedQueue;
+
+	std::mutex mainThreadMutex;
+	std::vector<Job> mainThreadQueue;
+
+	std::mutex sleepMutex;
+	std::condition_variable sleepSignal;
+	std::atomic<int32_t> queuedJobs{ 0 };
+	std::atomic<uint32_t> sleepingWorkers{ 0 };
+	std::atomic<bool> quit{ false };
+
+	Job* allocateJob();
+	void enqueue(Job* job);
+	void execute(Job* job);
+	void finish(JobCounter* counter);
+	Job* findJob(uint32_t thread);
+	void workerLoop(uint32_t thread);
+
+	template<typename F>
+	static void invoke(Job& job)
+	{
+		(*reinterpret_cast<F*>(job.data))();
+	}
+
+	template<typename F>
+	static void fill(Job& job, F&& function, JobCounter* counter)
+	{
+		typedef typename std::decay<F>::type Function;
+		static_assert(sizeof(Function) <= sizeof(Job::data), "Job captures too much");
+		static_assert(std::is_trivially_copyable<Function>::value, "Job captures must be trivially copyable");
+
+		job.function = &invoke<Function>;
+		job.counter = counter;
+		new (job.data) Function(std::forward<F>(function));
+	}
+
+public:
+	// Zero workers picks one per hardware thread, minus the main thread.
+	void init(uint32_t workerCount = 0);
+	void cleanup();
+
+	uint32_t threadCount() const { return static_cast<uint32_t>(threads.size()); }
+
+	// Index of the calling thread, or threadCount() for foreign threads.
+	uint32_t currentThread() const;
+
+	// Runs function on any thread. counter, if given, is incremented now and
+	// decremented when the job finishes. With a dependency the job only starts
+	// once that counter has reached zero.
+	template<typename F>
+	void run(F&& function, JobCounter* counter = nullptr, JobCounter* dependency = nullptr)
+	{
+		if (counter)
+			counter->count.fetch_add(1, std::memory_order_relaxed);
+
+		Job* job = allocateJob();
+		if (!job)
+		{
+			// Every slot looked at is still in use. A job that could start
+			// now runs right here, one that has to wait gets its own storage.
+			if (!dependency || dependency->count.load(std::memory_order_acquire) == 0)
+			{
+				function();
+				if (counter)
+					finish(counter);
+				return;
+			}
+
+			job = new Job;
+			job->busy = nullptr;
+			job->overflow = true;
+		}
+
+		fill(*job, std::forward<F>(function), counter);
+
+		if (dependency)
+		{
+			std::lock_guard<std::mutex> lock(dependency->waitingMutex);
+			if (dependency->count.load(std::memory_order_acquire) != 0)
+			{
+				dependency->waiting.push_back(job);
+				return;
+			}
+		}
+
+		enqueue(job);
+	}
+
+	// Queues function for the next runMainThreadJobs(), for work that has to
+	// happen on the main thread such as SDL or presentation.
+	template<typename F>
+	void runOnMainThread(F&& function, JobCounter* counter = nullptr)
+	{
+		if (counter)
+			counter->count.fetch_add(1, std::memory_order_relaxed);
+
+		Job job;
+		job.busy = nullptr;
+		job.overflow = false;
+		fill(job, std::forward<F>(function), counter);
+
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+		mainThreadQueue.push_back(job);
+	}
+
+	void runMainThreadJobs();
+
+	// Executes other jobs until the counter reaches zero.
+	void wait(JobCounter& counter);
+
+	// Calls function(begin, end) over [0, count) in batches of batchSize and
+	// returns once every batch has run. Runs inline when there is one batch.
+	template<typename F>
+	void parallelFor(uint32_t count, uint32_t batchSize, F&& function)
+	{
+		if (count == 0)
+			return;
+
+		if (count <= batchSize || threads.size() <= 1)
+		{
+			function(0u, count);
+			return;
+		}
+
+		JobCounter counter;
+		auto* f = &function;
+		for (uint32_t begin = batchSize; begin < count; begin += batchSize)
+		{
+			uint32_t end = begin + batchSize < count ? begin + batchSize : count;
+			run([f, begin, end] { (*f)(begin, end); }, &counter);
+		}
+
+		// The calling thread takes the first batch itself.
+		function(0u, batchSize);
+		wait(counter);
+	}
+};
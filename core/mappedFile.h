@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+
+// Read only view of a whole file mapped into memory.
+class MappedFile
+{
+	const char* bytes = nullptr;
+	size_t length = 0;
+
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	// Fails for missing and empty files.
+	bool open(const char* path);
+	void close();
+
+	const char* data() const { return bytes; }
+	size_t size() const { return length; }
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+// Bounded lock free queue for one producer and one consumer thread. push()
+// and pop() never wait: they fail when the ring is full or empty. Each side
+// keeps a copy of the other's index and only reloads it when the ring looks
+// full or empty, so the shared cache lines are touched rarely.
+template<typename T, uint32_t Capacity>
+class SpscRing
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+	static_assert(std::is_trivially_copyable<T>::value, "Items are copied between threads");
+
+	T items[Capacity];
+
+	// Both indices only grow, they wrap with the counter.
+	alignas(64) std::atomic<uint32_t> head{ 0 };
+	uint32_t cachedTail = 0;
+	alignas(64) std::atomic<uint32_t> tail{ 0 };
+	uint32_t cachedHead = 0;
+
+public:
+	// Producer side.
+	bool push(const T& item)
+	{
+		uint32_t index = head.load(std::memory_order_relaxed);
+		if (index - cachedTail == Capacity)
+		{
+			cachedTail = tail.load(std::memory_order_acquire);
+			if (index - cachedTail == Capacity)
+				return false;
+		}
+
+		items[index & (Capacity - 1)] = item;
+		head.store(index + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side.
+	bool pop(T& item)
+	{
+		uint32_t index = tail.load(std::memory_order_relaxed);
+		if (index == cachedHead)
+		{
+			cachedHead = head.load(std::memory_order_acquire);
+			if (index == cachedHead)
+				return false;
+		}
+
+		item = items[index & (Capacity - 1)];
+		tail.store(index + 1, std::memory_order_release);
+		return true;
+	}
+};
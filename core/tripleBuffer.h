@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock free single producer, single consumer triple buffer. The producer
+// fills back() and publishes it, the consumer takes the latest published
+// slot with acquire() and reads front() until the next acquire. Neither
+// side ever waits for the other; a slot published twice before the
+// consumer looks is replaced, and the producer gets the unread one back.
+template<typename T>
+class TripleBuffer
+{
+	static constexpr uint8_t indexMask = 3;
+	static constexpr uint8_t freshBit = 4;
+
+	T slots[3];
+	uint8_t backIndex = 0;
+	std::atomic<uint8_t> middle{ 1 };
+	uint8_t frontIndex = 2;
+
+public:
+	T& back() { return slots[backIndex]; }
+	T& front() { return slots[frontIndex]; }
+
+	// Every slot, for setup and teardown while neither side is running.
+	T& slot(uint32_t index) { return slots[index]; }
+
+	// Producer side, returns true if the previously published slot was never
+	// acquired. back() is then that slot and still holds its contents.
+	bool publish()
+	{
+		uint8_t previous = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel);
+		backIndex = previous & indexMask;
+		return (previous & freshBit) != 0;
+	}
+
+	// Consumer side, returns false if nothing was published since the last call.
+	bool acquire()
+	{
+		if (!hasFresh())
+			return false;
+
+		frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & indexMask;
+		return true;
+	}
+
+	bool hasFresh() const { return (middle.load(std::memory_order_acquire) & freshBit) != 0; }
+};
@@ -1,90 +1,415 @@
 #include "input.h"
+#include "sdl/SDL_keyboard.h"
+#include "sdl/SDL_timer.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
-void Input::onEventLoop(SDL_Event* e)
+constexpr char inputLogMagic[4] = { 'A', 'T', 'I', 'R' };
+constexpr uint32_t inputLogVersion = 1;
+
+struct RecordedFrame
 {
-	// Updating keystate
-	if (e->type == SDL_KEYDOWN)
+	uint32_t frame;
+	uint32_t eventCount;
+	double time;
+};
+
+static_assert(sizeof(RecordedEvent) == 24, "input log event layout changed");
+static_assert(sizeof(RecordedFrame) == 16, "input log frame layout changed");
+
+template<typename Handler>
+static void removeHandler(std::vector<Handler>& handlers, InputID id, bool dispatching, bool& needsCompact)
+{
+	for (size_t i = 0; i < handlers.size(); i++)
 	{
-		auto it = keyState.find(e->key.keysym.sym);
+		if (handlers[i].id != id)
+			continue;
 
-		if (it == keyState.end())
-			keyState.insert(std::pair<SDL_Keycode, bool>(e->key.keysym.sym, true));
+		if (dispatching)
+		{
+			handlers[i].id = 0;
+			handlers[i].callback.reset();
+			needsCompact = true;
+		}
 		else
-			it->second = true;
+		{
+			handlers.erase(handlers.begin() + i);
+		}
+		return;
+	}
+}
+
+template<typename Handler>
+static void compactHandlers(std::vector<Handler>& handlers)
+{
+	handlers.erase(std::remove_if(handlers.begin(), handlers.end(), [](const Handler& handler) {
+		return handler.id == 0;
+	}), handlers.end());
+}
+
+template<typename Callback, typename... Args>
+void Input::dispatch(std::vector<Handler<Callback>>& handlers, const Args&... args)
+{
+	dispatchDepth++;
+	for (size_t i = 0; i < handlers.size(); i++)
+		if (handlers[i].callback)
+			handlers[i].callback(args...);
+	dispatchDepth--;
+
+	if (dispatchDepth == 0 && needsCompact)
+		compact();
+}
+
+void Input::compact()
+{
+	for (auto& entry : pressHandlers)
+		compactHandlers(entry.second);
+	for (auto& entry : releaseHandlers)
+		compactHandlers(entry.second);
+	for (auto& entry : eventHandlers)
+		compactHandlers(entry.second);
+	compactHandlers(motionHandlers);
+
+	needsCompact = false;
+}
+
+void Input::onEventLoop(SDL_Event* e)
+{
+	if (recordFile.is_open())
+	{
+		RecordedEvent event;
+		if (encodeEvent(*e, event))
+			recordedEvents.push_back(event);
 	}
-	else if (e->type == SDL_KEYUP)
+
+	switch (e->type)
 	{
-		auto it = keyState.find(e->key.keysym.sym);
+	case SDL_KEYDOWN:
+	{
+		SDL_Keycode key = e->key.keysym.sym;
+		keysDown.set(e->key.keysym.scancode);
 
-		if (it != keyState.end())
-			it->second = false;
+		if (std::find(heldKeys.begin(), heldKeys.end(), key) == heldKeys.end())
+			heldKeys.push_back(key);
+		break;
 	}
-	else if (e->type == MOUSE_MOTION)
+	case SDL_KEYUP:
 	{
+		SDL_Keycode key = e->key.keysym.sym;
+		keysDown.reset(e->key.keysym.scancode);
+
+		auto held = std::find(heldKeys.begin(), heldKeys.end(), key);
+		if (held != heldKeys.end())
+		{
+			*held = heldKeys.back();
+			heldKeys.pop_back();
+		}
+
+		auto it = releaseHandlers.find(key);
+		if (it != releaseHandlers.end())
+			dispatch(it->second);
+		break;
+	}
+	case SDL_MOUSEMOTION:
 		mousePos = glm::vec2(static_cast<float>(e->motion.x), static_cast<float>(e->motion.y));
+		mouseDelta += glm::vec2(static_cast<float>(e->motion.xrel), static_cast<float>(e->motion.yrel));
+		mouseMoved = true;
+		break;
 	}
 
-	for (auto callback : callbacks)
+	if (eventHandlers.empty())
+		return;
+
+	auto it = eventHandlers.find(e->type);
+	if (it == eventHandlers.end())
+		return;
+
+	dispatch(it->second, *e);
+}
+
+void Input::onFrame()
+{
+	for (size_t i = 0; i < heldKeys.size(); i++)
 	{
-		if (callback.type == KEY_RELEASE && callback.keyCode == e->key.keysym.sym)
-			callback.callback();
-		else if (e->type == SDL_MOUSEMOTION && callback.type == MOUSE_MOTION)
-			callback.callback2(glm::vec2(e->motion.xrel, e->motion.yrel));
+		auto it = pressHandlers.find(heldKeys[i]);
+		if (it != pressHandlers.end())
+			dispatch(it->second);
 	}
+
+	if (!mouseMoved)
+		return;
+
+	glm::vec2 delta = mouseDelta;
+	mouseDelta = glm::vec2(0.f);
+	mouseMoved = false;
+
+	dispatch(motionHandlers, delta);
 }
 
-void Input::onFrame()
+bool Input::isKeyDown(SDL_Keycode key) const
 {
-	// Calling callbacks
-	for (auto callback : callbacks)
-		if (callback.type == KEY_PRESS && keyState[callback.keyCode] == true)
-			callback.callback();
+	return keysDown[SDL_GetScancodeFromKey(key)];
 }
 
-InputID Input::registerKeyPress(SDL_Keycode key, std::function<void()>&& callback)
+InputID Input::registerKeyPress(SDL_Keycode key, KeyCallback&& callback)
 {
-	Pair pair{};
-	pair.keyCode = key;
-	pair.callback = callback;
-	pair.type = KEY_PRESS;
-	pair.id = generateInputID();
+	InputID id = generateInputID();
+	pressHandlers[key].push_back({ id, std::move(callback) });
+	registrations[id] = { KEY_PRESS, static_cast<uint32_t>(key) };
 
-	callbacks.push_back(pair);
+	return id;
+}
 
-	return pair.id;
+InputID Input::registerKeyRelease(SDL_Keycode key, KeyCallback&& callback)
+{
+	InputID id = generateInputID();
+	releaseHandlers[key].push_back({ id, std::move(callback) });
+	registrations[id] = { KEY_RELEASE, static_cast<uint32_t>(key) };
+
+	return id;
 }
 
-InputID Input::registerKeyRelease(SDL_Keycode key, std::function<void()>&& callback)
+InputID Input::registerMouseMotion(MouseMotionCallback&& callback)
 {
-	Pair pair{};
-	pair.keyCode = key;
-	pair.callback = callback;
-	pair.type = KEY_RELEASE;
-	pair.id = generateInputID();
+	InputID id = generateInputID();
+	motionHandlers.push_back({ id, std::move(callback) });
+	registrations[id] = { MOUSE_MOTION, 0 };
+
+	return id;
+}
 
-	callbacks.push_back(pair);
+InputID Input::registerEvent(uint32_t type, EventCallback&& callback)
+{
+	InputID id = generateInputID();
+	eventHandlers[type].push_back({ id, std::move(callback) });
+	registrations[id] = { RAW_EVENT, type };
 
-	return pair.id;
+	return id;
 }
 
-InputID Input::registerMouseMotion(std::function<void(glm::vec2)>&& callback)
+void Input::removeCallback(InputID id)
 {
-	Pair pair{};
-	pair.callback2 = callback;
-	pair.type = MOUSE_MOTION;
-	pair.id = generateInputID();
+	auto it = registrations.find(id);
+	if (it == registrations.end())
+		return;
+
+	Registration registration = it->second;
+	registrations.erase(it);
 
-	callbacks.push_back(pair);
+	bool dispatching = dispatchDepth > 0;
+	SDL_Keycode key = static_cast<SDL_Keycode>(registration.key);
 
-	return pair.id;
+	switch (registration.type)
+	{
+	case KEY_PRESS:
+		removeHandler(pressHandlers[key], id, dispatching, needsCompact);
+		break;
+	case KEY_RELEASE:
+		removeHandler(releaseHandlers[key], id, dispatching, needsCompact);
+		break;
+	case MOUSE_MOTION:
+		removeHandler(motionHandlers, id, dispatching, needsCompact);
+		break;
+	case RAW_EVENT:
+		removeHandler(eventHandlers[registration.key], id, dispatching, needsCompact);
+		break;
+	}
 }
 
-void Input::removeCallback(InputID id)
+bool Input::encodeEvent(const SDL_Event& e, RecordedEvent& event)
 {
-	for (int i = 0; i < callbacks.size(); i++)
+	event = {};
+	event.type = e.type;
+
+	switch (e.type)
 	{
-		if (callbacks[i].id == id)
-			callbacks.erase(callbacks.begin() + i);
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		event.values[0] = e.key.keysym.scancode;
+		event.values[1] = e.key.keysym.sym;
+		event.values[2] = e.key.keysym.mod;
+		event.values[3] = e.key.repeat;
+		return true;
+	case SDL_MOUSEMOTION:
+		event.values[0] = e.motion.x;
+		event.values[1] = e.motion.y;
+		event.values[2] = e.motion.xrel;
+		event.values[3] = e.motion.yrel;
+		event.values[4] = static_cast<int32_t>(e.motion.state);
+		return true;
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		event.values[0] = e.button.button;
+		event.values[1] = e.button.x;
+		event.values[2] = e.button.y;
+		event.values[3] = e.button.clicks;
+		return true;
+	case SDL_MOUSEWHEEL:
+		event.values[0] = e.wheel.x;
+		event.values[1] = e.wheel.y;
+		event.values[2] = static_cast<int32_t>(e.wheel.direction);
+		return true;
+	case SDL_QUIT:
+		return true;
 	}
-}
\ No newline at end of file
+
+	return false;
+}
+
+void Input::decodeEvent(const RecordedEvent& event, SDL_Event& e)
+{
+	memset(&e, 0, sizeof(e));
+	e.type = event.type;
+	e.common.timestamp = SDL_GetTicks();
+
+	switch (event.type)
+	{
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		e.key.state = event.type == SDL_KEYDOWN ? SDL_PRESSED : SDL_RELEASED;
+		e.key.keysym.scancode = static_cast<SDL_Scancode>(event.values[0]);
+		e.key.keysym.sym = static_cast<SDL_Keycode>(event.values[1]);
+		e.key.keysym.mod = static_cast<Uint16>(event.values[2]);
+		e.key.repeat = static_cast<Uint8>(event.values[3]);
+		break;
+	case SDL_MOUSEMOTION:
+		e.motion.x = event.values[0];
+		e.motion.y = event.values[1];
+		e.motion.xrel = event.values[2];
+		e.motion.yrel = event.values[3];
+		e.motion.state = static_cast<Uint32>(event.values[4]);
+		break;
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		e.button.state = event.type == SDL_MOUSEBUTTONDOWN ? SDL_PRESSED : SDL_RELEASED;
+		e.button.button = static_cast<Uint8>(event.values[0]);
+		e.button.x = event.values[1];
+		e.button.y = event.values[2];
+		e.button.clicks = static_cast<Uint8>(event.values[3]);
+		break;
+	case SDL_MOUSEWHEEL:
+		e.wheel.x = event.values[0];
+		e.wheel.y = event.values[1];
+		e.wheel.direction = static_cast<Uint32>(event.values[2]);
+		break;
+	}
+}
+
+bool Input::startRecording(const char* path)
+{
+	stopRecording();
+
+	recordFile.open(path, std::ios::binary | std::ios::trunc);
+	if (!recordFile.is_open())
+	{
+		std::cerr << "Input Error: cannot write " << path << std::endl;
+		return false;
+	}
+
+	recordFile.write(inputLogMagic, sizeof(inputLogMagic));
+	recordFile.write(reinterpret_cast<const char*>(&inputLogVersion), sizeof(inputLogVersion));
+
+	recordedEvents.clear();
+	recordFrame = 0;
+	recordTime = 0.0;
+	return true;
+}
+
+void Input::stopRecording()
+{
+	if (!recordFile.is_open())
+		return;
+
+	// Events after the last endFrame() still belong to a frame.
+	if (!recordedEvents.empty())
+		endFrame(0.0);
+
+	recordFile.close();
+}
+
+void Input::endFrame(double frameTime)
+{
+	if (!recordFile.is_open())
+		return;
+
+	recordTime += frameTime;
+
+	RecordedFrame frame;
+	frame.frame = recordFrame++;
+	frame.eventCount = static_cast<uint32_t>(recordedEvents.size());
+	frame.time = recordTime;
+
+	recordFile.write(reinterpret_cast<const char*>(&frame), sizeof(frame));
+	recordFile.write(reinterpret_cast<const char*>(recordedEvents.data()), recordedEvents.size() * sizeof(RecordedEvent));
+	recordedEvents.clear();
+}
+
+bool Input::startReplay(const char* path)
+{
+	stopReplay();
+
+	if (!replayFile.open(path))
+	{
+		std::cerr << "Input Error: cannot read " << path << std::endl;
+		return false;
+	}
+
+	uint32_t version = 0;
+	if (replayFile.size() >= sizeof(inputLogMagic) + sizeof(version))
+		memcpy(&version, replayFile.data() + sizeof(inputLogMagic), sizeof(version));
+
+	if (memcmp(replayFile.data(), inputLogMagic, std::min(replayFile.size(), sizeof(inputLogMagic))) != 0 || version != inputLogVersion)
+	{
+		std::cerr << "Input Error: malformed input log " << path << std::endl;
+		replayFile.close();
+		return false;
+	}
+
+	replayOffset = sizeof(inputLogMagic) + sizeof(version);
+	replayTime = 0.0;
+	replaying = true;
+	return true;
+}
+
+void Input::stopReplay()
+{
+	replayFile.close();
+	replayOffset = 0;
+	replaying = false;
+}
+
+bool Input::replayFrame(double& frameTime)
+{
+	frameTime = 0.0;
+	if (!replaying)
+		return false;
+
+	RecordedFrame frame;
+	size_t remaining = replayFile.size() - replayOffset;
+	if (remaining < sizeof(frame))
+		return false;
+
+	memcpy(&frame, replayFile.data() + replayOffset, sizeof(frame));
+	if (frame.eventCount > (remaining - sizeof(frame)) / sizeof(RecordedEvent))
+		return false;
+
+	replayOffset += sizeof(frame);
+	frameTime = frame.time - replayTime;
+	replayTime = frame.time;
+
+	bool quit = false;
+	for (uint32_t i = 0; i < frame.eventCount; i++)
+	{
+		RecordedEvent event;
+		memcpy(&event, replayFile.data() + replayOffset, sizeof(event));
+		replayOffset += sizeof(event);
+
+		SDL_Event e;
+		decodeEvent(event, e);
+		onEventLoop(&e);
+		quit = quit || e.type == SDL_QUIT;
+	}
+
+	return !quit;
+}
@@ -1,10 +1,13 @@
 #pragma once
+#include <bitset>
 #include <vector>
-#include <functional>
 #include <unordered_map>
 #include "sdl/SDL_keycode.h"
 #include "sdl/SDL_events.h"
 #include "glm/glm.hpp"
+#include "../core/inplaceFunction.h"
+#include "../core/mappedFile.h"
+#include <fstream>
 
 typedef int InputID;
 
@@ -12,47 +15,134 @@ enum RegisterType
 {
 	KEY_PRESS,
 	KEY_RELEASE,
-	MOUSE_MOTION
+	MOUSE_MOTION,
+	RAW_EVENT
 };
 
-struct Pair
+typedef InplaceFunction<void()> KeyCallback;
+typedef InplaceFunction<void(glm::vec2)> MouseMotionCallback;
+typedef InplaceFunction<void(const SDL_Event&)> EventCallback;
+
+// One event in an input log. Only the event types Input reacts to are
+// recorded, their fields are packed into values.
+struct RecordedEvent
 {
-	SDL_Keycode keyCode;
-	std::function<void()> callback;
-	std::function<void(glm::vec2)> callback2;
-	RegisterType type;
-	InputID id;
+	uint32_t type;
+	int32_t values[5];
 };
 
+// Handlers are kept in tables per key and per event type, so an event only
+// visits the handlers that match it. Callbacks are stored inline and never
+// allocate. Handlers may be removed from inside a callback, registering new
+// ones from a callback is not supported.
 class Input
 {
-	std::vector<Pair> callbacks;
-	std::unordered_map<SDL_Keycode, bool> keyState;
+	template<typename Callback>
+	struct Handler
+	{
+		InputID id;
+		Callback callback;
+	};
+
+	struct Registration
+	{
+		RegisterType type;
+		// Keycode or SDL event type.
+		uint32_t key;
+	};
+
+	std::unordered_map<SDL_Keycode, std::vector<Handler<KeyCallback>>> pressHandlers;
+	std::unordered_map<SDL_Keycode, std::vector<Handler<KeyCallback>>> releaseHandlers;
+	std::vector<Handler<MouseMotionCallback>> motionHandlers;
+	std::unordered_map<uint32_t, std::vector<Handler<EventCallback>>> eventHandlers;
+	std::unordered_map<InputID, Registration> registrations;
+
+	std::bitset<SDL_NUM_SCANCODES> keysDown;
+	// Keys held right now, so onFrame() only looks at pressed keys.
+	std::vector<SDL_Keycode> heldKeys;
+
 	InputID currentID = 0;
-	glm::vec2 mousePos;
+	glm::vec2 mousePos = glm::vec2(0.f);
+	// Relative motion of every event since the last onFrame().
+	glm::vec2 mouseDelta = glm::vec2(0.f);
+	bool mouseMoved = false;
+
+	// Removals while dispatching only clear the handler, the tables are
+	// compacted once dispatch is done.
+	uint32_t dispatchDepth = 0;
+	bool needsCompact = false;
+
+	// Input logs are little endian: a header of char[4] "ATIR" and a uint32
+	// version, then per frame a uint32 frame index, a uint32 event count, a
+	// double timestamp in seconds since the first frame and the events.
+	std::ofstream recordFile;
+	std::vector<RecordedEvent> recordedEvents;
+	uint32_t recordFrame = 0;
+	double recordTime = 0.0;
+
+	MappedFile replayFile;
+	size_t replayOffset = 0;
+	double replayTime = 0.0;
+	bool replaying = false;
 
-	InputID generateInputID() 
+	static bool encodeEvent(const SDL_Event& e, RecordedEvent& event);
+	static void decodeEvent(const RecordedEvent& event, SDL_Event& e);
+
+	InputID generateInputID()
 	{
 		currentID++;
 		return currentID;
 	}
 
+	template<typename Callback, typename... Args>
+	void dispatch(std::vector<Handler<Callback>>& handlers, const Args&... args);
+	void compact();
+
 public:
 	void onEventLoop(SDL_Event* e);
 
-	// Must be called every frame
+	// Must be called every frame. Runs the press callbacks of held keys and
+	// hands the motion gathered since the last call to the motion callbacks
+	// as a single delta.
 	void onFrame();
 
-	// Callback is invoked when keypress event is fired.
-	InputID registerKeyPress(SDL_Keycode key, std::function<void()>&& callback);
-	
+	// Callback is invoked every frame while the key is held.
+	InputID registerKeyPress(SDL_Keycode key, KeyCallback&& callback);
+
 	// Callback is invoked when keyrelease event is fired.
-	InputID registerKeyRelease(SDL_Keycode key, std::function<void()>&& callback);
+	InputID registerKeyRelease(SDL_Keycode key, KeyCallback&& callback);
 
-	InputID registerMouseMotion(std::function<void(glm::vec2)>&& callback);
+	InputID registerMouseMotion(MouseMotionCallback&& callback);
+
+	// Callback is invoked for every SDL event of the given type.
+	InputID registerEvent(uint32_t type, EventCallback&& callback);
 
 	glm::vec2 getMousePos() { return mousePos; };
 
+	bool isKeyDown(SDL_Keycode key) const;
+	bool isScancodeDown(SDL_Scancode scancode) const { return keysDown[scancode]; }
+
 	// Removes a specific callback
 	void removeCallback(InputID id);
-};
\ No newline at end of file
+
+	// Writes every event passed to onEventLoop() to an input log, framed by
+	// endFrame().
+	bool startRecording(const char* path);
+	void stopRecording();
+	bool isRecording() const { return recordFile.is_open(); }
+
+	// Closes the current frame of the recording. frameTime is the time the
+	// frame advanced the simulation by.
+	void endFrame(double frameTime);
+
+	// Plays back an input log instead of live input, one recorded frame per
+	// replayFrame() call.
+	bool startReplay(const char* path);
+	void stopReplay();
+	bool isReplaying() const { return replaying; }
+
+	// Feeds the events of the next recorded frame to onEventLoop() and
+	// returns the frame time it was recorded with. Returns false once the log
+	// ends or a recorded SDL_QUIT is reached.
+	bool replayFrame(double& frameTime);
+};
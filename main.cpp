@@ -1,11 +1,35 @@
 #include "vulkan/vkEngine.h"
 #include "audio/audio.h"
 #include "audio/speaker.h"
+#include <cstdlib>
+#include <cstring>
 
 int main(int argc, char* arv[])
 {
 	VulkanEngine engine;
 
+	// --record <log>, --replay <log>, --camera <path> and --frames <count>
+	// for repeatable runs, --audio device|loopback|null picks the output.
+	// assets/camera/grid_overview.path frames the whole initScene grid and
+	// assets/camera/look_away.path keeps it behind the camera. Both advance
+	// per frame, so every run renders the same views:
+	//   --camera assets/camera/grid_overview.path --frames 600 --replay input.log
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(arv[i], "--record") == 0)
+			engine.recordPath = arv[i + 1];
+		else if (strcmp(arv[i], "--replay") == 0)
+			engine.replayPath = arv[i + 1];
+		else if (strcmp(arv[i], "--camera") == 0)
+			engine.cameraPathFile = arv[i + 1];
+		else if (strcmp(arv[i], "--frames") == 0)
+			engine.maxFrames = static_cast<uint32_t>(strtoul(arv[i + 1], nullptr, 10));
+		else if (strcmp(arv[i], "--audio") == 0 && strcmp(arv[i + 1], "loopback") == 0)
+			engine.audioOutput = AUDIO_OUTPUT_LOOPBACK;
+		else if (strcmp(arv[i], "--audio") == 0 && strcmp(arv[i + 1], "null") == 0)
+			engine.audioOutput = AUDIO_OUTPUT_NULL;
+	}
+
 	engine.init();
 
 	engine.run();
@@ -13,4 +37,4 @@ int main(int argc, char* arv[])
 	engine.cleanup();
 
 	return 0;
-}
\ No newline at end of file
+}
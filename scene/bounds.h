@@ -0,0 +1,139 @@
+#pragma once
+#include "glm/glm.hpp"
+#include <cfloat>
+
+struct AABB
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	void expand(glm::vec3 point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void expand(const AABB& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+	glm::vec3 extents() const { return (max - min) * 0.5f; }
+	bool isEmpty() const { return min.x > max.x; }
+
+	// Bounds of this box after transformation, without visiting all 8 corners.
+	AABB transformed(const glm::mat4& m) const
+	{
+		glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.f));
+		glm::vec3 e = extents();
+		glm::vec3 r = glm::abs(glm::vec3(m[0])) * e.x + glm::abs(glm::vec3(m[1])) * e.y + glm::abs(glm::vec3(m[2])) * e.z;
+
+		AABB result;
+		result.min = c - r;
+		result.max = c + r;
+		return result;
+	}
+};
+
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	float tMax = FLT_MAX;
+};
+
+// Slab test against a ray with precomputed reciprocal direction. Returns the
+// entry distance, or FLT_MAX when the box is missed or further than tMax.
+inline float intersectRayAABB(const AABB& box, glm::vec3 origin, glm::vec3 invDir, float tMax)
+{
+	glm::vec3 t0 = (box.min - origin) * invDir;
+	glm::vec3 t1 = (box.max - origin) * invDir;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.f));
+	float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+inline bool intersectSphereAABB(const AABB& box, glm::vec3 center, float radius)
+{
+	glm::vec3 closest = glm::clamp(center, box.min, box.max);
+	glm::vec3 d = center - closest;
+	return glm::dot(d, d) <= radius * radius;
+}
+
+enum FrustumTest
+{
+	FRUSTUM_OUTSIDE,
+	FRUSTUM_INTERSECTS,
+	FRUSTUM_INSIDE
+};
+
+struct Frustum
+{
+	// Planes are stored as (normal, distance) with normals pointing inwards.
+	glm::vec4 planes[6];
+
+	static Frustum fromMatrix(const glm::mat4& viewproj)
+	{
+		glm::vec4 row0 = glm::vec4(viewproj[0][0], viewproj[1][0], viewproj[2][0], viewproj[3][0]);
+		glm::vec4 row1 = glm::vec4(viewproj[0][1], viewproj[1][1], viewproj[2][1], viewproj[3][1]);
+		glm::vec4 row2 = glm::vec4(viewproj[0][2], viewproj[1][2], viewproj[2][2], viewproj[3][2]);
+		glm::vec4 row3 = glm::vec4(viewproj[0][3], viewproj[1][3], viewproj[2][3], viewproj[3][3]);
+
+		Frustum frustum;
+		frustum.planes[0] = row3 + row0;
+		frustum.planes[1] = row3 - row0;
+		frustum.planes[2] = row3 + row1;
+		frustum.planes[3] = row3 - row1;
+		frustum.planes[4] = row3 + row2;
+		frustum.planes[5] = row3 - row2;
+
+		for (int i = 0; i < 6; i++)
+			frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+
+		return frustum;
+	}
+
+	bool intersects(const AABB& box) const
+	{
+		glm::vec3 c = box.center();
+		glm::vec3 e = box.extents();
+
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 n = glm::vec3(planes[i]);
+			float r = glm::dot(e, glm::abs(n));
+			if (glm::dot(n, c) + planes[i].w < -r)
+				return false;
+		}
+
+		return true;
+	}
+
+	// Like intersects(), but also reports boxes that are fully contained so
+	// hierarchy traversal can accept whole subtrees without further tests.
+	FrustumTest classify(const AABB& box) const
+	{
+		glm::vec3 c = box.center();
+		glm::vec3 e = box.extents();
+		FrustumTest result = FRUSTUM_INSIDE;
+
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 n = glm::vec3(planes[i]);
+			float r = glm::dot(e, glm::abs(n));
+			float d = glm::dot(n, c) + planes[i].w;
+			if (d < -r)
+				return FRUSTUM_OUTSIDE;
+			if (d < r)
+				result = FRUSTUM_INTERSECTS;
+		}
+
+		return result;
+	}
+};
@@ -0,0 +1,260 @@
+#include "bvh.h"
+#include <algorithm>
+#include <functional>
+
+static float surfaceArea(const AABB& box)
+{
+	if (box.isEmpty())
+		return 0.f;
+
+	glm::vec3 e = box.max - box.min;
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+void BVH::build(const AABB* primBounds, uint32_t count)
+{
+	clear();
+	if (count == 0)
+		return;
+
+	primitives.resize(count);
+	centroids.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		primitives[i] = i;
+		centroids[i] = primBounds[i].center();
+	}
+
+	nodes.reserve(count * 2);
+	parents.reserve(count * 2);
+
+	BVHNode root;
+	root.leftFirst = 0;
+	root.count = count;
+	nodes.push_back(root);
+	parents.push_back(invalidIndex);
+	updateNodeBounds(0, primBounds);
+
+	// Node and depth.
+	std::vector<std::pair<uint32_t, uint32_t>> stack;
+	stack.push_back({ 0, 0 });
+	while (!stack.empty())
+	{
+		std::pair<uint32_t, uint32_t> entry = stack.back();
+		stack.pop_back();
+		subdivide(entry.first, entry.second, primBounds, stack);
+	}
+
+	centroids.clear();
+	centroids.shrink_to_fit();
+}
+
+void BVH::clear()
+{
+	nodes.clear();
+	primitives.clear();
+	parents.clear();
+}
+
+void BVH::updateNodeBounds(uint32_t nodeIndex, const AABB* primBounds)
+{
+	BVHNode& node = nodes[nodeIndex];
+	node.bounds = AABB();
+	for (uint32_t i = 0; i < node.count; i++)
+		node.bounds.expand(primBounds[primitives[node.leftFirst + i]]);
+}
+
+void BVH::subdivide(uint32_t nodeIndex, uint32_t depth, const AABB* primBounds, std::vector<std::pair<uint32_t, uint32_t>>& stack)
+{
+	const uint32_t first = nodes[nodeIndex].leftFirst;
+	const uint32_t count = nodes[nodeIndex].count;
+	if (count <= maxLeafSize)
+		return;
+
+	AABB centroidBounds;
+	for (uint32_t i = 0; i < count; i++)
+		centroidBounds.expand(centroids[primitives[first + i]]);
+
+	// Skewed input can make SAH peel off a few primitives per level, past
+	// sahDepth every split halves the node so traversal stacks stay bounded.
+	if (depth >= sahDepth)
+	{
+		glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+		uint32_t* begin = primitives.data() + first;
+		std::nth_element(begin, begin + count / 2, begin + count, [&](uint32_t a, uint32_t b) {
+			return centroids[a][axis] < centroids[b][axis];
+		});
+
+		split(nodeIndex, count / 2, depth, primBounds, stack);
+		return;
+	}
+
+	struct Bin
+	{
+		AABB bounds;
+		uint32_t count = 0;
+	};
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float minC = centroidBounds.min[axis];
+		float maxC = centroidBounds.max[axis];
+		if (maxC <= minC)
+			continue;
+
+		Bin bins[binCount];
+		float scale = binCount / (maxC - minC);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t prim = primitives[first + i];
+			uint32_t bin = std::min(binCount - 1, static_cast<uint32_t>((centroids[prim][axis] - minC) * scale));
+			bins[bin].count++;
+			bins[bin].bounds.expand(primBounds[prim]);
+		}
+
+		// Sweep from both sides to get the cost of every split plane.
+		float leftArea[binCount - 1], rightArea[binCount - 1];
+		uint32_t leftCount[binCount - 1], rightCount[binCount - 1];
+		AABB leftBox, rightBox;
+		uint32_t leftSum = 0, rightSum = 0;
+		for (uint32_t i = 0; i < binCount - 1; i++)
+		{
+			leftSum += bins[i].count;
+			leftCount[i] = leftSum;
+			leftBox.expand(bins[i].bounds);
+			leftArea[i] = surfaceArea(leftBox);
+
+			rightSum += bins[binCount - 1 - i].count;
+			rightCount[binCount - 2 - i] = rightSum;
+			rightBox.expand(bins[binCount - 1 - i].bounds);
+			rightArea[binCount - 2 - i] = surfaceArea(rightBox);
+		}
+
+		for (uint32_t i = 0; i < binCount - 1; i++)
+		{
+			float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i + 1;
+			}
+		}
+	}
+
+	float leafCost = count * surfaceArea(nodes[nodeIndex].bounds);
+	if (bestAxis < 0 || bestCost >= leafCost)
+		return;
+
+	float minC = centroidBounds.min[bestAxis];
+	float scale = binCount / (centroidBounds.max[bestAxis] - minC);
+	uint32_t* begin = primitives.data() + first;
+	uint32_t* middle = std::partition(begin, begin + count, [&](uint32_t prim) {
+		uint32_t bin = std::min(binCount - 1, static_cast<uint32_t>((centroids[prim][bestAxis] - minC) * scale));
+		return bin < bestSplit;
+	});
+
+	uint32_t leftCount = static_cast<uint32_t>(middle - begin);
+	if (leftCount == 0 || leftCount == count)
+		return;
+
+	split(nodeIndex, leftCount, depth, primBounds, stack);
+}
+
+void BVH::split(uint32_t nodeIndex, uint32_t leftCount, uint32_t depth, const AABB* primBounds, std::vector<std::pair<uint32_t, uint32_t>>& stack)
+{
+	const uint32_t first = nodes[nodeIndex].leftFirst;
+	const uint32_t count = nodes[nodeIndex].count;
+	uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+
+	BVHNode left;
+	left.leftFirst = first;
+	left.count = leftCount;
+
+	BVHNode right;
+	right.leftFirst = first + leftCount;
+	right.count = count - leftCount;
+
+	nodes.push_back(left);
+	nodes.push_back(right);
+	parents.push_back(nodeIndex);
+	parents.push_back(nodeIndex);
+
+	nodes[nodeIndex].leftFirst = leftIndex;
+	nodes[nodeIndex].count = 0;
+
+	updateNodeBounds(leftIndex, primBounds);
+	updateNodeBounds(leftIndex + 1, primBounds);
+
+	stack.push_back({ leftIndex, depth + 1 });
+	stack.push_back({ leftIndex + 1, depth + 1 });
+}
+
+void BVH::refit(const AABB* primBounds)
+{
+	for (size_t i = nodes.size(); i-- > 0;)
+	{
+		BVHNode& node = nodes[i];
+		if (node.isLeaf())
+		{
+			updateNodeBounds(static_cast<uint32_t>(i), primBounds);
+		}
+		else
+		{
+			node.bounds = nodes[node.leftFirst].bounds;
+			node.bounds.expand(nodes[node.leftFirst + 1].bounds);
+		}
+	}
+}
+
+void BVH::refitNodes(const AABB* primBounds, std::vector<uint32_t>& dirtyNodes)
+{
+	// Collect every ancestor once, then process children before parents.
+	size_t leafCount = dirtyNodes.size();
+	for (size_t i = 0; i < leafCount; i++)
+	{
+		uint32_t parent = parents[dirtyNodes[i]];
+		while (parent != invalidIndex)
+		{
+			dirtyNodes.push_back(parent);
+			parent = parents[parent];
+		}
+	}
+
+	std::sort(dirtyNodes.begin(), dirtyNodes.end(), std::greater<uint32_t>());
+	dirtyNodes.erase(std::unique(dirtyNodes.begin(), dirtyNodes.end()), dirtyNodes.end());
+
+	for (uint32_t nodeIndex : dirtyNodes)
+	{
+		BVHNode& node = nodes[nodeIndex];
+		if (node.isLeaf())
+		{
+			updateNodeBounds(nodeIndex, primBounds);
+		}
+		else
+		{
+			node.bounds = nodes[node.leftFirst].bounds;
+			node.bounds.expand(nodes[node.leftFirst + 1].bounds);
+		}
+	}
+
+	dirtyNodes.clear();
+}
+
+void BVH::computeLeaves(std::vector<uint32_t>& leafOf) const
+{
+	leafOf.assign(primitives.size(), invalidIndex);
+	for (uint32_t i = 0; i < nodes.size(); i++)
+	{
+		const BVHNode& node = nodes[i];
+		if (node.isLeaf())
+			for (uint32_t j = 0; j < node.count; j++)
+				leafOf[primitives[node.leftFirst + j]] = i;
+	}
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include "bounds.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Interior nodes have count == 0 and store the index of their left child in
+// leftFirst, the right child always follows at leftFirst + 1. Leaves store the
+// first entry of their primitive range in leftFirst.
+struct BVHNode
+{
+	AABB bounds;
+	uint32_t leftFirst;
+	uint32_t count;
+
+	bool isLeaf() const { return count > 0; }
+};
+
+// Bounding volume hierarchy over an array of primitive bounds, built top down
+// with a binned surface area heuristic. Children are always stored after their
+// parent, so walking the node array backwards visits children first.
+class BVH
+{
+	std::vector<glm::vec3> centroids;
+
+	void updateNodeBounds(uint32_t nodeIndex, const AABB* primBounds);
+	// Turns the node into an interior node whose left child holds its first
+	// leftCount primitives.
+	void split(uint32_t nodeIndex, uint32_t leftCount, uint32_t depth, const AABB* primBounds, std::vector<std::pair<uint32_t, uint32_t>>& stack);
+	void subdivide(uint32_t nodeIndex, uint32_t depth, const AABB* primBounds, std::vector<std::pair<uint32_t, uint32_t>>& stack);
+
+public:
+	static constexpr uint32_t invalidIndex = 0xFFFFFFFF;
+	static constexpr uint32_t maxLeafSize = 4;
+	static constexpr uint32_t binCount = 12;
+	// Below this depth nodes are split at the median instead of by SAH, which
+	// keeps any tree within maxDepth levels for up to 2^32 primitives.
+	static constexpr uint32_t sahDepth = 32;
+	static constexpr uint32_t maxDepth = 64;
+	// Enough for a depth first walk of the deepest tree: one pending sibling
+	// per level plus both children of the last.
+	static constexpr uint32_t stackSize = maxDepth + 2;
+
+	std::vector<BVHNode> nodes;
+	std::vector<uint32_t> primitives;
+	std::vector<uint32_t> parents;
+
+	void build(const AABB* primBounds, uint32_t count);
+	void clear();
+
+	// Recomputes every node from the current primitive bounds.
+	void refit(const AABB* primBounds);
+
+	// Recomputes only the given nodes and their ancestors.
+	void refitNodes(const AABB* primBounds, std::vector<uint32_t>& dirtyNodes);
+
+	// Fills leafOf[primitive] with the leaf that holds it.
+	void computeLeaves(std::vector<uint32_t>& leafOf) const;
+
+	bool isEmpty() const { return nodes.empty(); }
+
+	// Visits primitives of every leaf below root whose bounds overlap(bounds) accepts.
+	template<typename Overlap, typename Visit>
+	void query(Overlap&& overlap, Visit&& visit, uint32_t root = 0) const
+	{
+		if (nodes.empty())
+			return;
+
+		uint32_t stack[stackSize];
+		uint32_t top = 0;
+		stack[top++] = root;
+
+		while (top > 0)
+		{
+			const BVHNode& node = nodes[stack[--top]];
+			if (!overlap(node.bounds))
+				continue;
+
+			if (node.isLeaf())
+			{
+				for (uint32_t i = 0; i < node.count; i++)
+					visit(primitives[node.leftFirst + i]);
+			}
+			else
+			{
+				stack[top++] = node.leftFirst + 1;
+				stack[top++] = node.leftFirst;
+			}
+		}
+	}
+
+	// Closest hit traversal. intersect(primitive, tMax) returns the hit
+	// distance or FLT_MAX, nearer children are visited first.
+	template<typename Intersect>
+	float raycast(const Ray& ray, Intersect&& intersect) const
+	{
+		float tMax = ray.tMax;
+		if (nodes.empty())
+			return FLT_MAX;
+
+		glm::vec3 invDir = 1.f / ray.direction;
+		if (intersectRayAABB(nodes[0].bounds, ray.origin, invDir, tMax) == FLT_MAX)
+			return FLT_MAX;
+
+		bool hit = false;
+		uint32_t stack[stackSize];
+		uint32_t top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			const BVHNode& node = nodes[stack[--top]];
+
+			if (node.isLeaf())
+			{
+				for (uint32_t i = 0; i < node.count; i++)
+				{
+					float t = intersect(primitives[node.leftFirst + i], tMax);
+					if (t < tMax)
+					{
+						tMax = t;
+						hit = true;
+					}
+				}
+				continue;
+			}
+
+			uint32_t nearChild = node.leftFirst;
+			uint32_t farChild = node.leftFirst + 1;
+			float tNear = intersectRayAABB(nodes[nearChild].bounds, ray.origin, invDir, tMax);
+			float tFar = intersectRayAABB(nodes[farChild].bounds, ray.origin, invDir, tMax);
+
+			if (tFar < tNear)
+			{
+				std::swap(nearChild, farChild);
+				std::swap(tNear, tFar);
+			}
+
+			if (tFar != FLT_MAX)
+				stack[top++] = farChild;
+			if (tNear != FLT_MAX)
+				stack[top++] = nearChild;
+		}
+
+		return hit ? tMax : FLT_MAX;
+	}
+};
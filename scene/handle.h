@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// 32 bit generational handle. The low 24 bits index a slot, the high 8 bits
+// hold the generation of that slot so stale handles can be detected.
+template<typename T>
+struct Handle
+{
+	uint32_t value = 0;
+
+	static constexpr uint32_t indexBits = 24;
+	static constexpr uint32_t indexMask = (1u << indexBits) - 1;
+
+	static Handle make(uint32_t index, uint8_t generation)
+	{
+		Handle handle;
+		handle.value = (static_cast<uint32_t>(generation) << indexBits) | (index & indexMask);
+		return handle;
+	}
+
+	uint32_t index() const { return value & indexMask; }
+	uint8_t generation() const { return static_cast<uint8_t>(value >> indexBits); }
+	bool isValid() const { return value != 0; }
+
+	bool operator==(Handle other) const { return value == other.value; }
+	bool operator!=(Handle other) const { return value != other.value; }
+};
+
+// Generation 0 is reserved so that a zeroed handle is never valid.
+inline uint8_t nextGeneration(uint8_t generation)
+{
+	generation++;
+	return generation == 0 ? 1 : generation;
+}
+
+// Slot storage addressed by generational handles. Slots are reused through a
+// free list, so handles stay valid while other items are added or removed.
+// Pointers returned by get() are only valid until the next add().
+template<typename T>
+class HandlePool
+{
+	std::vector<T> items;
+	std::vector<uint8_t> generations;
+	std::vector<uint8_t> alive;
+	std::vector<uint32_t> freeSlots;
+	uint32_t count = 0;
+
+public:
+	Handle<T> add(T&& item)
+	{
+		uint32_t index;
+		if (!freeSlots.empty())
+		{
+			index = freeSlots.back();
+			freeSlots.pop_back();
+			items[index] = std::move(item);
+		}
+		else
+		{
+			index = static_cast<uint32_t>(items.size());
+			items.push_back(std::move(item));
+			generations.push_back(1);
+			alive.push_back(0);
+		}
+
+		alive[index] = 1;
+		count++;
+		return Handle<T>::make(index, generations[index]);
+	}
+
+	void remove(Handle<T> handle)
+	{
+		if (!contains(handle))
+			return;
+
+		uint32_t index = handle.index();
+		items[index] = T{};
+		generations[index] = nextGeneration(generations[index]);
+		alive[index] = 0;
+		freeSlots.push_back(index);
+		count--;
+	}
+
+	bool contains(Handle<T> handle) const
+	{
+		uint32_t index = handle.index();
+		return handle.isValid() && index < generations.size() && alive[index] && generations[index] == handle.generation();
+	}
+
+	T* get(Handle<T> handle)
+	{
+		return contains(handle) ? &items[handle.index()] : nullptr;
+	}
+
+	const T* get(Handle<T> handle) const
+	{
+		return contains(handle) ? &items[handle.index()] : nullptr;
+	}
+
+	// Unchecked access for hot loops that already validated the handle.
+	T& operator[](Handle<T> handle) { return items[handle.index()]; }
+	const T& operator[](Handle<T> handle) const { return items[handle.index()]; }
+
+	uint32_t size() const { return count; }
+	uint32_t capacity() const { return static_cast<uint32_t>(items.size()); }
+
+	template<typename F>
+	void forEach(F&& function)
+	{
+		for (uint32_t i = 0; i < items.size(); i++)
+			if (alive[i])
+				function(Handle<T>::make(i, generations[i]), items[i]);
+	}
+};
@@ -0,0 +1,263 @@
+#include "renderScene.h"
+#include "glm/gtc/quaternion.hpp"
+#include <cstring>
+
+RenderableHandle RenderScene::add(MeshHandle mesh, MaterialHandle material, const glm::mat4& transform, const AABB& meshBounds, uint32_t flags)
+{
+	uint32_t slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slot = static_cast<uint32_t>(slotToDense.size());
+		slotToDense.push_back(0);
+		slotGenerations.push_back(1);
+	}
+
+	RenderableHandle handle = RenderableHandle::make(slot, slotGenerations[slot]);
+	slotToDense[slot] = size();
+
+	transforms.push_back(transform);
+	previousTransforms.push_back(transform);
+	meshIds.push_back(mesh);
+	materialIds.push_back(material);
+	localBounds.push_back(meshBounds);
+	bounds.push_back(meshBounds.transformed(transform));
+	this->flags.push_back(flags);
+	handles.push_back(handle);
+
+	if (flags & RENDER_STATIC)
+		staticVersion++;
+
+	return handle;
+}
+
+uint32_t RenderScene::addBatch(const RenderBatch& batch)
+{
+	uint32_t first = size();
+	uint32_t total = first + batch.count;
+	if (batch.count == 0)
+		return first;
+
+	if (batch.count > freeSlots.size())
+	{
+		size_t newSlots = batch.count - freeSlots.size();
+		slotToDense.reserve(slotToDense.size() + newSlots);
+		slotGenerations.reserve(slotGenerations.size() + newSlots);
+	}
+
+	// Inserted from the source instead of resized and overwritten, which would
+	// write every element twice.
+	transforms.insert(transforms.end(), batch.transforms, batch.transforms + batch.count);
+	previousTransforms.insert(previousTransforms.end(), batch.transforms, batch.transforms + batch.count);
+	flags.insert(flags.end(), batch.flags, batch.flags + batch.count);
+
+	meshIds.reserve(total);
+	materialIds.reserve(total);
+	localBounds.reserve(total);
+	bounds.reserve(total);
+	handles.reserve(total);
+
+	bool anyStatic = false;
+	for (uint32_t i = 0; i < batch.count; i++)
+	{
+		uint32_t mesh = batch.meshIndices[i];
+
+		meshIds.push_back(batch.meshes[mesh]);
+		materialIds.push_back(batch.materials[batch.materialIndices[i]]);
+		localBounds.push_back(batch.meshBounds[mesh]);
+		bounds.push_back(batch.meshBounds[mesh].transformed(batch.transforms[i]));
+		anyStatic |= (batch.flags[i] & RENDER_STATIC) != 0;
+
+		uint32_t slot;
+		if (!freeSlots.empty())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			slot = static_cast<uint32_t>(slotToDense.size());
+			slotToDense.push_back(0);
+			slotGenerations.push_back(1);
+		}
+
+		slotToDense[slot] = first + i;
+		handles.push_back(RenderableHandle::make(slot, slotGenerations[slot]));
+	}
+
+	if (anyStatic)
+		staticVersion++;
+
+	return first;
+}
+
+void RenderScene::remove(RenderableHandle handle)
+{
+	if (!contains(handle))
+		return;
+
+	uint32_t slot = handle.index();
+	uint32_t index = slotToDense[slot];
+	uint32_t last = size() - 1;
+
+	if (flags[index] & RENDER_STATIC)
+		staticVersion++;
+
+	if (index != last)
+	{
+		transforms[index] = transforms[last];
+		previousTransforms[index] = previousTransforms[last];
+		meshIds[index] = meshIds[last];
+		materialIds[index] = materialIds[last];
+		localBounds[index] = localBounds[last];
+		bounds[index] = bounds[last];
+		flags[index] = flags[last];
+		handles[index] = handles[last];
+
+		slotToDense[handles[index].index()] = index;
+	}
+
+	transforms.pop_back();
+	previousTransforms.pop_back();
+	meshIds.pop_back();
+	materialIds.pop_back();
+	localBounds.pop_back();
+	bounds.pop_back();
+	flags.pop_back();
+	handles.pop_back();
+
+	slotGenerations[slot] = nextGeneration(slotGenerations[slot]);
+	freeSlots.push_back(slot);
+}
+
+void RenderScene::clear()
+{
+	if (!handles.empty())
+		staticVersion++;
+
+	for (RenderableHandle handle : handles)
+	{
+		slotGenerations[handle.index()] = nextGeneration(slotGenerations[handle.index()]);
+		freeSlots.push_back(handle.index());
+	}
+
+	transforms.clear();
+	previousTransforms.clear();
+	movedHandles.clear();
+	meshIds.clear();
+	materialIds.clear();
+	localBounds.clear();
+	bounds.clear();
+	flags.clear();
+	handles.clear();
+}
+
+bool RenderScene::contains(RenderableHandle handle) const
+{
+	uint32_t slot = handle.index();
+	if (!handle.isValid() || slot >= slotGenerations.size() || slotGenerations[slot] != handle.generation())
+		return false;
+
+	uint32_t index = slotToDense[slot];
+	return index < handles.size() && handles[index] == handle;
+}
+
+void RenderScene::setTransform(RenderableHandle handle, const glm::mat4& transform)
+{
+	if (!contains(handle))
+		return;
+
+	uint32_t index = indexOf(handle);
+	if (flags[index] & RENDER_STATIC)
+		staticVersion++;
+
+	if (!(flags[index] & RENDER_MOVED))
+	{
+		flags[index] |= RENDER_MOVED;
+		movedHandles.push_back(handle);
+	}
+
+	transforms[index] = transform;
+	bounds[index] = localBounds[index].transformed(transform);
+	bounds[index].expand(localBounds[index].transformed(previousTransforms[index]));
+}
+
+void RenderScene::setLocalBounds(RenderableHandle handle, const AABB& meshBounds)
+{
+	if (!contains(handle))
+		return;
+
+	uint32_t index = indexOf(handle);
+	if (flags[index] & RENDER_STATIC)
+		staticVersion++;
+
+	localBounds[index] = meshBounds;
+	bounds[index] = meshBounds.transformed(transforms[index]);
+	if (flags[index] & RENDER_MOVED)
+		bounds[index].expand(meshBounds.transformed(previousTransforms[index]));
+}
+
+void RenderScene::beginTick()
+{
+	for (RenderableHandle handle : movedHandles)
+	{
+		if (!contains(handle))
+			continue;
+
+		uint32_t index = indexOf(handle);
+		previousTransforms[index] = transforms[index];
+		bounds[index] = localBounds[index].transformed(transforms[index]);
+		flags[index] &= ~RENDER_MOVED;
+	}
+
+	movedHandles.clear();
+}
+
+glm::mat4 RenderScene::interpolatedTransform(uint32_t index, float alpha) const
+{
+	if (!(flags[index] & RENDER_MOVED))
+		return transforms[index];
+
+	const glm::mat4& from = previousTransforms[index];
+	const glm::mat4& to = transforms[index];
+
+	// Decompose so rotations are slerped instead of blending matrix columns.
+	glm::vec3 fromScale(glm::length(glm::vec3(from[0])), glm::length(glm::vec3(from[1])), glm::length(glm::vec3(from[2])));
+	glm::vec3 toScale(glm::length(glm::vec3(to[0])), glm::length(glm::vec3(to[1])), glm::length(glm::vec3(to[2])));
+
+	glm::quat fromRotation = glm::quat_cast(glm::mat3(glm::vec3(from[0]) / fromScale.x, glm::vec3(from[1]) / fromScale.y, glm::vec3(from[2]) / fromScale.z));
+	glm::quat toRotation = glm::quat_cast(glm::mat3(glm::vec3(to[0]) / toScale.x, glm::vec3(to[1]) / toScale.y, glm::vec3(to[2]) / toScale.z));
+
+	glm::vec3 scale = glm::mix(fromScale, toScale, alpha);
+	glm::mat4 result = glm::mat4_cast(glm::slerp(fromRotation, toRotation, alpha));
+	result[0] *= scale.x;
+	result[1] *= scale.y;
+	result[2] *= scale.z;
+	result[3] = glm::mix(from[3], to[3], alpha);
+
+	return result;
+}
+
+void RenderScene::setMaterial(RenderableHandle handle, MaterialHandle material)
+{
+	if (!contains(handle))
+		return;
+
+	uint32_t index = indexOf(handle);
+	if (flags[index] & RENDER_STATIC)
+		staticVersion++;
+
+	materialIds[index] = material;
+}
+
+void RenderScene::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	const uint32_t count = size();
+	for (uint32_t i = 0; i < count; i++)
+		if ((flags[i] & RENDER_VISIBLE) && frustum.intersects(bounds[i]))
+			visible.push_back(i);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "handle.h"
+#include "bounds.h"
+#include "glm/glm.hpp"
+#include <vector>
+
+struct Mesh;
+struct Material;
+struct Renderable;
+
+typedef Handle<Mesh> MeshHandle;
+typedef Handle<Material> MaterialHandle;
+typedef Handle<Renderable> RenderableHandle;
+
+enum RenderFlags : uint32_t
+{
+	RENDER_VISIBLE = 1 << 0,
+	RENDER_STATIC = 1 << 1,
+	// Set while previousTransforms differs from transforms, cleared by beginTick().
+	RENDER_MOVED = 1 << 2
+};
+
+// Renderables that share mesh and material tables, such as the contents of a
+// scene file. The per object arrays index into the tables.
+struct RenderBatch
+{
+	uint32_t count = 0;
+	const glm::mat4* transforms = nullptr;
+	const uint32_t* meshIndices = nullptr;
+	const uint32_t* materialIndices = nullptr;
+	const uint32_t* flags = nullptr;
+
+	const MeshHandle* meshes = nullptr;
+	const AABB* meshBounds = nullptr;
+	const MaterialHandle* materials = nullptr;
+};
+
+// Renderables stored as densely packed component arrays. Handles map to a
+// dense index through a sparse slot table, removal swaps the last element
+// into the hole so the arrays never have gaps.
+class RenderScene
+{
+	std::vector<uint32_t> slotToDense;
+	std::vector<uint8_t> slotGenerations;
+	std::vector<uint32_t> freeSlots;
+	std::vector<RenderableHandle> movedHandles;
+
+public:
+	std::vector<glm::mat4> transforms;
+	// Transforms at the start of the last simulation tick, for interpolation.
+	std::vector<glm::mat4> previousTransforms;
+	std::vector<MeshHandle> meshIds;
+	std::vector<MaterialHandle> materialIds;
+	std::vector<AABB> localBounds;
+	std::vector<AABB> bounds;
+	std::vector<uint32_t> flags;
+	std::vector<RenderableHandle> handles;
+
+	// Bumped whenever a RENDER_STATIC renderable is added, removed or changed,
+	// so caches built from the static set know when to rebuild.
+	uint64_t staticVersion = 1;
+
+	RenderableHandle add(MeshHandle mesh, MaterialHandle material, const glm::mat4& transform, const AABB& meshBounds, uint32_t flags = RENDER_VISIBLE);
+	// Appends a whole batch with one allocation per array instead of growing
+	// them object by object. Returns the dense index of the first object.
+	uint32_t addBatch(const RenderBatch& batch);
+	void remove(RenderableHandle handle);
+	void clear();
+
+	bool contains(RenderableHandle handle) const;
+
+	// Dense index of a live renderable, only valid until the next remove().
+	uint32_t indexOf(RenderableHandle handle) const { return slotToDense[handle.index()]; }
+
+	void setTransform(RenderableHandle handle, const glm::mat4& transform);
+	void setMaterial(RenderableHandle handle, MaterialHandle material);
+	void setLocalBounds(RenderableHandle handle, const AABB& meshBounds);
+
+	// Starts a simulation tick, objects moved during the last one stop
+	// interpolating. Bounds of moving objects cover both transforms.
+	void beginTick();
+
+	// Transform of a renderable alpha of the way from the previous tick to the current one.
+	glm::mat4 interpolatedTransform(uint32_t index, float alpha) const;
+
+	// Appends the dense index of every renderable inside the frustum.
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+	uint32_t size() const { return static_cast<uint32_t>(handles.size()); }
+};
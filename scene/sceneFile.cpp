@@ -0,0 +1,180 @@
+#include "sceneFile.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+constexpr char sceneMagic[4] = { 'A', 'T', 'S', 'C' };
+constexpr uint64_t sceneAlignment = 16;
+
+static bool isLittleEndian()
+{
+	uint16_t value = 1;
+	uint8_t first;
+	memcpy(&first, &value, 1);
+	return first == 1;
+}
+
+static uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + sceneAlignment - 1) & ~(sceneAlignment - 1);
+}
+
+bool writeSceneFile(const char* path, const SceneDesc& desc)
+{
+	uint32_t objectCount = static_cast<uint32_t>(desc.transforms.size());
+	if (desc.meshIndices.size() != objectCount || desc.materialIndices.size() != objectCount || desc.flags.size() != objectCount)
+	{
+		std::cerr << "Scene Error: object arrays differ in length" << std::endl;
+		return false;
+	}
+
+	std::vector<uint32_t> stringOffsets;
+	std::string stringData;
+	for (const std::string& name : desc.meshPaths)
+	{
+		stringOffsets.push_back(static_cast<uint32_t>(stringData.size()));
+		stringData += name;
+	}
+	for (const std::string& name : desc.materialNames)
+	{
+		stringOffsets.push_back(static_cast<uint32_t>(stringData.size()));
+		stringData += name;
+	}
+	stringOffsets.push_back(static_cast<uint32_t>(stringData.size()));
+
+	SceneFileHeader header{};
+	memcpy(header.magic, sceneMagic, sizeof(sceneMagic));
+	header.version = sceneFileVersion;
+	header.objectCount = objectCount;
+	header.meshCount = static_cast<uint32_t>(desc.meshPaths.size());
+	header.materialCount = static_cast<uint32_t>(desc.materialNames.size());
+	header.stringDataSize = static_cast<uint32_t>(stringData.size());
+
+	header.stringOffsetsOffset = alignOffset(sizeof(SceneFileHeader));
+	header.stringDataOffset = alignOffset(header.stringOffsetsOffset + stringOffsets.size() * sizeof(uint32_t));
+	header.transformsOffset = alignOffset(header.stringDataOffset + stringData.size());
+	header.meshIndicesOffset = alignOffset(header.transformsOffset + uint64_t(objectCount) * sizeof(glm::mat4));
+	header.materialIndicesOffset = alignOffset(header.meshIndicesOffset + uint64_t(objectCount) * sizeof(uint32_t));
+	header.flagsOffset = alignOffset(header.materialIndicesOffset + uint64_t(objectCount) * sizeof(uint32_t));
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "Scene Error: cannot write " << path << std::endl;
+		return false;
+	}
+
+	uint64_t written = 0;
+	auto write = [&](uint64_t offset, const void* data, size_t size) {
+		static const char padding[sceneAlignment] = {};
+		file.write(padding, offset - written);
+		file.write(static_cast<const char*>(data), size);
+		written = offset + size;
+	};
+
+	write(0, &header, sizeof(header));
+	write(header.stringOffsetsOffset, stringOffsets.data(), stringOffsets.size() * sizeof(uint32_t));
+	write(header.stringDataOffset, stringData.data(), stringData.size());
+	write(header.transformsOffset, desc.transforms.data(), desc.transforms.size() * sizeof(glm::mat4));
+	write(header.meshIndicesOffset, desc.meshIndices.data(), desc.meshIndices.size() * sizeof(uint32_t));
+	write(header.materialIndicesOffset, desc.materialIndices.data(), desc.materialIndices.size() * sizeof(uint32_t));
+	write(header.flagsOffset, desc.flags.data(), desc.flags.size() * sizeof(uint32_t));
+
+	return file.good();
+}
+
+bool SceneFile::open(const char* path)
+{
+	close();
+
+	// The arrays are used in place, so the host has to match the file.
+	if (!isLittleEndian() || !file.open(path))
+		return false;
+
+	const char* data = file.data();
+	uint64_t size = file.size();
+
+	auto fits = [&](uint64_t offset, uint64_t count, uint64_t elementSize) {
+		return offset % alignof(uint32_t) == 0 && offset <= size && count <= (size - offset) / elementSize;
+	};
+
+	if (size < sizeof(SceneFileHeader))
+	{
+		std::cerr << "Scene Error: malformed scene file " << path << std::endl;
+		close();
+		return false;
+	}
+
+	header = reinterpret_cast<const SceneFileHeader*>(data);
+	uint64_t stringCount = uint64_t(header->meshCount) + header->materialCount + 1;
+
+	bool valid = memcmp(header->magic, sceneMagic, sizeof(sceneMagic)) == 0 &&
+		header->version == sceneFileVersion &&
+		fits(header->stringOffsetsOffset, stringCount, sizeof(uint32_t)) &&
+		fits(header->stringDataOffset, header->stringDataSize, 1) &&
+		fits(header->transformsOffset, header->objectCount, sizeof(glm::mat4)) &&
+		fits(header->meshIndicesOffset, header->objectCount, sizeof(uint32_t)) &&
+		fits(header->materialIndicesOffset, header->objectCount, sizeof(uint32_t)) &&
+		fits(header->flagsOffset, header->objectCount, sizeof(uint32_t));
+
+	if (valid)
+	{
+		stringOffsets = reinterpret_cast<const uint32_t*>(data + header->stringOffsetsOffset);
+		stringData = data + header->stringDataOffset;
+		transforms = reinterpret_cast<const glm::mat4*>(data + header->transformsOffset);
+		meshIndices = reinterpret_cast<const uint32_t*>(data + header->meshIndicesOffset);
+		materialIndices = reinterpret_cast<const uint32_t*>(data + header->materialIndicesOffset);
+		flags = reinterpret_cast<const uint32_t*>(data + header->flagsOffset);
+
+		for (uint64_t i = 0; i + 1 < stringCount && valid; i++)
+			valid = stringOffsets[i] <= stringOffsets[i + 1];
+		valid = valid && stringOffsets[stringCount - 1] <= header->stringDataSize;
+	}
+
+	// Indices are checked once here so users can index the tables blindly.
+	if (valid)
+	{
+		uint32_t maxMesh = 0;
+		uint32_t maxMaterial = 0;
+		for (uint32_t i = 0; i < header->objectCount; i++)
+		{
+			maxMesh = std::max(maxMesh, meshIndices[i]);
+			maxMaterial = std::max(maxMaterial, materialIndices[i]);
+		}
+
+		valid = header->objectCount == 0 || (maxMesh < header->meshCount && maxMaterial < header->materialCount);
+	}
+
+	if (!valid)
+	{
+		std::cerr << "Scene Error: malformed scene file " << path << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void SceneFile::close()
+{
+	file.close();
+	header = nullptr;
+	stringOffsets = nullptr;
+	stringData = nullptr;
+	transforms = nullptr;
+	meshIndices = nullptr;
+	materialIndices = nullptr;
+	flags = nullptr;
+}
+
+std::string SceneFile::getMeshPath(uint32_t mesh) const
+{
+	return std::string(stringData + stringOffsets[mesh], stringOffsets[mesh + 1] - stringOffsets[mesh]);
+}
+
+std::string SceneFile::getMaterialName(uint32_t material) const
+{
+	uint32_t string = header->meshCount + material;
+	return std::string(stringData + stringOffsets[string], stringOffsets[string + 1] - stringOffsets[string]);
+}
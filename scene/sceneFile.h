@@ -0,0 +1,76 @@
+#pragma once
+#include "../core/mappedFile.h"
+#include "glm/glm.hpp"
+#include <string>
+#include <vector>
+
+// Scene files are little endian and laid out so that a memory map of the file
+// can be used as is: the header holds the offset of every array, arrays start
+// on 16 byte boundaries and nothing is stored per object but the arrays.
+struct SceneFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t objectCount;
+	uint32_t meshCount;
+	uint32_t materialCount;
+	uint32_t stringDataSize;
+
+	// meshCount + materialCount + 1 uint32 offsets into the string data, mesh
+	// paths first, then material names. String i spans offsets i to i + 1.
+	uint64_t stringOffsetsOffset;
+	uint64_t stringDataOffset;
+
+	// objectCount column major mat4.
+	uint64_t transformsOffset;
+	// objectCount uint32 each.
+	uint64_t meshIndicesOffset;
+	uint64_t materialIndicesOffset;
+	uint64_t flagsOffset;
+};
+
+static_assert(sizeof(SceneFileHeader) == 72, "scene file header layout changed");
+
+constexpr uint32_t sceneFileVersion = 1;
+
+// In memory form of a scene file, for writing.
+struct SceneDesc
+{
+	// OBJ paths relative to the asset root.
+	std::vector<std::string> meshPaths;
+	std::vector<std::string> materialNames;
+
+	std::vector<glm::mat4> transforms;
+	std::vector<uint32_t> meshIndices;
+	std::vector<uint32_t> materialIndices;
+	std::vector<uint32_t> flags;
+};
+
+bool writeSceneFile(const char* path, const SceneDesc& desc);
+
+// Read only view of a mapped scene file. open() validates the file once and
+// points the arrays into the mapping, after that no per object work is left.
+class SceneFile
+{
+	MappedFile file;
+	const SceneFileHeader* header = nullptr;
+	const uint32_t* stringOffsets = nullptr;
+	const char* stringData = nullptr;
+
+public:
+	const glm::mat4* transforms = nullptr;
+	const uint32_t* meshIndices = nullptr;
+	const uint32_t* materialIndices = nullptr;
+	const uint32_t* flags = nullptr;
+
+	// Fails quietly for missing files, malformed ones are reported.
+	bool open(const char* path);
+	void close();
+
+	uint32_t getObjectCount() const { return header ? header->objectCount : 0; }
+	uint32_t getMeshCount() const { return header ? header->meshCount : 0; }
+	uint32_t getMaterialCount() const { return header ? header->materialCount : 0; }
+
+	std::string getMeshPath(uint32_t mesh) const;
+	std::string getMaterialName(uint32_t material) const;
+};
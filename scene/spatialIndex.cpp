@@ -0,0 +1,235 @@
+#include "spatialIndex.h"
+#include "../vulkan/vkMesh.h"
+
+static constexpr uint32_t minRebuildThreshold = 64;
+
+uint32_t SpatialIndex::primOf(RenderableHandle handle) const
+{
+	uint32_t slot = handle.index();
+	if (slot >= primOfSlot.size())
+		return BVH::invalidIndex;
+
+	uint32_t prim = primOfSlot[slot];
+	if (prim == BVH::invalidIndex || primHandles[prim] != handle)
+		return BVH::invalidIndex;
+
+	return prim;
+}
+
+void SpatialIndex::build(const RenderScene& scene)
+{
+	const uint32_t count = scene.size();
+
+	primHandles.assign(scene.handles.begin(), scene.handles.end());
+	primBounds.assign(scene.bounds.begin(), scene.bounds.end());
+
+	primOfSlot.assign(primOfSlot.size(), BVH::invalidIndex);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t slot = primHandles[i].index();
+		if (slot >= primOfSlot.size())
+			primOfSlot.resize(slot + 1, BVH::invalidIndex);
+		primOfSlot[slot] = i;
+	}
+
+	bvh.build(primBounds.data(), count);
+	bvh.computeLeaves(leafOf);
+
+	pending.clear();
+	movedPrims.clear();
+	removedCount = 0;
+}
+
+void SpatialIndex::insert(RenderableHandle handle)
+{
+	pending.push_back(handle);
+}
+
+void SpatialIndex::remove(RenderableHandle handle)
+{
+	uint32_t prim = primOf(handle);
+	if (prim != BVH::invalidIndex)
+	{
+		primOfSlot[handle.index()] = BVH::invalidIndex;
+		primHandles[prim] = RenderableHandle();
+		removedCount++;
+		return;
+	}
+
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		if (pending[i] == handle)
+		{
+			pending[i] = pending.back();
+			pending.pop_back();
+			return;
+		}
+	}
+}
+
+void SpatialIndex::update(RenderableHandle handle)
+{
+	uint32_t prim = primOf(handle);
+	if (prim != BVH::invalidIndex)
+		movedPrims.push_back(prim);
+}
+
+void SpatialIndex::commit(const RenderScene& scene)
+{
+	uint32_t stale = static_cast<uint32_t>(pending.size()) + removedCount;
+	if (stale > minRebuildThreshold && stale > primHandles.size() / 4)
+	{
+		build(scene);
+		return;
+	}
+
+	if (movedPrims.empty())
+		return;
+
+	for (uint32_t prim : movedPrims)
+	{
+		RenderableHandle handle = primHandles[prim];
+		if (scene.contains(handle))
+			primBounds[prim] = scene.bounds[scene.indexOf(handle)];
+	}
+
+	if (movedPrims.size() > primHandles.size() / 4)
+	{
+		bvh.refit(primBounds.data());
+	}
+	else
+	{
+		for (uint32_t prim : movedPrims)
+			dirtyNodes.push_back(leafOf[prim]);
+
+		bvh.refitNodes(primBounds.data(), dirtyNodes);
+	}
+
+	movedPrims.clear();
+}
+
+void SpatialIndex::queryFrustum(const RenderScene& scene, const Frustum& frustum, std::vector<uint32_t>& results) const
+{
+	auto visit = [&](uint32_t prim) {
+		RenderableHandle handle = primHandles[prim];
+		if (!handle.isValid())
+			return;
+
+		uint32_t index = scene.indexOf(handle);
+		if ((scene.flags[index] & RENDER_VISIBLE) && frustum.intersects(scene.bounds[index]))
+			results.push_back(index);
+	};
+
+	if (!bvh.isEmpty())
+	{
+		// Subtrees fully inside the frustum are emitted without further plane tests.
+		uint32_t stack[BVH::stackSize];
+		uint32_t top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			uint32_t nodeIndex = stack[--top];
+			const BVHNode& node = bvh.nodes[nodeIndex];
+
+			FrustumTest test = frustum.classify(node.bounds);
+			if (test == FRUSTUM_OUTSIDE)
+				continue;
+
+			if (test == FRUSTUM_INSIDE)
+			{
+				bvh.query([](const AABB&) { return true; }, [&](uint32_t prim) {
+					RenderableHandle handle = primHandles[prim];
+					if (handle.isValid() && (scene.flags[scene.indexOf(handle)] & RENDER_VISIBLE))
+						results.push_back(scene.indexOf(handle));
+				}, nodeIndex);
+			}
+			else if (node.isLeaf())
+			{
+				for (uint32_t i = 0; i < node.count; i++)
+					visit(bvh.primitives[node.leftFirst + i]);
+			}
+			else
+			{
+				stack[top++] = node.leftFirst + 1;
+				stack[top++] = node.leftFirst;
+			}
+		}
+	}
+
+	for (RenderableHandle handle : pending)
+	{
+		uint32_t index = scene.indexOf(handle);
+		if ((scene.flags[index] & RENDER_VISIBLE) && frustum.intersects(scene.bounds[index]))
+			results.push_back(index);
+	}
+}
+
+void SpatialIndex::querySphere(const RenderScene& scene, glm::vec3 center, float radius, std::vector<uint32_t>& results) const
+{
+	bvh.query([&](const AABB& box) { return intersectSphereAABB(box, center, radius); }, [&](uint32_t prim) {
+		RenderableHandle handle = primHandles[prim];
+		if (!handle.isValid())
+			return;
+
+		uint32_t index = scene.indexOf(handle);
+		if (intersectSphereAABB(scene.bounds[index], center, radius))
+			results.push_back(index);
+	});
+
+	for (RenderableHandle handle : pending)
+	{
+		uint32_t index = scene.indexOf(handle);
+		if (intersectSphereAABB(scene.bounds[index], center, radius))
+			results.push_back(index);
+	}
+}
+
+bool SpatialIndex::raycast(const RenderScene& scene, const Ray& ray, RaycastHit& hit, const HandlePool<Mesh>* meshes) const
+{
+	glm::vec3 invDir = 1.f / ray.direction;
+
+	auto intersect = [&](RenderableHandle handle, float tMax) {
+		uint32_t index = scene.indexOf(handle);
+		float t = intersectRayAABB(scene.bounds[index], ray.origin, invDir, tMax);
+		if (t == FLT_MAX || !meshes)
+			return t;
+
+		const Mesh* mesh = meshes->get(scene.meshIds[index]);
+		if (!mesh || mesh->bvh.isEmpty())
+			return t;
+
+		// Directions are not normalized after the transform, so the parametric
+		// distance along the object space ray matches the world space one.
+		glm::mat4 toLocal = glm::inverse(scene.transforms[index]);
+		Ray localRay;
+		localRay.origin = glm::vec3(toLocal * glm::vec4(ray.origin, 1.f));
+		localRay.direction = glm::vec3(toLocal * glm::vec4(ray.direction, 0.f));
+		localRay.tMax = tMax;
+		return mesh->raycast(localRay);
+	};
+
+	float closest = bvh.raycast(ray, [&](uint32_t prim, float tMax) {
+		RenderableHandle handle = primHandles[prim];
+		if (!handle.isValid())
+			return FLT_MAX;
+
+		float t = intersect(handle, tMax);
+		if (t < tMax)
+			hit.object = handle;
+		return t;
+	});
+
+	for (RenderableHandle handle : pending)
+	{
+		float t = intersect(handle, glm::min(closest, ray.tMax));
+		if (t < closest)
+		{
+			closest = t;
+			hit.object = handle;
+		}
+	}
+
+	hit.distance = closest;
+	return closest != FLT_MAX;
+}
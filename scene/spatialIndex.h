@@ -0,0 +1,46 @@
+#pragma once
+#include "bvh.h"
+#include "renderScene.h"
+
+struct RaycastHit
+{
+	RenderableHandle object;
+	float distance = FLT_MAX;
+};
+
+// BVH over the renderables of a RenderScene. Moving objects are refit in
+// place, objects added since the last build are kept in a small list that is
+// tested linearly, and the tree is rebuilt with SAH once enough of it is stale.
+// Query results are dense scene indices, like RenderScene::cull().
+class SpatialIndex
+{
+	BVH bvh;
+	std::vector<RenderableHandle> primHandles;
+	std::vector<AABB> primBounds;
+	std::vector<uint32_t> leafOf;
+	std::vector<uint32_t> primOfSlot;
+
+	std::vector<RenderableHandle> pending;
+	std::vector<uint32_t> movedPrims;
+	std::vector<uint32_t> dirtyNodes;
+	uint32_t removedCount = 0;
+
+	uint32_t primOf(RenderableHandle handle) const;
+
+public:
+	void build(const RenderScene& scene);
+
+	void insert(RenderableHandle handle);
+	void remove(RenderableHandle handle);
+	void update(RenderableHandle handle);
+
+	// Applies pending changes, must be called before querying.
+	void commit(const RenderScene& scene);
+
+	void queryFrustum(const RenderScene& scene, const Frustum& frustum, std::vector<uint32_t>& results) const;
+	void querySphere(const RenderScene& scene, glm::vec3 center, float radius, std::vector<uint32_t>& results) const;
+
+	// Closest hit against object bounds. With meshes given, objects whose mesh
+	// has a triangle BVH are tested against their triangles instead.
+	bool raycast(const RenderScene& scene, const Ray& ray, RaycastHit& hit, const HandlePool<Mesh>* meshes = nullptr) const;
+};
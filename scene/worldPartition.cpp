@@ -0,0 +1,230 @@
+#include "worldPartition.h"
+#include "../vulkan/vkEngine.h"
+#include <algorithm>
+#include <cmath>
+
+uint64_t WorldPartition::cellKey(int32_t x, int32_t z)
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+}
+
+void WorldPartition::cellCoords(uint64_t key, int32_t& x, int32_t& z)
+{
+	x = static_cast<int32_t>(static_cast<uint32_t>(key >> 32));
+	z = static_cast<int32_t>(static_cast<uint32_t>(key));
+}
+
+float WorldPartition::cellDistance(int32_t x, int32_t z, const glm::vec3& center) const
+{
+	float minX = x * cellSize;
+	float minZ = z * cellSize;
+
+	float dx = std::max(std::max(minX - center.x, center.x - (minX + cellSize)), 0.f);
+	float dz = std::max(std::max(minZ - center.z, center.z - (minZ + cellSize)), 0.f);
+	return std::sqrt(dx * dx + dz * dz);
+}
+
+void WorldPartition::init(VulkanEngine* engine, JobSystem* jobs, const std::string& root)
+{
+	this->engine = engine;
+	this->jobs = jobs;
+	this->root = root;
+
+	if (!this->root.empty() && this->root.back() != '/' && this->root.back() != '\\')
+		this->root += '/';
+}
+
+void WorldPartition::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		requests.clear();
+	}
+
+	jobs->wait(loadCounter);
+	results.clear();
+
+	while (!cells.empty())
+		unloadCell(cells.begin()->first);
+	insertQueue.clear();
+}
+
+// Same scheme as asset loads, every request has one job and jobs take
+// whichever request is next.
+void WorldPartition::loadNext()
+{
+	LoadRequest request;
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		if (requests.empty())
+			return;
+
+		request = std::move(requests.front());
+		requests.pop_front();
+	}
+
+	LoadResult result;
+	result.cell = request.cell;
+	result.serial = request.serial;
+
+	result.file = std::make_unique<SceneFile>();
+	if (!result.file->open(request.path.c_str()))
+		result.file.reset();
+
+	std::lock_guard<std::mutex> lock(resultMutex);
+	results.push_back(std::move(result));
+}
+
+void WorldPartition::applyResults()
+{
+	{
+		std::lock_guard<std::mutex> lock(resultMutex);
+		if (results.empty())
+			return;
+
+		std::swap(results, resultScratch);
+	}
+
+	for (LoadResult& result : resultScratch)
+	{
+		// Unloaded, or unloaded and requested again, while the job ran.
+		auto it = cells.find(result.cell);
+		if (it == cells.end() || it->second.serial != result.serial || it->second.state != CELL_LOADING)
+			continue;
+
+		WorldCell& cell = it->second;
+		cell.state = CELL_LOADED;
+
+		if (!result.file || result.file->getObjectCount() == 0)
+			continue;
+
+		SceneFile& file = *result.file;
+		for (uint32_t i = 0; i < file.getMeshCount(); i++)
+		{
+			std::string path = file.getMeshPath(i);
+			AssetID id = assetID(path);
+			engine->assets.loadMesh(id, path);
+			cell.meshes.push_back(id);
+		}
+
+		for (uint32_t i = 0; i < file.getMaterialCount(); i++)
+			cell.materials.push_back(engine->getMaterial(assetID(file.getMaterialName(i))));
+
+		cell.file = std::move(result.file);
+		insertQueue.push_back(result.cell);
+	}
+
+	resultScratch.clear();
+}
+
+void WorldPartition::insertObjects()
+{
+	uint32_t budget = maxInsertionsPerUpdate;
+
+	size_t finished = 0;
+	for (; finished < insertQueue.size() && budget > 0; finished++)
+	{
+		// A cell requested again after an unload can be back under the same
+		// key, still loading.
+		auto it = cells.find(insertQueue[finished]);
+		if (it == cells.end() || it->second.state != CELL_LOADED || !it->second.file)
+			continue;
+
+		WorldCell& cell = it->second;
+		const SceneFile& file = *cell.file;
+		uint32_t end = std::min(file.getObjectCount(), cell.nextObject + budget);
+		budget -= end - cell.nextObject;
+
+		for (uint32_t i = cell.nextObject; i < end; i++)
+		{
+			MeshHandle mesh = engine->assets.getMesh(cell.meshes[file.meshIndices[i]]);
+			MaterialHandle material = cell.materials[file.materialIndices[i]];
+
+			RenderableHandle handle = engine->addRenderable(mesh, material, file.transforms[i], file.flags[i]);
+			if (handle.isValid())
+				cell.renderables.push_back(handle);
+		}
+		cell.nextObject = end;
+
+		if (cell.nextObject < file.getObjectCount())
+			break;
+
+		cell.file.reset();
+	}
+
+	insertQueue.erase(insertQueue.begin(), insertQueue.begin() + finished);
+}
+
+void WorldPartition::unloadCell(uint64_t key)
+{
+	auto it = cells.find(key);
+	if (it == cells.end())
+		return;
+
+	WorldCell& cell = it->second;
+
+	// Renderables go first, the meshes are unloaded when their last
+	// reference is released.
+	for (RenderableHandle handle : cell.renderables)
+		engine->removeRenderable(handle);
+
+	for (AssetID mesh : cell.meshes)
+		engine->assets.release(mesh);
+
+	insertQueue.erase(std::remove(insertQueue.begin(), insertQueue.end(), key), insertQueue.end());
+	cells.erase(it);
+}
+
+void WorldPartition::update(const glm::vec3& center)
+{
+	applyResults();
+
+	unloadScratch.clear();
+	for (auto& entry : cells)
+	{
+		int32_t x, z;
+		cellCoords(entry.first, x, z);
+		if (cellDistance(x, z, center) > unloadRadius)
+			unloadScratch.push_back(entry.first);
+	}
+
+	for (uint64_t key : unloadScratch)
+		unloadCell(key);
+
+	int32_t minX = static_cast<int32_t>(std::floor((center.x - loadRadius) / cellSize));
+	int32_t maxX = static_cast<int32_t>(std::floor((center.x + loadRadius) / cellSize));
+	int32_t minZ = static_cast<int32_t>(std::floor((center.z - loadRadius) / cellSize));
+	int32_t maxZ = static_cast<int32_t>(std::floor((center.z + loadRadius) / cellSize));
+
+	loadScratch.clear();
+	for (int32_t z = minZ; z <= maxZ; z++)
+	{
+		for (int32_t x = minX; x <= maxX; x++)
+		{
+			float distance = cellDistance(x, z, center);
+			if (distance <= loadRadius && cells.find(cellKey(x, z)) == cells.end())
+				loadScratch.push_back({ distance, cellKey(x, z) });
+		}
+	}
+
+	// Nearest cells first, they are the ones likely to be seen soon.
+	std::sort(loadScratch.begin(), loadScratch.end());
+
+	for (const std::pair<float, uint64_t>& entry : loadScratch)
+	{
+		int32_t x, z;
+		cellCoords(entry.second, x, z);
+
+		WorldCell& cell = cells[entry.second];
+		cell.serial = ++nextSerial;
+
+		std::string path = root + "cell_" + std::to_string(x) + "_" + std::to_string(z) + ".scene";
+		{
+			std::lock_guard<std::mutex> lock(requestMutex);
+			requests.push_back({ entry.second, cell.serial, std::move(path) });
+		}
+		jobs->run([this] { loadNext(); }, &loadCounter);
+	}
+
+	insertObjects();
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "renderScene.h"
+#include "sceneFile.h"
+#include "../asset/assetID.h"
+#include "../core/jobSystem.h"
+#include "glm/glm.hpp"
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class VulkanEngine;
+
+enum CellState : uint8_t
+{
+	CELL_LOADING,
+	CELL_LOADED
+};
+
+struct WorldCell
+{
+	CellState state = CELL_LOADING;
+	uint32_t serial = 0;
+
+	// Kept mapped until every object is in the scene.
+	std::unique_ptr<SceneFile> file;
+	std::vector<AssetID> meshes;
+	std::vector<MaterialHandle> materials;
+	// Objects before this one are in the scene.
+	uint32_t nextObject = 0;
+	std::vector<RenderableHandle> renderables;
+};
+
+// Splits the world into square cells on the xz plane, each stored in its own
+// scene file named cell_<x>_<z>.scene. Cells within loadRadius of the streaming
+// center are read as jobs, cells past unloadRadius are removed again; the gap
+// between the two keeps cells on a border from loading and unloading every
+// frame. Meshes go through the asset manager, so cells sharing a mesh share
+// one copy. Missing cell files are empty cells.
+class WorldPartition
+{
+	struct LoadRequest
+	{
+		uint64_t cell;
+		uint32_t serial;
+		std::string path;
+	};
+
+	struct LoadResult
+	{
+		uint64_t cell;
+		uint32_t serial;
+		// Null for cells without a file.
+		std::unique_ptr<SceneFile> file;
+	};
+
+	VulkanEngine* engine;
+	std::string root;
+
+	std::unordered_map<uint64_t, WorldCell> cells;
+	// Loaded cells with objects left to insert, oldest first.
+	std::vector<uint64_t> insertQueue;
+	uint32_t nextSerial = 0;
+
+	JobSystem* jobs;
+	JobCounter loadCounter;
+	std::mutex requestMutex;
+	std::deque<LoadRequest> requests;
+
+	std::mutex resultMutex;
+	std::vector<LoadResult> results;
+	std::vector<LoadResult> resultScratch;
+
+	std::vector<uint64_t> unloadScratch;
+	std::vector<std::pair<float, uint64_t>> loadScratch;
+
+	static uint64_t cellKey(int32_t x, int32_t z);
+	static void cellCoords(uint64_t key, int32_t& x, int32_t& z);
+
+	// Distance on the xz plane from center to the closest point of the cell.
+	float cellDistance(int32_t x, int32_t z, const glm::vec3& center) const;
+
+	void loadNext();
+	void applyResults();
+	void insertObjects();
+	void unloadCell(uint64_t key);
+
+public:
+	float cellSize = 64.f;
+	float loadRadius = 192.f;
+	float unloadRadius = 256.f;
+
+	// Renderables added per update at most, spreading large cells over
+	// several frames.
+	uint32_t maxInsertionsPerUpdate = 4096;
+
+	// Cell files are looked up in root, usually relative to the asset root.
+	void init(VulkanEngine* engine, JobSystem* jobs, const std::string& root);
+	void cleanup();
+
+	// Streams cells around center, call once per frame before the asset
+	// manager's update.
+	void update(const glm::vec3& center);
+
+	uint32_t getLoadedCellCount() const { return static_cast<uint32_t>(cells.size()); }
+};
@@ -0,0 +1,38 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+#define MAX_VIEWS 4
+
+layout(location = 0) in vec3 vPosition;
+layout(location = 1) in vec3 vNormal;
+layout(location = 2) in vec3 vColor;
+
+layout (location = 0) out vec3 outColor;
+
+// Padded to the engine's camera stride of 256 bytes.
+struct CameraData
+{
+	mat4 view;
+	mat4 proj;
+	mat4 viewproj;
+	mat4 pad;
+};
+
+// One camera per layer of the offscreen target.
+layout (set = 0, binding = 0) uniform CameraBuffer
+{
+	CameraData cameras[MAX_VIEWS];
+} cameraData;
+
+layout(push_constant) uniform constants
+{
+	vec4 data;
+	mat4 renderMatrix;
+} PushConstants;
+
+void main()
+{
+	mat4 transformMatrix = (cameraData.cameras[gl_ViewIndex].viewproj * PushConstants.renderMatrix);
+	gl_Position = transformMatrix * vec4(vPosition, 1.f);
+	outColor = vColor;
+}
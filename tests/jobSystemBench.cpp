@@ -0,0 +1,181 @@
+// Job system dispatch cost at 1, 2, 4 ... N workers, and checks for jobs held
+// back by a dependency and for jobs queued to the main thread. Standalone,
+// build from the repository root:
+//   c++ -std=c++17 -O2 tests/jobSystemBench.cpp core/jobSystem.cpp -lpthread
+// Exits with 1 if any check fails.
+#include "../core/jobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+static uint32_t failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+// More than one thread's job pool holds, the rest take the overflow path.
+static constexpr uint32_t parkedJobs = 10000;
+
+// Runs a job that blocks until open is set, jobs depending on gate are held
+// back until then.
+static void closeGate(JobSystem& jobs, JobCounter& gate, std::atomic<bool>& open)
+{
+	auto* flag = &open;
+	jobs.run([flag] {
+		while (!flag->load(std::memory_order_acquire))
+			std::this_thread::yield();
+	}, &gate);
+}
+
+static void testDependencies(JobSystem& jobs)
+{
+	std::atomic<bool> open{ false };
+	std::atomic<uint32_t> ran{ 0 };
+	JobCounter gate;
+	JobCounter done;
+	closeGate(jobs, gate, open);
+
+	auto* counter = &ran;
+	for (uint32_t i = 0; i < parkedJobs; i++)
+		jobs.run([counter] { counter->fetch_add(1, std::memory_order_relaxed); }, &done, &gate);
+
+	// Give the workers time to run anything that was let through early.
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	check(ran.load() == 0, "jobs wait for an unfinished dependency");
+	check(done.count.load() == parkedJobs, "parked jobs are counted");
+
+	open.store(true, std::memory_order_release);
+	jobs.wait(done);
+	check(ran.load() == parkedJobs, "every parked job runs once the dependency is done");
+	check(gate.isDone(), "dependency is done");
+
+	// A dependency that is already done doesn't hold anything back.
+	JobCounter again;
+	jobs.run([counter] { counter->fetch_add(1, std::memory_order_relaxed); }, &again, &gate);
+	jobs.wait(again);
+	check(ran.load() == parkedJobs + 1, "job with a finished dependency runs");
+
+	// Chains see the side effects of the job they depend on.
+	uint32_t value = 0;
+	auto* target = &value;
+	JobCounter first;
+	JobCounter second;
+	jobs.run([target] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		*target = 1;
+	}, &first);
+	jobs.run([target] { *target = *target == 1 ? 2 : 0; }, &second, &first);
+	jobs.wait(second);
+	check(value == 2, "dependent job runs after the job it depends on");
+}
+
+// Counts where the jobs queued with runOnMainThread() ran.
+struct MainThreadProbe
+{
+	std::thread::id mainThread = std::this_thread::get_id();
+	std::atomic<uint32_t> onMain{ 0 };
+	std::atomic<uint32_t> elsewhere{ 0 };
+
+	void record()
+	{
+		if (std::this_thread::get_id() == mainThread)
+			onMain.fetch_add(1);
+		else
+			elsewhere.fetch_add(1);
+	}
+};
+
+static void testMainThread(JobSystem& jobs)
+{
+	MainThreadProbe probe;
+	auto* target = &probe;
+
+	JobCounter counter;
+	for (uint32_t i = 0; i < 16; i++)
+		jobs.runOnMainThread([target] { target->record(); }, &counter);
+	check(probe.onMain.load() == 0 && !counter.isDone(), "main thread jobs wait for runMainThreadJobs()");
+
+	jobs.runMainThreadJobs();
+	check(counter.isDone(), "runMainThreadJobs() drains the queue");
+	check(probe.onMain.load() == 16, "main thread jobs run on the main thread");
+
+	// Queued from workers, drained by the main thread waiting on them.
+	JobCounter queued;
+	JobCounter spawned;
+	JobSystem* system = &jobs;
+	JobCounter* queuedCounter = &queued;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		jobs.run([system, queuedCounter, target] {
+			system->runOnMainThread([target] { target->record(); }, queuedCounter);
+		}, &spawned);
+	}
+	jobs.wait(spawned);
+	jobs.wait(queued);
+	check(probe.onMain.load() == 32, "jobs queued from workers run on the main thread");
+	check(probe.elsewhere.load() == 0, "no main thread job ran on a worker");
+}
+
+static double nanosecondsSince(std::chrono::steady_clock::time_point start, uint32_t count)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+static void benchmark(uint32_t workerCount)
+{
+	const uint32_t jobCount = 200000;
+	const uint32_t rounds = 5;
+
+	JobSystem jobs;
+	jobs.init(workerCount);
+
+	double runBest = 1e30;
+	double forBest = 1e30;
+	for (uint32_t round = 0; round < rounds; round++)
+	{
+		JobCounter counter;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < jobCount; i++)
+			jobs.run([] {}, &counter);
+		jobs.wait(counter);
+		runBest = std::min(runBest, nanosecondsSince(start, jobCount));
+
+		std::atomic<uint32_t> batches{ 0 };
+		start = std::chrono::steady_clock::now();
+		jobs.parallelFor(jobCount, 1, [&batches](uint32_t, uint32_t) { batches.fetch_add(1, std::memory_order_relaxed); });
+		forBest = std::min(forBest, nanosecondsSince(start, jobCount));
+		check(batches.load() == jobCount, "parallelFor runs every batch");
+	}
+
+	testDependencies(jobs);
+	testMainThread(jobs);
+	jobs.cleanup();
+
+	std::cout << workerCount << (workerCount == 1 ? " worker" : " workers") << ", nanoseconds per empty job: run/wait "
+		<< runBest << ", parallelFor " << forBest << std::endl;
+}
+
+int main()
+{
+	uint32_t hardwareThreads = std::thread::hardware_concurrency();
+	uint32_t maxWorkers = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+
+	for (uint32_t workers = 1; workers < maxWorkers; workers *= 2)
+		benchmark(workers);
+	benchmark(maxWorkers);
+
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Job system checks passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,278 @@
+// Golden output test and benchmark for the software mixer. Standalone, build
+// from the repository root against the same OpenAL Soft, SDL2 and libsndfile
+// as the engine, once as is and once with -mavx to cover both kernels:
+//   c++ -std=c++17 -O2 tests/mixerTest.cpp audio/audio.cpp audio/mixer.cpp audio/soundCache.cpp
+//       audio/stream.cpp audio/voiceManager.cpp -lopenal -lSDL2 -lsndfile -lpthread
+//   ./a.out [tests/mixerTest.golden] [--update]
+// --update rewrites the golden file after an intended change to the mix.
+// Exits with 1 if any check fails.
+#include "../audio/audio.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Odd sizes, so every kernel ends in its scalar tail.
+static constexpr uint32_t blockFrames = 509;
+static constexpr uint32_t blockCount = 4;
+static constexpr uint32_t goldenFrames = blockFrames * blockCount;
+// The stored buffer may come from another compiler or libm.
+static constexpr float goldenTolerance = 1e-5f;
+
+static uint32_t failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+// Fixed sounds: a sine, a saw, noise and a click shorter than a block.
+static std::vector<std::vector<float>> makeSounds()
+{
+	std::vector<std::vector<float>> sounds(4);
+
+	sounds[0].resize(1201);
+	for (size_t i = 0; i < sounds[0].size(); i++)
+		sounds[0][i] = std::sin(static_cast<float>(i) * 0.0575f);
+
+	sounds[1].resize(777);
+	for (size_t i = 0; i < sounds[1].size(); i++)
+		sounds[1][i] = static_cast<float>(i % 97) / 48.5f - 1.f;
+
+	uint32_t seed = 12345;
+	sounds[2].resize(3001);
+	for (float& sample : sounds[2])
+	{
+		seed = seed * 1664525u + 1013904223u;
+		sample = static_cast<float>(seed >> 8) / 8388608.f - 1.f;
+	}
+
+	sounds[3] = { 1.f, -1.f, 0.5f, -0.5f, 0.25f, -0.25f, 0.125f };
+	return sounds;
+}
+
+struct VoiceSetup
+{
+	uint32_t sound;
+	glm::vec3 pos;
+	float gain;
+	bool looping;
+};
+
+// Voices around, behind, on top of and out of range of the listener.
+static std::vector<VoiceSetup> makeVoices(uint32_t count)
+{
+	std::vector<VoiceSetup> voices;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float angle = static_cast<float>(i) * 0.7f;
+		float distance = static_cast<float>(i % 9) * 17.f;
+		VoiceSetup voice;
+		voice.sound = i % 4;
+		voice.pos = glm::vec3(std::cos(angle) * distance, static_cast<float>(i % 3) - 1.f, std::sin(angle) * distance);
+		voice.gain = 0.25f + static_cast<float>(i % 5) * 0.1f;
+		voice.looping = i % 3 != 0;
+		voices.push_back(voice);
+	}
+	return voices;
+}
+
+static void addVoices(Mixer& mixer, const std::vector<std::vector<float>>& sounds, const std::vector<VoiceSetup>& voices)
+{
+	std::vector<MixSoundID> ids;
+	for (const std::vector<float>& samples : sounds)
+		ids.push_back(mixer.addSound(std::vector<float>(samples)));
+
+	// One voice is removed again, its slot is reused by the last one.
+	MixVoiceID removed = mixer.addVoice(ids[0]);
+	mixer.removeVoice(removed);
+
+	for (const VoiceSetup& setup : voices)
+	{
+		MixVoiceID id = mixer.addVoice(ids[setup.sound]);
+		mixer.setPos(id, setup.pos);
+		mixer.setGain(id, setup.gain);
+		mixer.setLooping(id, setup.looping);
+		mixer.play(id);
+	}
+
+	mixer.setListener(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+}
+
+// The mix written out one sample at a time, in the order the kernels promise
+// to keep.
+static std::vector<float> referenceMix(const std::vector<std::vector<float>>& sounds, const std::vector<VoiceSetup>& voices, uint32_t frames)
+{
+	std::vector<float> out(static_cast<size_t>(frames) * 2, 0.f);
+	glm::vec3 listenerRight = glm::vec3(1.f, 0.f, 0.f);
+
+	for (uint32_t block = 0; block * blockFrames < frames; block++)
+	{
+		float* dst = out.data() + static_cast<size_t>(block) * blockFrames * 2;
+		for (size_t v = 0; v < voices.size(); v++)
+		{
+			const VoiceSetup& voice = voices[v];
+			const std::vector<float>& samples = sounds[voice.sound];
+
+			float distance = glm::length(voice.pos);
+			float clamped = std::min(std::max(distance, 1.f), 100.f);
+			float gain = voice.gain * 1.f / std::max(clamped, 0.0001f);
+			float pan = distance > 0.0001f ? glm::dot(voice.pos / distance, listenerRight) : 0.f;
+			float angle = (pan + 1.f) * 0.25f * 3.14159265f;
+			float left = std::cos(angle) * gain;
+			float right = std::sin(angle) * gain;
+
+			for (uint32_t i = 0; i < blockFrames; i++)
+			{
+				size_t frame = static_cast<size_t>(block) * blockFrames + i;
+				if (!voice.looping && frame >= samples.size())
+					break;
+
+				float sample = samples[frame % samples.size()];
+				dst[i * 2] += sample * left;
+				dst[i * 2 + 1] += sample * right;
+			}
+		}
+	}
+	return out;
+}
+
+template<typename Render>
+static std::vector<float> renderBlocks(Render&& render)
+{
+	std::vector<float> out(static_cast<size_t>(goldenFrames) * 2, 0.f);
+	for (uint32_t block = 0; block < blockCount; block++)
+		render(out.data() + static_cast<size_t>(block) * blockFrames * 2, blockFrames);
+	return out;
+}
+
+static float maxDifference(const std::vector<float>& a, const std::vector<float>& b)
+{
+	float difference = 0.f;
+	for (size_t i = 0; i < a.size(); i++)
+		difference = std::max(difference, std::abs(a[i] - b[i]));
+	return difference;
+}
+
+static void testGolden(const std::string& goldenPath, bool update)
+{
+	std::vector<std::vector<float>> sounds = makeSounds();
+	std::vector<VoiceSetup> voices = makeVoices(64);
+
+	Mixer mixer;
+	mixer.init(48000);
+	addVoices(mixer, sounds, voices);
+	std::vector<float> mixed = renderBlocks([&](float* out, uint32_t frames) { mixer.mix(out, frames); });
+	mixer.cleanup();
+
+	std::vector<float> reference = referenceMix(sounds, voices, goldenFrames);
+	check(memcmp(mixed.data(), reference.data(), mixed.size() * sizeof(float)) == 0, "SIMD mix is bit identical to the scalar reference");
+
+	// Same voices again, the mix must not change between runs.
+	mixer.init(48000);
+	addVoices(mixer, sounds, voices);
+	std::vector<float> again = renderBlocks([&](float* out, uint32_t frames) { mixer.mix(out, frames); });
+	mixer.cleanup();
+	check(memcmp(mixed.data(), again.data(), mixed.size() * sizeof(float)) == 0, "mixing is deterministic");
+
+	if (update)
+	{
+		std::ofstream file(goldenPath, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(mixed.data()), mixed.size() * sizeof(float));
+		check(file.good(), "write golden file");
+		std::cout << "Wrote " << goldenPath << std::endl;
+		return;
+	}
+
+	std::vector<float> golden(mixed.size());
+	std::ifstream file(goldenPath, std::ios::binary);
+	file.read(reinterpret_cast<char*>(golden.data()), golden.size() * sizeof(float));
+	if (!file || file.peek() != EOF)
+	{
+		check(false, "read golden file of the expected size");
+		return;
+	}
+
+	float difference = maxDifference(mixed, golden);
+	if (difference > goldenTolerance)
+		std::cout << "Largest difference to the golden output: " << difference << std::endl;
+	check(difference <= goldenTolerance, "mix matches the golden output");
+
+	// OpenAL renders silence through the null output, what comes out of
+	// render() is the mixer's voices alone.
+	Audio audio;
+	audio.init(AUDIO_OUTPUT_NULL);
+	if (audio.getOutput() == AUDIO_OUTPUT_NULL)
+	{
+		addVoices(audio.getMixer(), sounds, voices);
+		std::vector<float> rendered = renderBlocks([&](float* out, uint32_t frames) { audio.render(out, frames); });
+		check(maxDifference(rendered, golden) <= goldenTolerance, "null output renders the golden output");
+	}
+	else
+	{
+		std::cout << "ALC_SOFT_loopback not available, null output not tested" << std::endl;
+	}
+	audio.cleanup();
+}
+
+static void benchmarkVoices()
+{
+	const uint32_t voiceCount = 1024;
+	const uint32_t frames = 480;
+	const uint32_t blocks = 200;
+
+	Mixer mixer;
+	mixer.init(48000);
+	std::vector<VoiceSetup> voices = makeVoices(voiceCount);
+	for (VoiceSetup& voice : voices)
+		voice.looping = true;
+	addVoices(mixer, makeSounds(), voices);
+
+	std::vector<float> out(frames * 2);
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t block = 0; block < blocks; block++)
+	{
+		std::fill(out.begin(), out.end(), 0.f);
+		mixer.mix(out.data(), frames);
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	// A voice here is one voice mixed for one 10 ms block.
+	std::cout << voiceCount << " voices, " << blocks << " blocks of " << frames << " frames: "
+		<< voiceCount * blocks / milliseconds << " voices per ms, "
+		<< mixer.getRealtimeVoices() << " voices in real time on one core" << std::endl;
+	mixer.cleanup();
+}
+
+int main(int argc, char** argv)
+{
+	std::string goldenPath = "tests/mixerTest.golden";
+	bool update = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--update") == 0)
+			update = true;
+		else
+			goldenPath = argv[i];
+	}
+
+	testGolden(goldenPath, update);
+	benchmarkVoices();
+
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Mixer tests passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,193 @@
+// OBJ parser throughput against tinyobjloader, the loader the engine used
+// before, on a generated mesh of n-gons with and without normals. Standalone,
+// build from the repository root with the same include paths as the engine:
+//   c++ -std=c++17 -O2 tests/objParserBench.cpp asset/objParser.cpp vulkan/vkMesh.cpp scene/bvh.cpp
+//       core/jobSystem.cpp core/mappedFile.cpp -lpthread
+//   ./a.out [file.obj]
+// Given a file, that file is measured instead of the generated ones. Exits
+// with 1 if the triangle or index counts differ from tinyobjloader's.
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader/tiny_obj_loader.h"
+#include "../asset/objParser.h"
+#include "../core/jobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+static const char* normalsPath = "objParserBench.obj";
+static const char* noNormalsPath = "objParserBench.nonormals.obj";
+static constexpr uint32_t faceCount = 200000;
+static constexpr uint32_t rounds = 3;
+
+static uint32_t failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+// Convex faces of 3 to 8 corners scattered through a cube, every corner with
+// its own position and, when asked for, a normal of the same index. Returns
+// the triangle count after fan triangulation.
+static uint64_t writeMesh(const char* path, bool normals)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return 0;
+
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> position(-500.f, 500.f);
+	std::uniform_real_distribution<float> direction(-1.f, 1.f);
+
+	uint64_t triangles = 0;
+	uint32_t written = 0;
+	for (uint32_t face = 0; face < faceCount; face++)
+	{
+		uint32_t corners = 3 + random() % 6;
+		glm::vec3 center(position(random), position(random), position(random));
+		glm::vec3 normal = glm::vec3(direction(random), direction(random), direction(random));
+		normal = glm::length(normal) > 0.01f ? glm::normalize(normal) : glm::vec3(0.f, 0.f, 1.f);
+		glm::vec3 tangent = glm::normalize(glm::cross(normal, std::abs(normal.y) < 0.9f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f)));
+		glm::vec3 bitangent = glm::cross(normal, tangent);
+
+		for (uint32_t i = 0; i < corners; i++)
+		{
+			float angle = static_cast<float>(i) / static_cast<float>(corners) * 6.2831853f;
+			glm::vec3 p = center + (tangent * std::cos(angle) + bitangent * std::sin(angle)) * 2.f;
+			fprintf(file, "v %.6f %.6f %.6f\n", p.x, p.y, p.z);
+			if (normals)
+				fprintf(file, "vn %.6f %.6f %.6f\n", normal.x, normal.y, normal.z);
+		}
+
+		fputc('f', file);
+		for (uint32_t i = 1; i <= corners; i++)
+		{
+			if (normals)
+				fprintf(file, " %u//%u", written + i, written + i);
+			else
+				fprintf(file, " %u", written + i);
+		}
+		fputc('\n', file);
+
+		written += corners;
+		triangles += corners - 2;
+	}
+
+	fclose(file);
+	return triangles;
+}
+
+static double fileMegabytes(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 0.0;
+	fseek(file, 0, SEEK_END);
+	double megabytes = static_cast<double>(ftell(file)) / (1024.0 * 1024.0);
+	fclose(file);
+	return megabytes;
+}
+
+// Best of a few rounds, the file stays in the page cache after the first.
+template<typename Load>
+static double bestSeconds(Load&& load)
+{
+	double best = 1e30;
+	for (uint32_t round = 0; round < rounds; round++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		load();
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+static void compare(const char* path, uint64_t expectedTriangles, JobSystem& jobs)
+{
+	double megabytes = fileMegabytes(path);
+	check(megabytes > 0.0, "read the OBJ file");
+
+	Mesh serial;
+	bool serialParsed = false;
+	double serialSeconds = bestSeconds([&] { serialParsed = parseOBJ(path, serial, nullptr); });
+	check(serialParsed, "parseOBJ without jobs");
+
+	Mesh parallel;
+	bool parallelParsed = false;
+	double parallelSeconds = bestSeconds([&] { parallelParsed = parseOBJ(path, parallel, &jobs); });
+	check(parallelParsed, "parseOBJ on jobs");
+	check(serial.indices == parallel.indices && serial.vertices.size() == parallel.vertices.size(), "parsing on jobs gives the same mesh");
+
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	bool tinyParsed = false;
+	double tinySeconds = bestSeconds([&] {
+		std::string warn;
+		std::string err;
+		attrib = tinyobj::attrib_t();
+		shapes.clear();
+		materials.clear();
+		tinyParsed = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path, nullptr, true);
+	});
+	check(tinyParsed, "tinyobj::LoadObj");
+
+	uint64_t tinyTriangles = 0;
+	uint64_t tinyIndices = 0;
+	for (const tinyobj::shape_t& shape : shapes)
+	{
+		tinyTriangles += shape.mesh.num_face_vertices.size();
+		tinyIndices += shape.mesh.indices.size();
+	}
+
+	uint64_t triangles = serial.indices.size() / 3;
+	check(serial.indices.size() % 3 == 0, "three indices per triangle");
+	check(triangles == tinyTriangles, "triangle count matches tinyobj");
+	check(serial.indices.size() == tinyIndices, "index count matches tinyobj");
+	if (expectedTriangles > 0)
+		check(triangles == expectedTriangles, "triangle count matches the generated faces");
+
+	std::cout << path << ", " << megabytes << " MB, " << triangles << " triangles, MB/s:" << std::endl
+		<< "  parseOBJ          " << megabytes / serialSeconds << std::endl
+		<< "  parseOBJ on jobs  " << megabytes / parallelSeconds << " (" << jobs.threadCount() << " threads)" << std::endl
+		<< "  tinyobj::LoadObj  " << megabytes / tinySeconds << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	JobSystem jobs;
+	jobs.init();
+
+	if (argc > 1)
+	{
+		compare(argv[1], 0, jobs);
+	}
+	else
+	{
+		uint64_t triangles = writeMesh(normalsPath, true);
+		compare(normalsPath, triangles, jobs);
+		triangles = writeMesh(noNormalsPath, false);
+		compare(noNormalsPath, triangles, jobs);
+		std::remove(normalsPath);
+		std::remove(noNormalsPath);
+	}
+
+	jobs.cleanup();
+
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "OBJ parser checks passed" << std::endl;
+	return 0;
+}
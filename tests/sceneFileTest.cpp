@@ -0,0 +1,210 @@
+// Round trip and load benchmark for scene files. Standalone, build from the
+// repository root with the same include paths as the engine:
+//   c++ -std=c++17 -O2 tests/sceneFileTest.cpp scene/sceneFile.cpp core/mappedFile.cpp
+// Exits with 1 if any check fails.
+#include "../scene/sceneFile.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+static const char* testPath = "sceneFileTest.scene";
+static const char* corruptPath = "sceneFileTest.corrupt.scene";
+static uint32_t failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+static SceneDesc makeScene(uint32_t objectCount, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> position(-1000.f, 1000.f);
+
+	SceneDesc desc;
+	desc.meshPaths = { "monkey_smooth.obj", "rocks/boulder.obj", "" };
+	desc.materialNames = { "defaultmesh", "texturedmesh" };
+
+	for (uint32_t i = 0; i < objectCount; i++)
+	{
+		glm::mat4 transform(1.f);
+		transform[3] = glm::vec4(position(random), position(random), position(random), 1.f);
+		desc.transforms.push_back(transform);
+		desc.meshIndices.push_back(random() % desc.meshPaths.size());
+		desc.materialIndices.push_back(random() % desc.materialNames.size());
+		desc.flags.push_back(random() % 4);
+	}
+	return desc;
+}
+
+static bool matches(const SceneFile& file, const SceneDesc& desc)
+{
+	uint32_t count = static_cast<uint32_t>(desc.transforms.size());
+	if (file.getObjectCount() != count || file.getMeshCount() != desc.meshPaths.size() || file.getMaterialCount() != desc.materialNames.size())
+		return false;
+
+	for (uint32_t i = 0; i < file.getMeshCount(); i++)
+		if (file.getMeshPath(i) != desc.meshPaths[i])
+			return false;
+	for (uint32_t i = 0; i < file.getMaterialCount(); i++)
+		if (file.getMaterialName(i) != desc.materialNames[i])
+			return false;
+
+	return count == 0 || (memcmp(file.transforms, desc.transforms.data(), count * sizeof(glm::mat4)) == 0 &&
+		memcmp(file.meshIndices, desc.meshIndices.data(), count * sizeof(uint32_t)) == 0 &&
+		memcmp(file.materialIndices, desc.materialIndices.data(), count * sizeof(uint32_t)) == 0 &&
+		memcmp(file.flags, desc.flags.data(), count * sizeof(uint32_t)) == 0);
+}
+
+static std::vector<char> readBytes(const char* path)
+{
+	std::ifstream file(path, std::ios::binary);
+	return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void writeBytes(const char* path, const std::vector<char>& bytes)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(bytes.data(), bytes.size());
+}
+
+template<typename T>
+static void patch(std::vector<char>& bytes, size_t offset, T value)
+{
+	memcpy(bytes.data() + offset, &value, sizeof(T));
+}
+
+// Writes a damaged copy of the valid file and checks that it is rejected.
+template<typename Damage>
+static void checkRejected(const std::vector<char>& valid, Damage&& damage, const char* what)
+{
+	std::vector<char> bytes = valid;
+	damage(bytes);
+	writeBytes(corruptPath, bytes);
+
+	SceneFile file;
+	check(!file.open(corruptPath), what);
+}
+
+static void testRoundTrip()
+{
+	SceneDesc desc = makeScene(1000, 1);
+	check(writeSceneFile(testPath, desc), "write scene");
+
+	SceneFile file;
+	check(file.open(testPath), "open written scene");
+	check(matches(file, desc), "round trip keeps every array and string");
+	file.close();
+
+	SceneDesc empty;
+	check(writeSceneFile(testPath, empty), "write empty scene");
+	check(file.open(testPath), "open empty scene");
+	check(matches(file, empty), "round trip of an empty scene");
+	file.close();
+
+	SceneDesc mismatched = makeScene(10, 2);
+	mismatched.flags.pop_back();
+	check(!writeSceneFile(testPath, mismatched), "arrays of different length are not written");
+}
+
+static void testMalformed()
+{
+	SceneDesc desc = makeScene(100, 3);
+	writeSceneFile(testPath, desc);
+	const std::vector<char> valid = readBytes(testPath);
+
+	const SceneFileHeader* header = reinterpret_cast<const SceneFileHeader*>(valid.data());
+	uint64_t stringOffsetsOffset = header->stringOffsetsOffset;
+	uint64_t meshIndicesOffset = header->meshIndicesOffset;
+	uint64_t materialIndicesOffset = header->materialIndicesOffset;
+
+	SceneFile file;
+	check(!file.open("sceneFileTest.missing.scene"), "missing file");
+
+	// Cut anywhere: inside the header, inside each array and one byte short.
+	for (size_t size : { size_t(0), size_t(4), sizeof(SceneFileHeader) - 1, size_t(stringOffsetsOffset + 2), size_t(meshIndicesOffset), valid.size() - 1 })
+		checkRejected(valid, [size](std::vector<char>& bytes) { bytes.resize(size); }, "truncated file");
+
+	checkRejected(valid, [](std::vector<char>& bytes) { bytes[0] = 'X'; }, "bad magic");
+	checkRejected(valid, [](std::vector<char>& bytes) {
+		patch<uint32_t>(bytes, offsetof(SceneFileHeader, version), sceneFileVersion + 1);
+	}, "unknown version");
+	checkRejected(valid, [](std::vector<char>& bytes) {
+		patch<uint32_t>(bytes, offsetof(SceneFileHeader, objectCount), 0x40000000);
+	}, "object count larger than the file");
+	checkRejected(valid, [](std::vector<char>& bytes) {
+		patch<uint64_t>(bytes, offsetof(SceneFileHeader, transformsOffset), ~uint64_t(0) - 8);
+	}, "offset past the end");
+	checkRejected(valid, [](std::vector<char>& bytes) {
+		patch<uint64_t>(bytes, offsetof(SceneFileHeader, flagsOffset), 2);
+	}, "misaligned offset");
+	checkRejected(valid, [](std::vector<char>& bytes) {
+		patch<uint32_t>(bytes, offsetof(SceneFileHeader, meshCount), 0xFFFFFFFF);
+	}, "string table larger than the file");
+	checkRejected(valid, [stringOffsetsOffset](std::vector<char>& bytes) {
+		patch<uint32_t>(bytes, stringOffsetsOffset + sizeof(uint32_t), 0xFFFF);
+	}, "string offsets out of order");
+	checkRejected(valid, [meshIndicesOffset](std::vector<char>& bytes) {
+		patch<uint32_t>(bytes, meshIndicesOffset + 7 * sizeof(uint32_t), 3);
+	}, "mesh index out of range");
+	checkRejected(valid, [materialIndicesOffset](std::vector<char>& bytes) {
+		patch<uint32_t>(bytes, materialIndicesOffset, 2);
+	}, "material index out of range");
+
+	std::remove(corruptPath);
+}
+
+static void benchmarkLoad()
+{
+	const uint32_t objectCount = 1000000;
+	SceneDesc desc = makeScene(objectCount, 4);
+	writeSceneFile(testPath, desc);
+
+	auto start = std::chrono::steady_clock::now();
+	SceneFile file;
+	bool opened = file.open(testPath);
+	double openMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	check(opened && matches(file, desc), "open 1M object scene");
+
+	// What building the scene object by object costs, for comparison.
+	struct Object
+	{
+		glm::mat4 transform;
+		uint32_t mesh;
+		uint32_t material;
+		uint32_t flags;
+	};
+
+	start = std::chrono::steady_clock::now();
+	std::vector<Object> objects;
+	for (uint32_t i = 0; i < objectCount; i++)
+		objects.push_back({ desc.transforms[i], desc.meshIndices[i], desc.materialIndices[i], desc.flags[i] });
+	double pushMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "1M objects: open " << openMilliseconds << " ms, push_back " << pushMilliseconds << " ms" << std::endl;
+}
+
+int main()
+{
+	testRoundTrip();
+	testMalformed();
+	benchmarkLoad();
+	std::remove(testPath);
+
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Scene file tests passed" << std::endl;
+	return 0;
+}
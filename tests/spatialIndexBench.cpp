@@ -0,0 +1,246 @@
+// Spatial index queries against a linear scan at 10k, 100k and 1M objects.
+// Standalone, build from the repository root with the same include paths as
+// the engine:
+//   c++ -std=c++17 -O2 tests/spatialIndexBench.cpp scene/spatialIndex.cpp scene/renderScene.cpp
+//       scene/bvh.cpp vulkan/vkMesh.cpp asset/objParser.cpp core/jobSystem.cpp core/mappedFile.cpp -lpthread
+// Exits with 1 if any index result differs from the scan.
+#include "../scene/spatialIndex.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+static uint32_t failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+// Objects spread through a cube at the same density for every size.
+static float worldSize(uint32_t count)
+{
+	return std::cbrt(static_cast<float>(count)) * 8.f;
+}
+
+static void populate(RenderScene& scene, uint32_t count, std::mt19937& random)
+{
+	float size = worldSize(count);
+	std::uniform_real_distribution<float> position(0.f, size);
+	std::uniform_real_distribution<float> scale(0.5f, 3.f);
+
+	AABB unit;
+	unit.min = glm::vec3(-1.f);
+	unit.max = glm::vec3(1.f);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		glm::mat4 transform = glm::translate(glm::mat4(1.f), glm::vec3(position(random), position(random), position(random)));
+		transform = glm::scale(transform, glm::vec3(scale(random)));
+		scene.add(MeshHandle(), MaterialHandle(), transform, unit);
+	}
+}
+
+static void sphereScan(const RenderScene& scene, glm::vec3 center, float radius, std::vector<uint32_t>& results)
+{
+	for (uint32_t i = 0; i < scene.size(); i++)
+		if (intersectSphereAABB(scene.bounds[i], center, radius))
+			results.push_back(i);
+}
+
+static float rayScan(const RenderScene& scene, const Ray& ray)
+{
+	glm::vec3 invDir = 1.f / ray.direction;
+	float closest = FLT_MAX;
+	for (uint32_t i = 0; i < scene.size(); i++)
+		closest = std::min(closest, intersectRayAABB(scene.bounds[i], ray.origin, invDir, std::min(closest, ray.tMax)));
+	return closest;
+}
+
+static bool sameSet(std::vector<uint32_t>& a, std::vector<uint32_t>& b)
+{
+	std::sort(a.begin(), a.end());
+	std::sort(b.begin(), b.end());
+	return a == b;
+}
+
+struct Queries
+{
+	std::vector<Frustum> frustums;
+	std::vector<std::pair<glm::vec3, float>> spheres;
+	std::vector<Ray> rays;
+};
+
+static Queries makeQueries(uint32_t count, std::mt19937& random)
+{
+	float size = worldSize(count);
+	std::uniform_real_distribution<float> position(0.f, size);
+	std::uniform_real_distribution<float> direction(-1.f, 1.f);
+
+	Queries queries;
+	glm::mat4 projection = glm::perspective(glm::radians(70.f), 16.f / 9.f, 0.1f, size * 0.25f);
+	for (uint32_t i = 0; i < 50; i++)
+	{
+		glm::vec3 eye = glm::vec3(position(random), position(random), position(random));
+		glm::vec3 target = glm::vec3(position(random), position(random), position(random));
+		queries.frustums.push_back(Frustum::fromMatrix(projection * glm::lookAt(eye, target, glm::vec3(0.f, 1.f, 0.f))));
+	}
+
+	for (uint32_t i = 0; i < 200; i++)
+		queries.spheres.push_back({ glm::vec3(position(random), position(random), position(random)), 5.f + size * 0.02f });
+
+	for (uint32_t i = 0; i < 200; i++)
+	{
+		glm::vec3 dir = glm::vec3(direction(random), direction(random), direction(random));
+		if (glm::length(dir) < 0.01f)
+			dir = glm::vec3(1.f, 0.f, 0.f);
+
+		Ray ray;
+		ray.origin = glm::vec3(position(random), position(random), position(random));
+		ray.direction = glm::normalize(dir);
+		queries.rays.push_back(ray);
+	}
+	return queries;
+}
+
+// Runs the index and the scan over the same queries and checks they agree.
+static void checkQueries(const RenderScene& scene, const SpatialIndex& index, const Queries& queries)
+{
+	std::vector<uint32_t> found, expected;
+
+	bool frustumsMatch = true;
+	for (const Frustum& frustum : queries.frustums)
+	{
+		found.clear();
+		expected.clear();
+		index.queryFrustum(scene, frustum, found);
+		scene.cull(frustum, expected);
+		frustumsMatch = frustumsMatch && sameSet(found, expected);
+	}
+	check(frustumsMatch, "frustum query matches the scan");
+
+	bool spheresMatch = true;
+	for (const auto& sphere : queries.spheres)
+	{
+		found.clear();
+		expected.clear();
+		index.querySphere(scene, sphere.first, sphere.second, found);
+		sphereScan(scene, sphere.first, sphere.second, expected);
+		spheresMatch = spheresMatch && sameSet(found, expected);
+	}
+	check(spheresMatch, "sphere query matches the scan");
+
+	bool raysMatch = true;
+	for (const Ray& ray : queries.rays)
+	{
+		RaycastHit hit;
+		bool hitSomething = index.raycast(scene, ray, hit);
+		float closest = rayScan(scene, ray);
+		raysMatch = raysMatch && hitSomething == (closest != FLT_MAX) && (!hitSomething || hit.distance == closest);
+	}
+	check(raysMatch, "raycast matches the scan");
+}
+
+template<typename Query>
+static double microsecondsPer(uint32_t count, Query&& query)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < count; i++)
+		query(i);
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+static void benchmark(uint32_t count)
+{
+	std::mt19937 random(count);
+	RenderScene scene;
+	populate(scene, count, random);
+
+	auto start = std::chrono::steady_clock::now();
+	SpatialIndex index;
+	index.build(scene);
+	index.commit(scene);
+	double buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	Queries queries = makeQueries(count, random);
+	checkQueries(scene, index, queries);
+
+	// Changes that don't trigger a rebuild: pending inserts, refits and
+	// removed objects.
+	std::uniform_real_distribution<float> position(0.f, worldSize(count));
+	for (uint32_t i = 0; i < 32; i++)
+	{
+		RenderableHandle handle = scene.handles[random() % scene.size()];
+		scene.setTransform(handle, glm::translate(glm::mat4(1.f), glm::vec3(position(random), position(random), position(random))));
+		index.update(handle);
+	}
+	RenderScene added;
+	populate(added, 32, random);
+	for (uint32_t i = 0; i < added.size(); i++)
+		index.insert(scene.add(MeshHandle(), MaterialHandle(), added.transforms[i], added.localBounds[i]));
+	for (uint32_t i = 0; i < 32; i++)
+	{
+		RenderableHandle handle = scene.handles[random() % scene.size()];
+		index.remove(handle);
+		scene.remove(handle);
+	}
+	index.commit(scene);
+	checkQueries(scene, index, queries);
+
+	std::vector<uint32_t> results;
+	auto frustumQuery = [&](bool indexed) {
+		return microsecondsPer(static_cast<uint32_t>(queries.frustums.size()), [&](uint32_t i) {
+			results.clear();
+			if (indexed)
+				index.queryFrustum(scene, queries.frustums[i], results);
+			else
+				scene.cull(queries.frustums[i], results);
+		});
+	};
+	auto sphereQuery = [&](bool indexed) {
+		return microsecondsPer(static_cast<uint32_t>(queries.spheres.size()), [&](uint32_t i) {
+			results.clear();
+			if (indexed)
+				index.querySphere(scene, queries.spheres[i].first, queries.spheres[i].second, results);
+			else
+				sphereScan(scene, queries.spheres[i].first, queries.spheres[i].second, results);
+		});
+	};
+	// Keeps the scan from being optimized away.
+	volatile float sink = 0.f;
+	auto rayQuery = [&](bool indexed) {
+		return microsecondsPer(static_cast<uint32_t>(queries.rays.size()), [&](uint32_t i) {
+			RaycastHit hit;
+			if (indexed)
+				sink = index.raycast(scene, queries.rays[i], hit) ? hit.distance : 0.f;
+			else
+				sink = rayScan(scene, queries.rays[i]);
+		});
+	};
+
+	std::cout << count << " objects, build " << buildMilliseconds << " ms, microseconds per query (index / scan):" << std::endl
+		<< "  frustum " << frustumQuery(true) << " / " << frustumQuery(false) << std::endl
+		<< "  sphere  " << sphereQuery(true) << " / " << sphereQuery(false) << std::endl
+		<< "  ray     " << rayQuery(true) << " / " << rayQuery(false) << std::endl;
+}
+
+int main()
+{
+	for (uint32_t count : { 10000u, 100000u, 1000000u })
+		benchmark(count);
+
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Spatial index checks passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "bufferPool.h"
+
+constexpr size_t minBufferSize = 4096;
+
+size_t BufferPool::classSize(size_t size)
+{
+	if (size <= minBufferSize)
+		return minBufferSize;
+
+	size_t high = size_t(1) << 63;
+	while (!(size & high))
+		high >>= 1;
+
+	size_t step = high / 4;
+	return (size + step - 1) / step * step;
+}
+
+void BufferPool::init(VmaAllocator allocator, size_t maxPooledBytes)
+{
+	this->allocator = allocator;
+	this->maxPooledBytes = maxPooledBytes;
+}
+
+void BufferPool::cleanup()
+{
+	for (auto& bucket : freeBuffers)
+		for (AllocatedBuffer& buffer : bucket.second)
+			vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+	freeBuffers.clear();
+
+	for (PendingBuffer& entry : pending)
+		vmaDestroyBuffer(allocator, entry.buffer.buffer, entry.buffer.allocation);
+	pending.clear();
+
+	sizeOf.clear();
+	pooledBytes = 0;
+}
+
+VkResult BufferPool::acquire(size_t size, VkBufferUsageFlags usage, uint64_t completedSequence, AllocatedBuffer& buffer)
+{
+	// Released in sequence order, so the completed ones are at the front.
+	while (!pending.empty() && pending.front().sequence <= completedSequence)
+	{
+		PendingBuffer& entry = pending.front();
+		freeBuffers[{ entry.usage, sizeOf[entry.buffer.buffer] }].push_back(entry.buffer);
+		pending.pop_front();
+	}
+
+	size_t capacity = classSize(size);
+
+	auto it = freeBuffers.find({ usage, capacity });
+	if (it != freeBuffers.end() && !it->second.empty())
+	{
+		buffer = it->second.back();
+		it->second.pop_back();
+		pooledBytes -= capacity;
+		return VK_SUCCESS;
+	}
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.pNext = nullptr;
+	bufferInfo.size = capacity;
+	bufferInfo.usage = usage;
+
+	VmaAllocationCreateInfo vmaallocInfo = {};
+	vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+
+	VkResult result = vmaCreateBuffer(allocator, &bufferInfo, &vmaallocInfo, &buffer.buffer, &buffer.allocation, nullptr);
+	if (result == VK_SUCCESS)
+		sizeOf[buffer.buffer] = capacity;
+
+	return result;
+}
+
+bool BufferPool::release(AllocatedBuffer buffer, VkBufferUsageFlags usage, uint64_t sequence)
+{
+	auto it = sizeOf.find(buffer.buffer);
+	if (it == sizeOf.end())
+		return false;
+
+	if (pooledBytes + it->second > maxPooledBytes)
+	{
+		sizeOf.erase(it);
+		return false;
+	}
+
+	pooledBytes += it->second;
+	pending.push_back({ buffer, usage, sequence });
+	return true;
+}
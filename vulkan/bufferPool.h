@@ -0,0 +1,48 @@
+#pragma once
+#include "vkTypes.h"
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+// Host visible buffers of unloaded meshes, kept for reuse instead of being
+// destroyed and allocated again while the world streams. Sizes are rounded to
+// classes with four steps per power of two, so a reused buffer is at most a
+// quarter larger than asked for.
+//
+// A released buffer may still be read by frames in flight. It is tagged with
+// the last published snapshot sequence and only handed out again once the
+// render thread reports that sequence as completed.
+class BufferPool
+{
+	struct PendingBuffer
+	{
+		AllocatedBuffer buffer;
+		VkBufferUsageFlags usage;
+		uint64_t sequence;
+	};
+
+	VmaAllocator allocator;
+	size_t maxPooledBytes = 0;
+	size_t pooledBytes = 0;
+
+	std::map<std::pair<VkBufferUsageFlags, size_t>, std::vector<AllocatedBuffer>> freeBuffers;
+	std::deque<PendingBuffer> pending;
+	std::unordered_map<VkBuffer, size_t> sizeOf;
+
+	static size_t classSize(size_t size);
+
+public:
+	void init(VmaAllocator allocator, size_t maxPooledBytes);
+	void cleanup();
+
+	// Gets a CPU_TO_GPU buffer of at least size bytes, reusing a pooled one
+	// when a buffer released at or before completedSequence fits.
+	VkResult acquire(size_t size, VkBufferUsageFlags usage, uint64_t completedSequence, AllocatedBuffer& buffer);
+
+	// Takes the buffer back. Returns false when it did not come from this pool
+	// or the pool is full, the caller has to destroy it then.
+	bool release(AllocatedBuffer buffer, VkBufferUsageFlags usage, uint64_t sequence);
+
+	size_t getPooledBytes() const { return pooledBytes; }
+};
@@ -15,6 +15,8 @@ public:
 	VkPipelineMultisampleStateCreateInfo multisampling;
 	VkPipelineLayout pipelineLayout;
 	VkPipelineDepthStencilStateCreateInfo depthStencil;
+	// viewport and scissor are ignored for the states listed here.
+	std::vector<VkDynamicState> dynamicStates;
 
-	VkPipeline buildPipeline(VkDevice device, VkRenderPass pass);
+	VkPipeline buildPipeline(VkDevice device, VkRenderPass pass, VkPipelineCache cache = VK_NULL_HANDLE);
 };
\ No newline at end of file
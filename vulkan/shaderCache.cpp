@@ -0,0 +1,386 @@
+#include "shaderCache.h"
+#include "vkEngine.h"
+#include "vkInit.h"
+#include <fstream>
+#include <iostream>
+
+constexpr uint32_t spirvMagic = 0x07230203;
+
+static uint64_t hashCode(const std::vector<uint32_t>& code)
+{
+	// 64 bit FNV-1a
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(code.data());
+	size_t size = code.size() * sizeof(uint32_t);
+
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+void ShaderCache::init(VulkanEngine* engine, JobSystem* jobs, const std::string& root)
+{
+	this->engine = engine;
+	this->jobs = jobs;
+	this->device = engine->device;
+	this->root = root;
+
+	if (!this->root.empty() && this->root.back() != '/' && this->root.back() != '\\')
+		this->root += '/';
+
+	pipelineCachePath = this->root + "pipelines.cache";
+
+	std::vector<char> cacheData;
+	std::ifstream file(pipelineCachePath, std::ios::ate | std::ios::binary);
+	if (file.is_open())
+	{
+		cacheData.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(cacheData.data(), cacheData.size());
+		file.close();
+	}
+
+	// The driver ignores data written by another device or driver version.
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.pNext = nullptr;
+	cacheInfo.initialDataSize = cacheData.size();
+	cacheInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+	{
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+			pipelineCache = VK_NULL_HANDLE;
+	}
+
+	watcher.init(this->root);
+}
+
+void ShaderCache::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		requests.clear();
+	}
+
+	jobs->wait(buildCounter);
+
+	for (BuildResult& result : results)
+		if (result.pipeline != VK_NULL_HANDLE)
+			vkDestroyPipeline(device, result.pipeline, nullptr);
+	results.clear();
+
+	for (PipelineEntry& entry : pipelines)
+		if (entry.pipeline != VK_NULL_HANDLE)
+			vkDestroyPipeline(device, entry.pipeline, nullptr);
+	pipelines.clear();
+
+	for (auto& module : modules)
+		vkDestroyShaderModule(device, module.second.module, nullptr);
+	modules.clear();
+
+	for (VkShaderModule module : retiredModules)
+		vkDestroyShaderModule(device, module, nullptr);
+	retiredModules.clear();
+
+	files.clear();
+
+	if (pipelineCache != VK_NULL_HANDLE)
+	{
+		size_t size = 0;
+		if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) == VK_SUCCESS && size > 0)
+		{
+			std::vector<char> cacheData(size);
+			if (vkGetPipelineCacheData(device, pipelineCache, &size, cacheData.data()) == VK_SUCCESS)
+			{
+				std::ofstream file(pipelineCachePath, std::ios::binary | std::ios::trunc);
+				file.write(cacheData.data(), size);
+			}
+		}
+
+		vkDestroyPipelineCache(device, pipelineCache, nullptr);
+		pipelineCache = VK_NULL_HANDLE;
+	}
+
+	watcher.cleanup();
+}
+
+bool ShaderCache::readFile(const std::string& path, std::vector<uint32_t>& code) const
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	// Files caught halfway through a write fail these checks and are picked
+	// up again by the next change notification.
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0)
+		return false;
+
+	code.resize(fileSize / sizeof(uint32_t));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(code.data()), fileSize);
+
+	return file.good() && code[0] == spirvMagic;
+}
+
+bool ShaderCache::addModule(const std::vector<uint32_t>& code, uint64_t& hash)
+{
+	hash = hashCode(code);
+
+	auto it = modules.find(hash);
+	if (it != modules.end())
+	{
+		it->second.refCount++;
+		return true;
+	}
+
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.pNext = nullptr;
+
+	createInfo.codeSize = code.size() * sizeof(uint32_t);
+	createInfo.pCode = code.data();
+
+	VkShaderModule module;
+	if (vkCreateShaderModule(device, &createInfo, nullptr, &module) != VK_SUCCESS)
+		return false;
+
+	modules[hash] = { module, 1 };
+	return true;
+}
+
+void ShaderCache::releaseModule(uint64_t hash)
+{
+	auto it = modules.find(hash);
+	if (it == modules.end() || --it->second.refCount > 0)
+		return;
+
+	retiredModules.push_back(it->second.module);
+	modules.erase(it);
+}
+
+bool ShaderCache::loadFile(const std::string& path)
+{
+	if (files.find(path) != files.end())
+		return true;
+
+	std::vector<uint32_t> code;
+	uint64_t hash;
+	if (!readFile(root + path, code) || !addModule(code, hash))
+		return false;
+
+	files[path].hash = hash;
+	watcher.watch(path);
+	return true;
+}
+
+void ShaderCache::reloadFile(const std::string& path)
+{
+	auto it = files.find(path);
+	if (it == files.end())
+		return;
+
+	std::vector<uint32_t> code;
+	uint64_t hash;
+	if (!readFile(root + path, code) || !addModule(code, hash))
+		return;
+
+	// Saved without changes, nothing to rebuild.
+	if (hash == it->second.hash)
+	{
+		releaseModule(hash);
+		return;
+	}
+
+	std::cout << "Reloading shader " << path << std::endl;
+
+	releaseModule(it->second.hash);
+	it->second.hash = hash;
+
+	for (PipelineID id : it->second.users)
+		queueBuild(id);
+}
+
+void ShaderCache::gatherModules(PipelineID id, std::vector<VkShaderModule>& stageModules) const
+{
+	const PipelineDesc& desc = pipelines[id].desc;
+
+	stageModules.clear();
+	for (const ShaderStageDesc& stage : desc.stages)
+		stageModules.push_back(modules.at(files.at(stage.path).hash).module);
+}
+
+VkPipeline ShaderCache::build(const PipelineDesc& desc, const VkShaderModule* stageModules) const
+{
+	std::vector<VkSpecializationMapEntry> entries(desc.constants.size());
+	for (uint32_t i = 0; i < entries.size(); i++)
+	{
+		entries[i].constantID = i;
+		entries[i].offset = i * sizeof(uint32_t);
+		entries[i].size = sizeof(uint32_t);
+	}
+
+	VkSpecializationInfo specialization{};
+	specialization.mapEntryCount = static_cast<uint32_t>(entries.size());
+	specialization.pMapEntries = entries.data();
+	specialization.dataSize = desc.constants.size() * sizeof(uint32_t);
+	specialization.pData = desc.constants.data();
+
+	const VkSpecializationInfo* specializationInfo = desc.constants.empty() ? nullptr : &specialization;
+
+	if (desc.stages.size() == 1 && desc.stages[0].stage == VK_SHADER_STAGE_COMPUTE_BIT)
+	{
+		VkComputePipelineCreateInfo pipelineInfo = vkinit::computePipelineCreateInfo(desc.layout, stageModules[0]);
+		pipelineInfo.stage.pSpecializationInfo = specializationInfo;
+
+		VkPipeline pipeline;
+		if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+			return VK_NULL_HANDLE;
+
+		return pipeline;
+	}
+
+	PipelineBuilder builder = desc.builder;
+	builder.pipelineLayout = desc.layout;
+	builder.vertexInputInfo.pVertexBindingDescriptions = desc.vertexInput.bindings.data();
+	builder.vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexInput.bindings.size());
+	builder.vertexInputInfo.pVertexAttributeDescriptions = desc.vertexInput.attributes.data();
+	builder.vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexInput.attributes.size());
+
+	builder.shaderStages.clear();
+	for (size_t i = 0; i < desc.stages.size(); i++)
+	{
+		VkPipelineShaderStageCreateInfo stageInfo = vkinit::pipelineShaderCreateInfo(desc.stages[i].stage, stageModules[i]);
+		stageInfo.pSpecializationInfo = specializationInfo;
+		builder.shaderStages.push_back(stageInfo);
+	}
+
+	return builder.buildPipeline(device, desc.renderPass, pipelineCache);
+}
+
+PipelineID ShaderCache::addPipeline(PipelineDesc&& desc)
+{
+	for (const ShaderStageDesc& stage : desc.stages)
+	{
+		if (!loadFile(stage.path))
+		{
+			std::cout << "Error when loading shader " << stage.path << std::endl;
+			return noPipeline;
+		}
+	}
+
+	PipelineID id = static_cast<PipelineID>(pipelines.size());
+	pipelines.emplace_back();
+	PipelineEntry& entry = pipelines.back();
+	entry.desc = std::move(desc);
+
+	for (const ShaderStageDesc& stage : entry.desc.stages)
+	{
+		std::vector<PipelineID>& users = files[stage.path].users;
+		if (users.empty() || users.back() != id)
+			users.push_back(id);
+	}
+
+	std::vector<VkShaderModule> stageModules;
+	gatherModules(id, stageModules);
+	entry.pipeline = build(entry.desc, stageModules.data());
+
+	return id;
+}
+
+void ShaderCache::queueBuild(PipelineID id)
+{
+	PipelineEntry& entry = pipelines[id];
+	entry.serial++;
+
+	BuildRequest request;
+	request.id = id;
+	request.serial = entry.serial;
+	request.desc = &entry.desc;
+	gatherModules(id, request.modules);
+
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		requests.push_back(std::move(request));
+	}
+	jobs->run([this] { buildNext(); }, &buildCounter);
+}
+
+// Same scheme as asset loads, every request has one job and jobs take
+// whichever request is next.
+void ShaderCache::buildNext()
+{
+	BuildRequest request;
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		if (requests.empty())
+			return;
+
+		request = std::move(requests.front());
+		requests.pop_front();
+	}
+
+	BuildResult result;
+	result.id = request.id;
+	result.serial = request.serial;
+	result.pipeline = build(*request.desc, request.modules.data());
+
+	std::lock_guard<std::mutex> lock(resultMutex);
+	results.push_back(result);
+}
+
+uint32_t ShaderCache::update()
+{
+	changedFiles.clear();
+	watcher.poll(changedFiles);
+
+	for (const std::string& path : changedFiles)
+		reloadFile(path);
+
+	{
+		std::lock_guard<std::mutex> lock(resultMutex);
+		std::swap(results, resultScratch);
+	}
+
+	uint32_t replaced = 0;
+	for (BuildResult& result : resultScratch)
+	{
+		PipelineEntry& entry = pipelines[result.id];
+
+		// Superseded by a newer rebuild, never used.
+		if (result.serial != entry.serial)
+		{
+			if (result.pipeline != VK_NULL_HANDLE)
+				vkDestroyPipeline(device, result.pipeline, nullptr);
+			continue;
+		}
+
+		if (result.pipeline == VK_NULL_HANDLE)
+		{
+			std::cout << "Error when rebuilding pipeline, keeping the previous one" << std::endl;
+			continue;
+		}
+
+		if (entry.pipeline != VK_NULL_HANDLE)
+			engine->retiredResources.pushPipeline(entry.pipeline);
+
+		entry.pipeline = result.pipeline;
+		replaced++;
+	}
+	resultScratch.clear();
+
+	if (!retiredModules.empty() && buildCounter.isDone())
+	{
+		for (VkShaderModule module : retiredModules)
+			vkDestroyShaderModule(device, module, nullptr);
+		retiredModules.clear();
+	}
+
+	return replaced;
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include "vkTypes.h"
+#include "vkMesh.h"
+#include "pipelineBuilder.h"
+#include "../core/jobSystem.h"
+#include "../core/fileWatcher.h"
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class VulkanEngine;
+
+typedef uint32_t PipelineID;
+constexpr PipelineID noPipeline = 0xFFFFFFFF;
+
+struct ShaderStageDesc
+{
+	VkShaderStageFlagBits stage;
+	// SPIR-V file relative to the shader root.
+	std::string path;
+};
+
+// Everything needed to build a pipeline again after one of its shaders
+// changed. A single compute stage makes a compute pipeline.
+struct PipelineDesc
+{
+	// Fixed function state. Shader stages and vertex input pointers are
+	// filled in by the cache.
+	PipelineBuilder builder;
+	VertexInputDescription vertexInput;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	std::vector<ShaderStageDesc> stages;
+
+	// Specialization constants for every stage, constant_id is the index.
+	// Permutations of a shader differ only here and share its module.
+	std::vector<uint32_t> constants;
+};
+
+// Owns shader modules and the pipelines built from them. Modules are keyed by
+// a hash of their contents, so identical SPIR-V is only created once however
+// many files or pipelines use it. Watched files that change are reloaded by
+// update() and only the pipelines using them are rebuilt, as jobs; until a
+// rebuild finishes the old pipeline stays in use. Pipelines go through a
+// VkPipelineCache that is kept on disk between runs.
+class ShaderCache
+{
+	struct ShaderModule
+	{
+		VkShaderModule module;
+		// Number of files with this content.
+		uint32_t refCount;
+	};
+
+	struct ShaderFile
+	{
+		uint64_t hash;
+		std::vector<PipelineID> users;
+	};
+
+	struct PipelineEntry
+	{
+		PipelineDesc desc;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		// Bumped for every rebuild so results of superseded ones are dropped.
+		uint32_t serial = 0;
+	};
+
+	struct BuildRequest
+	{
+		PipelineID id;
+		uint32_t serial;
+		const PipelineDesc* desc;
+		std::vector<VkShaderModule> modules;
+	};
+
+	struct BuildResult
+	{
+		PipelineID id;
+		uint32_t serial;
+		VkPipeline pipeline;
+	};
+
+	VulkanEngine* engine;
+	VkDevice device;
+	std::string root;
+	std::string pipelineCachePath;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+	std::unordered_map<uint64_t, ShaderModule> modules;
+	std::unordered_map<std::string, ShaderFile> files;
+	// Deque so builds on other threads can read descriptions while new
+	// pipelines are registered.
+	std::deque<PipelineEntry> pipelines;
+
+	FileWatcher watcher;
+	std::vector<std::string> changedFiles;
+
+	// Modules no file uses anymore, destroyed once no build can reference them.
+	std::vector<VkShaderModule> retiredModules;
+
+	JobSystem* jobs;
+	JobCounter buildCounter;
+	std::mutex requestMutex;
+	std::deque<BuildRequest> requests;
+
+	std::mutex resultMutex;
+	std::vector<BuildResult> results;
+	std::vector<BuildResult> resultScratch;
+
+	bool readFile(const std::string& path, std::vector<uint32_t>& code) const;
+	bool addModule(const std::vector<uint32_t>& code, uint64_t& hash);
+	void releaseModule(uint64_t hash);
+	bool loadFile(const std::string& path);
+	void reloadFile(const std::string& path);
+	void gatherModules(PipelineID id, std::vector<VkShaderModule>& stageModules) const;
+	VkPipeline build(const PipelineDesc& desc, const VkShaderModule* stageModules) const;
+	void queueBuild(PipelineID id);
+	void buildNext();
+
+public:
+	void init(VulkanEngine* engine, JobSystem* jobs, const std::string& root);
+	void cleanup();
+
+	// Builds the pipeline right away, returns noPipeline if a shader failed to
+	// load. A pipeline that fails to build stays null until a reload fixes it,
+	// and may be replaced by any later update().
+	PipelineID addPipeline(PipelineDesc&& desc);
+
+	VkPipeline getPipeline(PipelineID id) const { return id < pipelines.size() ? pipelines[id].pipeline : VK_NULL_HANDLE; }
+
+	// Reloads changed shaders and swaps in finished rebuilds, returns how many
+	// pipelines were replaced. Replaced pipelines are retired through the engine.
+	uint32_t update();
+};
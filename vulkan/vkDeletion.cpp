@@ -0,0 +1,188 @@
+#include "vkDeletion.h"
+
+void DeletionQueue::pushBuffer(AllocatedBuffer buffer)
+{
+	DeletionRecord record{};
+	record.type = DELETE_BUFFER;
+	record.buffer = buffer.buffer;
+	record.allocation = buffer.allocation;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushImage(AllocatedImage image)
+{
+	DeletionRecord record{};
+	record.type = DELETE_IMAGE;
+	record.image = image.image;
+	record.allocation = image.allocation;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushImageView(VkImageView imageView)
+{
+	DeletionRecord record{};
+	record.type = DELETE_IMAGE_VIEW;
+	record.imageView = imageView;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushSampler(VkSampler sampler)
+{
+	DeletionRecord record{};
+	record.type = DELETE_SAMPLER;
+	record.sampler = sampler;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushPipeline(VkPipeline pipeline)
+{
+	DeletionRecord record{};
+	record.type = DELETE_PIPELINE;
+	record.pipeline = pipeline;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushPipelineLayout(VkPipelineLayout pipelineLayout)
+{
+	DeletionRecord record{};
+	record.type = DELETE_PIPELINE_LAYOUT;
+	record.pipelineLayout = pipelineLayout;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushRenderPass(VkRenderPass renderPass)
+{
+	DeletionRecord record{};
+	record.type = DELETE_RENDER_PASS;
+	record.renderPass = renderPass;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushFramebuffer(VkFramebuffer framebuffer)
+{
+	DeletionRecord record{};
+	record.type = DELETE_FRAMEBUFFER;
+	record.framebuffer = framebuffer;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushCommandPool(VkCommandPool commandPool)
+{
+	DeletionRecord record{};
+	record.type = DELETE_COMMAND_POOL;
+	record.commandPool = commandPool;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushFence(VkFence fence)
+{
+	DeletionRecord record{};
+	record.type = DELETE_FENCE;
+	record.fence = fence;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushSemaphore(VkSemaphore semaphore)
+{
+	DeletionRecord record{};
+	record.type = DELETE_SEMAPHORE;
+	record.semaphore = semaphore;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushDescriptorSetLayout(VkDescriptorSetLayout descriptorSetLayout)
+{
+	DeletionRecord record{};
+	record.type = DELETE_DESCRIPTOR_SET_LAYOUT;
+	record.descriptorSetLayout = descriptorSetLayout;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushDescriptorPool(VkDescriptorPool descriptorPool)
+{
+	DeletionRecord record{};
+	record.type = DELETE_DESCRIPTOR_POOL;
+	record.descriptorPool = descriptorPool;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushShaderModule(VkShaderModule shaderModule)
+{
+	DeletionRecord record{};
+	record.type = DELETE_SHADER_MODULE;
+	record.shaderModule = shaderModule;
+	records.push_back(record);
+}
+
+void DeletionQueue::pushSwapchain(VkSwapchainKHR swapchain)
+{
+	DeletionRecord record{};
+	record.type = DELETE_SWAPCHAIN;
+	record.swapchain = swapchain;
+	records.push_back(record);
+}
+
+void DeletionQueue::append(DeletionQueue& other)
+{
+	records.insert(records.end(), other.records.begin(), other.records.end());
+	other.records.clear();
+}
+
+void DeletionQueue::flush(VkDevice device, VmaAllocator allocator)
+{
+	for (auto it = records.rbegin(); it != records.rend(); it++)
+	{
+		const DeletionRecord& record = *it;
+
+		switch (record.type)
+		{
+		case DELETE_BUFFER:
+			vmaDestroyBuffer(allocator, record.buffer, record.allocation);
+			break;
+		case DELETE_IMAGE:
+			vmaDestroyImage(allocator, record.image, record.allocation);
+			break;
+		case DELETE_IMAGE_VIEW:
+			vkDestroyImageView(device, record.imageView, nullptr);
+			break;
+		case DELETE_SAMPLER:
+			vkDestroySampler(device, record.sampler, nullptr);
+			break;
+		case DELETE_PIPELINE:
+			vkDestroyPipeline(device, record.pipeline, nullptr);
+			break;
+		case DELETE_PIPELINE_LAYOUT:
+			vkDestroyPipelineLayout(device, record.pipelineLayout, nullptr);
+			break;
+		case DELETE_RENDER_PASS:
+			vkDestroyRenderPass(device, record.renderPass, nullptr);
+			break;
+		case DELETE_FRAMEBUFFER:
+			vkDestroyFramebuffer(device, record.framebuffer, nullptr);
+			break;
+		case DELETE_COMMAND_POOL:
+			vkDestroyCommandPool(device, record.commandPool, nullptr);
+			break;
+		case DELETE_FENCE:
+			vkDestroyFence(device, record.fence, nullptr);
+			break;
+		case DELETE_SEMAPHORE:
+			vkDestroySemaphore(device, record.semaphore, nullptr);
+			break;
+		case DELETE_DESCRIPTOR_SET_LAYOUT:
+			vkDestroyDescriptorSetLayout(device, record.descriptorSetLayout, nullptr);
+			break;
+		case DELETE_DESCRIPTOR_POOL:
+			vkDestroyDescriptorPool(device, record.descriptorPool, nullptr);
+			break;
+		case DELETE_SHADER_MODULE:
+			vkDestroyShaderModule(device, record.shaderModule, nullptr);
+			break;
+		case DELETE_SWAPCHAIN:
+			vkDestroySwapchainKHR(device, record.swapchain, nullptr);
+			break;
+		}
+	}
+
+	records.clear();
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "vkTypes.h"
+#include <vector>
+
+enum DeletionType : uint8_t
+{
+	DELETE_BUFFER,
+	DELETE_IMAGE,
+	DELETE_IMAGE_VIEW,
+	DELETE_SAMPLER,
+	DELETE_PIPELINE,
+	DELETE_PIPELINE_LAYOUT,
+	DELETE_RENDER_PASS,
+	DELETE_FRAMEBUFFER,
+	DELETE_COMMAND_POOL,
+	DELETE_FENCE,
+	DELETE_SEMAPHORE,
+	DELETE_DESCRIPTOR_SET_LAYOUT,
+	DELETE_DESCRIPTOR_POOL,
+	DELETE_SHADER_MODULE,
+	DELETE_SWAPCHAIN
+};
+
+struct DeletionRecord
+{
+	union
+	{
+		VkBuffer buffer;
+		VkImage image;
+		VkImageView imageView;
+		VkSampler sampler;
+		VkPipeline pipeline;
+		VkPipelineLayout pipelineLayout;
+		VkRenderPass renderPass;
+		VkFramebuffer framebuffer;
+		VkCommandPool commandPool;
+		VkFence fence;
+		VkSemaphore semaphore;
+		VkDescriptorSetLayout descriptorSetLayout;
+		VkDescriptorPool descriptorPool;
+		VkShaderModule shaderModule;
+		VkSwapchainKHR swapchain;
+	};
+	VmaAllocation allocation;
+	DeletionType type;
+};
+
+// Plain records instead of closures, so pushing never allocates once the
+// vector has grown to its working size. Flushed in reverse push order.
+struct DeletionQueue
+{
+	std::vector<DeletionRecord> records;
+
+	void pushBuffer(AllocatedBuffer buffer);
+	void pushImage(AllocatedImage image);
+	void pushImageView(VkImageView imageView);
+	void pushSampler(VkSampler sampler);
+	void pushPipeline(VkPipeline pipeline);
+	void pushPipelineLayout(VkPipelineLayout pipelineLayout);
+	void pushRenderPass(VkRenderPass renderPass);
+	void pushFramebuffer(VkFramebuffer framebuffer);
+	void pushCommandPool(VkCommandPool commandPool);
+	void pushFence(VkFence fence);
+	void pushSemaphore(VkSemaphore semaphore);
+	void pushDescriptorSetLayout(VkDescriptorSetLayout descriptorSetLayout);
+	void pushDescriptorPool(VkDescriptorPool descriptorPool);
+	void pushShaderModule(VkShaderModule shaderModule);
+	void pushSwapchain(VkSwapchainKHR swapchain);
+
+	// Moves every record of other to the end of this queue.
+	void append(DeletionQueue& other);
+
+	void flush(VkDevice device, VmaAllocator allocator);
+
+	bool isEmpty() const { return records.empty(); }
+};
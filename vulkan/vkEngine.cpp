@@ -13,6 +13,9 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include "glm/gtc/matrix_transform.hpp"
 
 #include "../input/input.h"
@@ -51,12 +54,26 @@ void VulkanEngine::initVulkan()
 
 	SDL_Vulkan_CreateSurface(window, this->instance, &surface);
 
+	// rg32f storage images for the depth pyramid
+	VkPhysicalDeviceFeatures requiredFeatures{};
+	requiredFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+
 	vkb::PhysicalDeviceSelector selector(instance);
-	vkb::PhysicalDevice physicalDevice = selector
+	selector
 		.set_minimum_version(1, 1)
 		.set_surface(surface)
-		.select()
-		.value();
+		.set_required_features(requiredFeatures);
+
+	// Offscreen views are drawn in a single multiview pass
+	if (offscreenLayers > 0)
+	{
+		VkPhysicalDeviceMultiviewFeatures multiviewFeatures{};
+		multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+		multiviewFeatures.multiview = VK_TRUE;
+		selector.add_required_extension_features(multiviewFeatures);
+	}
+
+	vkb::PhysicalDevice physicalDevice = selector.select().value();
 
 	vkb::DeviceBuilder deviceBuilder(physicalDevice);
 
@@ -102,7 +119,8 @@ void VulkanEngine::initSwapchain()
 
 	depthFormat = VK_FORMAT_D32_SFLOAT;
 
-	VkImageCreateInfo imageInfo = vkinit::imageCreateInfo(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depthImageExtent);
+	// Sampled by the depth pyramid build after the early pass
+	VkImageCreateInfo imageInfo = vkinit::imageCreateInfo(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, depthImageExtent);
 
 	VmaAllocationCreateInfo imageInfoAlloc{};
 	imageInfoAlloc.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -114,10 +132,9 @@ void VulkanEngine::initSwapchain()
 
 	VK_CHECK(vkCreateImageView(device, &imageViewInfo, nullptr, &depthImageView));
 
-	mainDeletionQueue.pushFunction([=]() {
-		vkDestroySwapchainKHR(device, this->swapchain, nullptr);
-		vmaDestroyImage(allocator, depthImage.image, depthImage.allocation);
-	});
+	mainDeletionQueue.pushSwapchain(this->swapchain);
+	mainDeletionQueue.pushImage(depthImage);
+	mainDeletionQueue.pushImageView(depthImageView);
 }
 
 void VulkanEngine::initCommands()
@@ -132,14 +149,28 @@ void VulkanEngine::initCommands()
 
 		VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &frames[i].mainCommandBuffer));
 
-		mainDeletionQueue.pushFunction([=]() {
-			vkDestroyCommandPool(device, frames[i].commandPool, nullptr);
-		});
+		auto secondaryAllocInfo = vkinit::commandBufferAllocInfo(frames[i].commandPool, maxDrawSections, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+		VK_CHECK(vkAllocateCommandBuffers(device, &secondaryAllocInfo, frames[i].staticCommands));
+		VK_CHECK(vkAllocateCommandBuffers(device, &secondaryAllocInfo, frames[i].dynamicCommands));
+
+		mainDeletionQueue.pushCommandPool(frames[i].commandPool);
 	}
+
+	auto uploadCommandPoolInfo = vkinit::commandPoolCreateInfo(graphicsQueueFamily);
+	VK_CHECK(vkCreateCommandPool(device, &uploadCommandPoolInfo, nullptr, &uploadContext.commandPool));
+
+	auto uploadAllocInfo = vkinit::commandBufferAllocInfo(uploadContext.commandPool);
+	VK_CHECK(vkAllocateCommandBuffers(device, &uploadAllocInfo, &uploadContext.commandBuffer));
+
+	mainDeletionQueue.pushCommandPool(uploadContext.commandPool);
 }
 
 void VulkanEngine::initRenderpass()
 {
+	// The frame is drawn in two passes around the depth pyramid build. The early
+	// pass clears and leaves depth readable, the late pass loads both attachments
+	// and hands the color image to presentation.
 	VkAttachmentDescription attachmentDesc{};
 	attachmentDesc.format = swapchainImageFormat;
 	attachmentDesc.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -148,7 +179,7 @@ void VulkanEngine::initRenderpass()
 	attachmentDesc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachmentDesc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachmentDesc.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachmentDesc.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	attachmentDesc.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference attachmentRef{};
 	attachmentRef.attachment = 0;
@@ -163,7 +194,7 @@ void VulkanEngine::initRenderpass()
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
 	VkAttachmentReference depthAttachmentRef{};
 	depthAttachmentRef.attachment = 1;
@@ -184,15 +215,24 @@ void VulkanEngine::initRenderpass()
 	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+	// Also orders the previous frame's pyramid build before depth is cleared
 	VkSubpassDependency depthDependency{};
 	depthDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
 	depthDependency.dstSubpass = 0;
-	depthDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	depthDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 	depthDependency.srcAccessMask = 0;
 	depthDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 	depthDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-	VkSubpassDependency dependencies[2] = { dependency, depthDependency };
+	VkSubpassDependency pyramidDependency{};
+	pyramidDependency.srcSubpass = 0;
+	pyramidDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+	pyramidDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	pyramidDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	pyramidDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	pyramidDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	VkSubpassDependency dependencies[3] = { dependency, depthDependency, pyramidDependency };
 
 	VkAttachmentDescription attachments[2] = { attachmentDesc, depthAttachment };
 
@@ -202,14 +242,35 @@ void VulkanEngine::initRenderpass()
 	renderPassCreateInfo.pAttachments = &attachments[0];
 	renderPassCreateInfo.subpassCount = 1;
 	renderPassCreateInfo.pSubpasses = &subpass;
-	renderPassCreateInfo.dependencyCount = 2;
+	renderPassCreateInfo.dependencyCount = 3;
 	renderPassCreateInfo.pDependencies = &dependencies[0];
 
 	VK_CHECK(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &renderPass));
 
-	mainDeletionQueue.pushFunction([=]() {
-		vkDestroyRenderPass(device, renderPass, nullptr);
-	});
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDependency lateDependency{};
+	lateDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	lateDependency.dstSubpass = 0;
+	lateDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	lateDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	lateDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	lateDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	lateDependency.dependencyFlags = 0;
+
+	renderPassCreateInfo.dependencyCount = 1;
+	renderPassCreateInfo.pDependencies = &lateDependency;
+
+	VK_CHECK(vkCreateRenderPass(device, &renderPassCreateInfo, nullptr, &latePass));
+
+	mainDeletionQueue.pushRenderPass(renderPass);
+	mainDeletionQueue.pushRenderPass(latePass);
 }
 
 void VulkanEngine::initFramebuffers()
@@ -230,13 +291,125 @@ void VulkanEngine::initFramebuffers()
 
 		VK_CHECK(vkCreateFramebuffer(device, &fbInfo, nullptr, &framebuffers[i]));
 
-		mainDeletionQueue.pushFunction([=]() {
-			vkDestroyFramebuffer(device, framebuffers[i], nullptr);
-			vkDestroyImageView(device, swapchainImageViews[i], nullptr);
-		});
+		mainDeletionQueue.pushImageView(swapchainImageViews[i]);
+		mainDeletionQueue.pushFramebuffer(framebuffers[i]);
 	}
 }
 
+void VulkanEngine::initOffscreenTarget()
+{
+	if (offscreenLayers == 0)
+		return;
+
+	// The main view keeps a camera slot.
+	offscreenLayers = std::min(offscreenLayers, maxViews - 1);
+
+	VkExtent3D extent = { offscreenExtent.width, offscreenExtent.height, 1 };
+	VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+	VmaAllocationCreateInfo imageAllocInfo{};
+	imageAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	imageAllocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkImageCreateInfo colorInfo = vkinit::imageCreateInfo(colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, extent);
+	colorInfo.arrayLayers = offscreenLayers;
+	VK_CHECK(vmaCreateImage(allocator, &colorInfo, &imageAllocInfo, &offscreenColor.image, &offscreenColor.allocation, nullptr));
+
+	VkImageCreateInfo depthInfo = vkinit::imageCreateInfo(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, extent);
+	depthInfo.arrayLayers = offscreenLayers;
+	VK_CHECK(vmaCreateImage(allocator, &depthInfo, &imageAllocInfo, &offscreenDepth.image, &offscreenDepth.allocation, nullptr));
+
+	VkImageViewCreateInfo colorViewInfo = vkinit::imageViewCreateInfo(colorFormat, offscreenColor.image, VK_IMAGE_ASPECT_COLOR_BIT);
+	colorViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	colorViewInfo.subresourceRange.layerCount = offscreenLayers;
+	VK_CHECK(vkCreateImageView(device, &colorViewInfo, nullptr, &offscreenColorView));
+
+	VkImageViewCreateInfo depthViewInfo = vkinit::imageViewCreateInfo(depthFormat, offscreenDepth.image, VK_IMAGE_ASPECT_DEPTH_BIT);
+	depthViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	depthViewInfo.subresourceRange.layerCount = offscreenLayers;
+	VK_CHECK(vkCreateImageView(device, &depthViewInfo, nullptr, &offscreenDepthView));
+
+	// Color is left ready for sampling, depth is only needed during the pass.
+	VkAttachmentDescription attachments[2] = {};
+	attachments[0].format = colorFormat;
+	attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	attachments[1].format = depthFormat;
+	attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference colorRef = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	VkAttachmentReference depthRef = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorRef;
+	subpass.pDepthStencilAttachment = &depthRef;
+
+	// The previous frame's readers are done before the clear, this frame's
+	// wait for the pass.
+	VkSubpassDependency dependencies[2] = {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	// Every layer is drawn by each draw call, gl_ViewIndex picks the camera.
+	uint32_t viewMask = (1u << offscreenLayers) - 1;
+
+	VkRenderPassMultiviewCreateInfo multiviewInfo{};
+	multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+	multiviewInfo.subpassCount = 1;
+	multiviewInfo.pViewMasks = &viewMask;
+
+	VkRenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.pNext = &multiviewInfo;
+	renderPassInfo.attachmentCount = 2;
+	renderPassInfo.pAttachments = attachments;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = 2;
+	renderPassInfo.pDependencies = dependencies;
+
+	VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, nullptr, &offscreenPass));
+
+	VkImageView framebufferAttachments[2] = { offscreenColorView, offscreenDepthView };
+
+	VkFramebufferCreateInfo fbInfo = vkinit::framebufferCreateInfo(offscreenPass, offscreenExtent);
+	fbInfo.attachmentCount = 2;
+	fbInfo.pAttachments = framebufferAttachments;
+	VK_CHECK(vkCreateFramebuffer(device, &fbInfo, nullptr, &offscreenFramebuffer));
+
+	mainDeletionQueue.pushImage(offscreenColor);
+	mainDeletionQueue.pushImage(offscreenDepth);
+	mainDeletionQueue.pushImageView(offscreenColorView);
+	mainDeletionQueue.pushImageView(offscreenDepthView);
+	mainDeletionQueue.pushRenderPass(offscreenPass);
+	mainDeletionQueue.pushFramebuffer(offscreenFramebuffer);
+}
+
 void VulkanEngine::initSyncStructures()
 {
 	auto fenceInfo = vkinit::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
@@ -249,37 +422,24 @@ void VulkanEngine::initSyncStructures()
 		VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frames[i].presentSemaphore));
 		VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frames[i].renderSemaphore));
 
-		mainDeletionQueue.pushFunction([=]() {
-			vkDestroyFence(device, frames[i].renderFence, nullptr);
-
-			vkDestroySemaphore(device, frames[i].presentSemaphore, nullptr);
-			vkDestroySemaphore(device, frames[i].renderSemaphore, nullptr);
-		});
+		mainDeletionQueue.pushFence(frames[i].renderFence);
+		mainDeletionQueue.pushSemaphore(frames[i].presentSemaphore);
+		mainDeletionQueue.pushSemaphore(frames[i].renderSemaphore);
 	}
+
+	auto uploadFenceInfo = vkinit::fenceCreateInfo();
+	VK_CHECK(vkCreateFence(device, &uploadFenceInfo, nullptr, &uploadContext.uploadFence));
+
+	mainDeletionQueue.pushFence(uploadContext.uploadFence);
 }
 
 void VulkanEngine::initPipelines()
 {
-	// Loading shaders from files
-	VkShaderModule rtriangleFragShader;
-	if (!loadShaderModule("E:\\Code\\atlas\\x64\\Debug\\shaders\\rfrag.spv", &rtriangleFragShader))
-		std::cout << "Error when building frag shader module" << std::endl;
-	else
-		std::cout << "Frag shader module loaded" << std::endl;
-
-	VkShaderModule meshVertShader;
-	if (!loadShaderModule("E:\\Code\\atlas\\x64\\Debug\\shaders\\triMesh.spv", &meshVertShader))
-		std::cout << "Error when building triMesh shader module" << std::endl;
-	else
-		std::cout << "triMesh shader module loaded" << std::endl;
-	
 	VkPushConstantRange pushConstant;
 	pushConstant.offset = 0;
 	pushConstant.size = sizeof(MeshPushConstants);
 	pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-	VertexInputDescription vertexDescription = Vertex::getVertexDescription();
-	
 	VkPipelineLayoutCreateInfo meshPipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
 	meshPipelineLayoutInfo.pPushConstantRanges = &pushConstant;
 	meshPipelineLayoutInfo.pushConstantRangeCount = 1;
@@ -289,7 +449,8 @@ void VulkanEngine::initPipelines()
 
 	VK_CHECK(vkCreatePipelineLayout(device, &meshPipelineLayoutInfo, nullptr, &meshPipelineLayout));
 
-	PipelineBuilder pipelineBuilder;
+	PipelineDesc meshDesc;
+	PipelineBuilder& pipelineBuilder = meshDesc.builder;
 
 	pipelineBuilder.vertexInputInfo = vkinit::vertexInputStateCreateInfo();
 	pipelineBuilder.inputAssembly = vkinit::inputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
@@ -306,31 +467,35 @@ void VulkanEngine::initPipelines()
 	pipelineBuilder.multisampling = vkinit::multisampleStateCreateInfo();
 	pipelineBuilder.colorBlendAttachment = vkinit::colorBlendAttachmentState();
 	pipelineBuilder.depthStencil = vkinit::depthStencilCreateInfo(true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
-	pipelineBuilder.vertexInputInfo.pVertexAttributeDescriptions = vertexDescription.attributes.data();
-	pipelineBuilder.vertexInputInfo.vertexAttributeDescriptionCount = vertexDescription.attributes.size();
-	pipelineBuilder.pipelineLayout = meshPipelineLayout;
-	pipelineBuilder.vertexInputInfo.pVertexBindingDescriptions = vertexDescription.bindings.data();
-	pipelineBuilder.vertexInputInfo.vertexBindingDescriptionCount = vertexDescription.bindings.size();
-
-	pipelineBuilder.shaderStages.push_back(vkinit::pipelineShaderCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, meshVertShader));
-	pipelineBuilder.shaderStages.push_back(vkinit::pipelineShaderCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, rtriangleFragShader));
+	// Set per view when drawing
+	pipelineBuilder.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	meshDesc.vertexInput = Vertex::getVertexDescription();
+	meshDesc.renderPass = renderPass;
+	meshDesc.layout = meshPipelineLayout;
+	meshDesc.stages = {
+		{ VK_SHADER_STAGE_VERTEX_BIT, "triMesh.spv" },
+		{ VK_SHADER_STAGE_FRAGMENT_BIT, "rfrag.spv" }
+	};
 
-	meshPipeline = pipelineBuilder.buildPipeline(device, renderPass);
+	if (offscreenPass != VK_NULL_HANDLE)
+	{
+		PipelineDesc multiviewDesc = meshDesc;
+		multiviewDesc.renderPass = offscreenPass;
+		multiviewDesc.stages[0].path = "triMeshMultiview.spv";
+		meshMultiviewPipeline = shaders.addPipeline(std::move(multiviewDesc));
+	}
 
-	createMaterial(meshPipeline, meshPipelineLayout, "defaultmesh");
+	meshPipeline = shaders.addPipeline(std::move(meshDesc));
 
-	vkDestroyShaderModule(device, meshVertShader, nullptr);
-	vkDestroyShaderModule(device, rtriangleFragShader, nullptr);
-	mainDeletionQueue.pushFunction([=]() {
-		vkDestroyPipeline(device, meshPipeline, nullptr);
+	createMaterial(meshPipeline, meshPipelineLayout, assetID("defaultmesh"), meshMultiviewPipeline);
 
-		vkDestroyPipelineLayout(device, trianglePipelineLayot, nullptr);
-		vkDestroyPipelineLayout(device, meshPipelineLayout, nullptr);
-	});
+	mainDeletionQueue.pushPipelineLayout(meshPipelineLayout);
 }
 
 void VulkanEngine::loadMeshes()
 {
+	Mesh triangleMesh;
 	triangleMesh.vertices.resize(3);
 
 	triangleMesh.vertices[0].position = { 1.f, 1.f, 0.0f };
@@ -341,37 +506,40 @@ void VulkanEngine::loadMeshes()
 	triangleMesh.vertices[1].color = { 0.f, 1.f, 0.0f };
 	triangleMesh.vertices[2].color = { 0.f, 1.f, 0.0f };
 
-	monkeyMesh.loadFromOBJ("E:\\Code\\atlas\\assets\\monkey_smooth.obj", "E:\\Code\\atlas\\assets\\");
+	triangleMesh.indices = { 0, 1, 2 };
 
-	uploadMesh(triangleMesh);
-	uploadMesh(monkeyMesh);
+	triangleMesh.computeBounds();
+	triangleMesh.buildBVH();
 
-	meshes["monkey"] = monkeyMesh;
-	meshes["triangle"] = triangleMesh;
+	assets.addMesh(assetID("triangle"), std::move(triangleMesh));
+	assets.loadMesh(assetID("monkey"), "monkey_smooth.obj");
 }
 
 void VulkanEngine::initScene()
 {
-	RenderObject monkey;
-	monkey.mesh = getMesh("monkey");
-	monkey.material = getMaterial("defaultmesh");
-	monkey.transformMatrix = glm::mat4({ 1.f });
+	if (loadScene(scenePath))
+	{
+		spatialIndex.build(scene);
+		return;
+	}
 
-	renderables.push_back(monkey);
+	MeshHandle monkey = getMesh(assetID("monkey"));
+	MeshHandle triangle = getMesh(assetID("triangle"));
+	MaterialHandle defaultMaterial = getMaterial(assetID("defaultmesh"));
+
+	addRenderable(monkey, defaultMaterial, glm::mat4({ 1.f }), RENDER_VISIBLE | RENDER_STATIC);
 
 	for (int x = -20; x <= 20; x++) {
 		for (int y = -20; y <= 20; y++) {
 
-			RenderObject tri;
-			tri.mesh = getMesh("triangle");
-			tri.material = getMaterial("defaultmesh");
 			glm::mat4 translation = glm::translate(glm::mat4{ 1.0 }, glm::vec3(x, 0, y));
 			glm::mat4 scale = glm::scale(glm::mat4{ 1.0 }, glm::vec3(0.2, 0.2, 0.2));
-			tri.transformMatrix = translation * scale;
 
-			renderables.push_back(tri);
+			addRenderable(triangle, defaultMaterial, translation * scale, RENDER_VISIBLE | RENDER_STATIC);
 		}
 	}
+
+	spatialIndex.build(scene);
 }
 
 void VulkanEngine::initImGui()
@@ -383,20 +551,24 @@ void VulkanEngine::initDescriptors()
 {
 	std::vector<VkDescriptorPoolSize> sizes =
 	{
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10 }
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 10 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 20 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxPyramidLevels },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxPyramidLevels + 10 }
 	};
 
 	VkDescriptorPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.flags = 0;
-	poolInfo.maxSets = 10;
+	poolInfo.maxSets = 10 + maxPyramidLevels;
 	poolInfo.poolSizeCount = (uint32_t)sizes.size();
 	poolInfo.pPoolSizes = sizes.data();
 
 	VkDescriptorSetLayoutBinding camBufferBinding{};
 	camBufferBinding.binding = 0;
 	camBufferBinding.descriptorCount = 1;
-	camBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	camBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	camBufferBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
 	VkDescriptorSetLayoutCreateInfo descInfo{};
@@ -411,7 +583,9 @@ void VulkanEngine::initDescriptors()
 
 	for (int i = 0; i < frameOverlap; i++)
 	{
-		frames[i].camInfo = createBuffer(sizeof(GPUCameraData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		// One camera per slot. Draws bind their group's camera with a dynamic
+		// offset, so the range also covers the cameras of a multiview group.
+		frames[i].camInfo = createBuffer(2 * maxViews * cameraStride, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
 
 		VkDescriptorSetAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -425,7 +599,7 @@ void VulkanEngine::initDescriptors()
 		VkDescriptorBufferInfo bufferInfo;
 		bufferInfo.buffer = frames[i].camInfo.buffer;
 		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(GPUCameraData);
+		bufferInfo.range = maxViews * cameraStride;
 
 		VkWriteDescriptorSet setWrite{};
 		setWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -433,19 +607,219 @@ void VulkanEngine::initDescriptors()
 		setWrite.dstBinding = 0;
 		setWrite.dstSet = frames[i].globalDescriptor;
 		setWrite.descriptorCount = 1;
-		setWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		setWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		setWrite.pBufferInfo = &bufferInfo;
 
 		vkUpdateDescriptorSets(device, 1, &setWrite, 0, nullptr);
 	}
 
-	mainDeletionQueue.pushFunction([=] {
-		for (int i = 0; i < frameOverlap; i++)
-			vmaDestroyBuffer(allocator, frames[i].camInfo.buffer, frames[i].camInfo.allocation);
+	mainDeletionQueue.pushDescriptorPool(descriptorPool);
+	mainDeletionQueue.pushDescriptorSetLayout(globalSetLayout);
+
+	for (int i = 0; i < frameOverlap; i++)
+		mainDeletionQueue.pushBuffer(frames[i].camInfo);
+}
 
-		vkDestroyDescriptorSetLayout(device, globalSetLayout, nullptr);
-		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+void VulkanEngine::initOcclusionCulling()
+{
+	VkExtent3D pyramidExtent = { windowExtent.width, windowExtent.height, 1 };
+
+	depthPyramidLevels = 1;
+	while (depthPyramidLevels < maxPyramidLevels && (std::max(windowExtent.width, windowExtent.height) >> depthPyramidLevels) > 0)
+		depthPyramidLevels++;
+
+	VkImageCreateInfo pyramidInfo = vkinit::imageCreateInfo(VK_FORMAT_R32G32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, pyramidExtent);
+	pyramidInfo.mipLevels = depthPyramidLevels;
+
+	VmaAllocationCreateInfo pyramidAllocInfo{};
+	pyramidAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	pyramidAllocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VK_CHECK(vmaCreateImage(allocator, &pyramidInfo, &pyramidAllocInfo, &depthPyramid.image, &depthPyramid.allocation, nullptr));
+
+	VkImageViewCreateInfo pyramidViewInfo = vkinit::imageViewCreateInfo(VK_FORMAT_R32G32_SFLOAT, depthPyramid.image, VK_IMAGE_ASPECT_COLOR_BIT);
+	pyramidViewInfo.subresourceRange.levelCount = depthPyramidLevels;
+	VK_CHECK(vkCreateImageView(device, &pyramidViewInfo, nullptr, &depthPyramidView));
+
+	for (uint32_t i = 0; i < depthPyramidLevels; i++)
+	{
+		VkImageViewCreateInfo mipViewInfo = vkinit::imageViewCreateInfo(VK_FORMAT_R32G32_SFLOAT, depthPyramid.image, VK_IMAGE_ASPECT_COLOR_BIT);
+		mipViewInfo.subresourceRange.baseMipLevel = i;
+		VK_CHECK(vkCreateImageView(device, &mipViewInfo, nullptr, &depthPyramidMips[i]));
+	}
+
+	VkSamplerCreateInfo samplerInfo = vkinit::samplerCreateInfo(VK_FILTER_NEAREST);
+	VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &depthSampler));
+
+	visibilityBuffer = createBuffer(maxVisibilityEntries * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+
+	for (int i = 0; i < frameOverlap; i++)
+	{
+		frames[i].objectBuffer = createBuffer(maxCullObjects * sizeof(GPUObjectData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		frames[i].drawBuffer = createBuffer(maxDrawSections * maxCullObjects * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		frames[i].viewBuffer = createBuffer(sizeof(GPUViewData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+	}
+
+	// Everything counts as visible in the first frame, the pyramid stays in
+	// the general layout for its whole lifetime.
+	immediateSubmit([=](VkCommandBuffer cmd) {
+		vkCmdFillBuffer(cmd, visibilityBuffer.buffer, 0, VK_WHOLE_SIZE, 1);
+
+		VkImageMemoryBarrier pyramidBarrier = vkinit::imageBarrier(depthPyramid.image, 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &pyramidBarrier);
 	});
+
+	// Depth reduction, one descriptor set per pyramid level
+	VkDescriptorSetLayoutBinding reduceBindings[2] = {
+		vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1)
+	};
+
+	VkDescriptorSetLayoutCreateInfo reduceSetInfo{};
+	reduceSetInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	reduceSetInfo.bindingCount = 2;
+	reduceSetInfo.pBindings = reduceBindings;
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &reduceSetInfo, nullptr, &depthReduceSetLayout));
+
+	for (uint32_t i = 0; i < depthPyramidLevels; i++)
+	{
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &depthReduceSetLayout;
+		VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &depthReduceDescriptors[i]));
+
+		VkDescriptorImageInfo dstInfo{};
+		dstInfo.imageView = depthPyramidMips[i];
+		dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo srcInfo{};
+		srcInfo.sampler = depthSampler;
+		if (i == 0)
+		{
+			srcInfo.imageView = depthImageView;
+			srcInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		}
+		else
+		{
+			srcInfo.imageView = depthPyramidView;
+			srcInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+
+		VkWriteDescriptorSet writes[2] = {
+			vkinit::writeDescriptorImage(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, depthReduceDescriptors[i], &dstInfo, 0),
+			vkinit::writeDescriptorImage(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depthReduceDescriptors[i], &srcInfo, 1)
+		};
+		vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+	}
+
+	// Culling, one descriptor set per frame
+	VkDescriptorSetLayoutBinding cullBindings[5] = {
+		vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+		vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+		vkinit::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4)
+	};
+
+	VkDescriptorSetLayoutCreateInfo cullSetInfo{};
+	cullSetInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	cullSetInfo.bindingCount = 5;
+	cullSetInfo.pBindings = cullBindings;
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &cullSetInfo, nullptr, &cullSetLayout));
+
+	for (int i = 0; i < frameOverlap; i++)
+	{
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &cullSetLayout;
+		VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &frames[i].cullDescriptor));
+
+		VkDescriptorBufferInfo objectInfo{ frames[i].objectBuffer.buffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo drawInfo{ frames[i].drawBuffer.buffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo visibilityInfo{ visibilityBuffer.buffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo viewInfo{ frames[i].viewBuffer.buffer, 0, VK_WHOLE_SIZE };
+
+		VkDescriptorImageInfo pyramidInfo{};
+		pyramidInfo.sampler = depthSampler;
+		pyramidInfo.imageView = depthPyramidView;
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet writes[5] = {
+			vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frames[i].cullDescriptor, &objectInfo, 0),
+			vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frames[i].cullDescriptor, &drawInfo, 1),
+			vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frames[i].cullDescriptor, &visibilityInfo, 2),
+			vkinit::writeDescriptorImage(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frames[i].cullDescriptor, &pyramidInfo, 3),
+			vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frames[i].cullDescriptor, &viewInfo, 4)
+		};
+		vkUpdateDescriptorSets(device, 5, writes, 0, nullptr);
+	}
+
+	// Compute pipelines
+	VkPushConstantRange reducePushConstant;
+	reducePushConstant.offset = 0;
+	reducePushConstant.size = sizeof(DepthReducePushConstants);
+	reducePushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo reduceLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+	reduceLayoutInfo.setLayoutCount = 1;
+	reduceLayoutInfo.pSetLayouts = &depthReduceSetLayout;
+	reduceLayoutInfo.pushConstantRangeCount = 1;
+	reduceLayoutInfo.pPushConstantRanges = &reducePushConstant;
+	VK_CHECK(vkCreatePipelineLayout(device, &reduceLayoutInfo, nullptr, &depthReducePipelineLayout));
+
+	VkPushConstantRange cullPushConstant;
+	cullPushConstant.offset = 0;
+	cullPushConstant.size = sizeof(CullPushConstants);
+	cullPushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo cullLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+	cullLayoutInfo.setLayoutCount = 1;
+	cullLayoutInfo.pSetLayouts = &cullSetLayout;
+	cullLayoutInfo.pushConstantRangeCount = 1;
+	cullLayoutInfo.pPushConstantRanges = &cullPushConstant;
+	VK_CHECK(vkCreatePipelineLayout(device, &cullLayoutInfo, nullptr, &cullPipelineLayout));
+
+	PipelineDesc reduceDesc;
+	reduceDesc.layout = depthReducePipelineLayout;
+	reduceDesc.stages = { { VK_SHADER_STAGE_COMPUTE_BIT, "depthReduce.spv" } };
+	depthReducePipeline = shaders.addPipeline(std::move(reduceDesc));
+
+	PipelineDesc cullDesc;
+	cullDesc.layout = cullPipelineLayout;
+	cullDesc.stages = { { VK_SHADER_STAGE_COMPUTE_BIT, "cull.spv" } };
+	cullDesc.constants = { cullGroupSize };
+	cullPipeline = shaders.addPipeline(std::move(cullDesc));
+
+	if (shaders.getPipeline(cullPipeline) == VK_NULL_HANDLE || shaders.getPipeline(depthReducePipeline) == VK_NULL_HANDLE)
+	{
+		std::cout << "Occlusion culling pipelines failed to build, culling disabled" << std::endl;
+		occlusionCulling = false;
+	}
+
+	mainDeletionQueue.pushImage(depthPyramid);
+	mainDeletionQueue.pushImageView(depthPyramidView);
+	for (uint32_t i = 0; i < depthPyramidLevels; i++)
+		mainDeletionQueue.pushImageView(depthPyramidMips[i]);
+
+	mainDeletionQueue.pushSampler(depthSampler);
+	mainDeletionQueue.pushBuffer(visibilityBuffer);
+
+	for (int i = 0; i < frameOverlap; i++)
+	{
+		mainDeletionQueue.pushBuffer(frames[i].objectBuffer);
+		mainDeletionQueue.pushBuffer(frames[i].drawBuffer);
+		mainDeletionQueue.pushBuffer(frames[i].viewBuffer);
+	}
+
+	mainDeletionQueue.pushDescriptorSetLayout(depthReduceSetLayout);
+	mainDeletionQueue.pushDescriptorSetLayout(cullSetLayout);
+	mainDeletionQueue.pushPipelineLayout(depthReducePipelineLayout);
+	mainDeletionQueue.pushPipelineLayout(cullPipelineLayout);
 }
 
 AllocatedBuffer VulkanEngine::createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage)
@@ -468,60 +842,56 @@ AllocatedBuffer VulkanEngine::createBuffer(size_t allocSize, VkBufferUsageFlags
 
 void VulkanEngine::uploadMesh(Mesh& mesh)
 {
-	VkBufferCreateInfo bufferInfo{};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.pNext = nullptr;
-	bufferInfo.size = mesh.vertices.size() * sizeof(Vertex);
-	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-
-	VmaAllocationCreateInfo vmaallocInfo = {};
-	vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
-
-	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaallocInfo,
-		&mesh.vertexBuffer.buffer,
-		&mesh.vertexBuffer.allocation,
-		nullptr));
+	uint64_t completed = completedSequence.load(std::memory_order_acquire);
+	size_t vertexSize = mesh.vertices.size() * sizeof(Vertex);
+	size_t indexSize = mesh.indices.size() * sizeof(uint32_t);
 
-	//add the destruction of triangle mesh buffer to the deletion queue
-	mainDeletionQueue.pushFunction([=]() {
-		vmaDestroyBuffer(allocator, mesh.vertexBuffer.buffer, mesh.vertexBuffer.allocation);
-	});
+	VK_CHECK(meshBuffers.acquire(vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, completed, mesh.vertexBuffer));
+	VK_CHECK(meshBuffers.acquire(indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, completed, mesh.indexBuffer));
 
 	//copy vertex data
 	void* data;
 	vmaMapMemory(allocator, mesh.vertexBuffer.allocation, &data);
 
-	memcpy(data, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+	memcpy(data, mesh.vertices.data(), vertexSize);
 
 	vmaUnmapMemory(allocator, mesh.vertexBuffer.allocation);
+
+	vmaMapMemory(allocator, mesh.indexBuffer.allocation, &data);
+
+	memcpy(data, mesh.indices.data(), indexSize);
+
+	vmaUnmapMemory(allocator, mesh.indexBuffer.allocation);
 }
 
-bool VulkanEngine::loadShaderModule(const char* filePath, VkShaderModule* outShaderModule)
+void VulkanEngine::immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function)
 {
-	std::ifstream file(filePath, std::ios::ate | std::ios::binary);
+	VkCommandBuffer cmd = uploadContext.commandBuffer;
 
-	if (!file.is_open())
-		return false;
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.pNext = nullptr;
+	beginInfo.pInheritanceInfo = nullptr;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
-	file.seekg(0);
-	file.read((char*)buffer.data(), fileSize);
-	file.close();
+	VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
 
-	VkShaderModuleCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.pNext = nullptr;
+	function(cmd);
 
-	createInfo.codeSize = buffer.size() * sizeof(uint32_t);
-	createInfo.pCode = buffer.data();
+	VK_CHECK(vkEndCommandBuffer(cmd));
 
-	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
-		return false;
+	VkSubmitInfo submit{};
+	submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit.pNext = nullptr;
+	submit.commandBufferCount = 1;
+	submit.pCommandBuffers = &cmd;
 
-	*outShaderModule = shaderModule;
-	return true;
+	VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, uploadContext.uploadFence));
+
+	vkWaitForFences(device, 1, &uploadContext.uploadFence, true, UINT64_MAX);
+	vkResetFences(device, 1, &uploadContext.uploadFence);
+
+	vkResetCommandPool(device, uploadContext.commandPool, 0);
 }
 
 FrameData& VulkanEngine::getCurrentFrame()
@@ -529,89 +899,357 @@ FrameData& VulkanEngine::getCurrentFrame()
 	return frames[frameNumber % frameOverlap];
 }
 
-Material* VulkanEngine::createMaterial(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name)
+MaterialHandle VulkanEngine::createMaterial(PipelineID pipeline, VkPipelineLayout layout, AssetID id, PipelineID multiviewPipeline)
 {
 	Material mat;
-	mat.pipeline = pipeline;
+	mat.pipeline = shaders.getPipeline(pipeline);
 	mat.pipelineLayout = layout;
-	materials[name] = mat;
-	
-	return &materials[name];
+	mat.shaderPipeline = pipeline;
+	mat.multiviewPipeline = shaders.getPipeline(multiviewPipeline);
+	mat.shaderMultiviewPipeline = multiviewPipeline;
+
+	MaterialHandle handle = materials.add(std::move(mat));
+	materialsById[id] = handle;
+
+	return handle;
 }
 
-Material* VulkanEngine::getMaterial(const std::string& name)
+void VulkanEngine::refreshPipelines()
 {
-	auto it = materials.find(name);
-	if (it == materials.end())
-		return nullptr;
+	materials.forEach([&](MaterialHandle, Material& material) {
+		material.pipeline = shaders.getPipeline(material.shaderPipeline);
+		material.multiviewPipeline = shaders.getPipeline(material.shaderMultiviewPipeline);
+	});
+
+	// Static draws hold pipelines too, force a rebuild.
+	staticSceneVersion = 0;
+}
+
+MaterialHandle VulkanEngine::getMaterial(AssetID id)
+{
+	auto it = materialsById.find(id);
+	if (it == materialsById.end())
+		return MaterialHandle();
 	else
-		return &(*it).second;
+		return it->second;
+}
+
+MeshHandle VulkanEngine::getMesh(AssetID id)
+{
+	return assets.getMesh(id);
 }
 
-Mesh* VulkanEngine::getMesh(const std::string& name)
+RenderableHandle VulkanEngine::addRenderable(MeshHandle mesh, MaterialHandle material, const glm::mat4& transform, uint32_t flags)
 {
-	auto it = meshes.find(name);
-	if (it == meshes.end())
-		return nullptr;
+	const Mesh* meshData = meshes.get(mesh);
+	if (!meshData || !materials.contains(material))
+		return RenderableHandle();
+
+	RenderableHandle handle = scene.add(mesh, material, transform, meshData->bounds, flags);
+	if (assets.isReady(mesh))
+		spatialIndex.insert(handle);
 	else
-		return &(*it).second;
+		waitingRenderables.push_back(handle);
+
+	return handle;
 }
 
-void VulkanEngine::drawObjects(VkCommandBuffer cmd, RenderObject* first, int count)
+bool VulkanEngine::loadScene(const std::string& path)
 {
-	glm::mat4 projection = glm::perspective(glm::radians(70.f), static_cast<float>(windowExtent.width) / static_cast<float>(windowExtent.height), 0.1f, 200.0f);
-	projection[1][1] *= -1;
-	glm::mat4 view = cam.getView();
+	SceneFile file;
+	if (!file.open(assets.resolvePath(path).c_str()))
+		return false;
 
-	GPUCameraData camData;
-	camData.proj = projection;
-	camData.view = view;
-	camData.viewproj = projection * view;
+	std::vector<MaterialHandle> sceneMaterials(file.getMaterialCount());
+	for (uint32_t i = 0; i < file.getMaterialCount(); i++)
+	{
+		sceneMaterials[i] = getMaterial(assetID(file.getMaterialName(i)));
+		if (!sceneMaterials[i].isValid())
+		{
+			std::cout << "Scene " << path << " uses unknown material " << file.getMaterialName(i) << std::endl;
+			return false;
+		}
+	}
 
-	void* data;
-	vmaMapMemory(allocator, getCurrentFrame().camInfo.allocation, &data);
-	memcpy(data, &camData, sizeof(GPUCameraData));
-	vmaUnmapMemory(allocator, getCurrentFrame().camInfo.allocation);
+	// Loading meshes have empty bounds until addWaitingRenderables().
+	std::vector<MeshHandle> sceneMeshes(file.getMeshCount());
+	std::vector<AABB> meshBounds(file.getMeshCount());
+	std::vector<uint8_t> meshReady(file.getMeshCount());
+	for (uint32_t i = 0; i < file.getMeshCount(); i++)
+	{
+		std::string meshPath = file.getMeshPath(i);
+		sceneMeshes[i] = assets.loadMesh(assetID(meshPath), meshPath);
+		meshBounds[i] = meshes[sceneMeshes[i]].bounds;
+		meshReady[i] = assets.isReady(sceneMeshes[i]);
+	}
 
-	Mesh* lastMesh = nullptr;
-	Material* lastMaterial = nullptr;
+	RenderBatch batch;
+	batch.count = file.getObjectCount();
+	batch.transforms = file.transforms;
+	batch.meshIndices = file.meshIndices;
+	batch.materialIndices = file.materialIndices;
+	batch.flags = file.flags;
+	batch.meshes = sceneMeshes.data();
+	batch.meshBounds = meshBounds.data();
+	batch.materials = sceneMaterials.data();
 
-	for (int i = 0; i < count; i++)
+	uint32_t first = scene.addBatch(batch);
+
+	for (uint32_t i = 0; i < batch.count; i++)
 	{
-		RenderObject& object = first[i];
+		RenderableHandle handle = scene.handles[first + i];
+		if (meshReady[file.meshIndices[i]])
+			spatialIndex.insert(handle);
+		else
+			waitingRenderables.push_back(handle);
+	}
+
+	return true;
+}
 
-		if (object.material != lastMaterial)
+void VulkanEngine::addWaitingRenderables()
+{
+	for (size_t i = 0; i < waitingRenderables.size();)
+	{
+		RenderableHandle handle = waitingRenderables[i];
+		bool alive = scene.contains(handle);
+		MeshHandle mesh = alive ? scene.meshIds[scene.indexOf(handle)] : MeshHandle();
+
+		if (alive && !assets.isReady(mesh))
 		{
-			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, object.material->pipeline);
-			lastMaterial = object.material;
+			i++;
+			continue;
+		}
 
-			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, object.material->pipelineLayout, 0, 1, &getCurrentFrame().globalDescriptor, 0, nullptr);
+		if (alive)
+		{
+			scene.setLocalBounds(handle, meshes[mesh].bounds);
+			spatialIndex.insert(handle);
 		}
 
-		glm::mat4 model = object.transformMatrix;
-		glm::mat4 model2 = glm::rotate(object.transformMatrix, glm::radians(frameNumber * 0.4f), glm::vec3(0, 1, 0));
+		waitingRenderables[i] = waitingRenderables.back();
+		waitingRenderables.pop_back();
+	}
+}
+
+void VulkanEngine::removeRenderable(RenderableHandle handle)
+{
+	spatialIndex.remove(handle);
+	scene.remove(handle);
+}
+
+void VulkanEngine::unloadMesh(MeshHandle handle)
+{
+	Mesh* mesh = meshes.get(handle);
+	if (!mesh)
+		return;
+
+	// Snapshots up to the last published one may still draw the mesh.
+	if (!meshBuffers.release(mesh->vertexBuffer, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, snapshotSequence))
+		retireBuffer(mesh->vertexBuffer);
+	if (!meshBuffers.release(mesh->indexBuffer, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, snapshotSequence))
+		retireBuffer(mesh->indexBuffer);
+
+	meshes.remove(handle);
+}
+
+void VulkanEngine::retireBuffer(AllocatedBuffer buffer)
+{
+	retiredResources.pushBuffer(buffer);
+}
+
+void VulkanEngine::setTransform(RenderableHandle handle, const glm::mat4& transform)
+{
+	scene.setTransform(handle, transform);
+	spatialIndex.update(handle);
+}
+
+// Indirect command section a group draws from, the main view has two.
+static uint32_t groupSection(uint32_t group)
+{
+	return group == 0 ? 0 : group + 1;
+}
+
+void VulkanEngine::writeCullData(const DrawItem* items, uint32_t count, uint32_t firstObject, uint32_t sectionCount)
+{
+	FrameData& frame = getCurrentFrame();
+
+	void* objectData;
+	vmaMapMemory(allocator, frame.objectBuffer.allocation, &objectData);
+	GPUObjectData* objects = static_cast<GPUObjectData*>(objectData);
+
+	void* drawData;
+	vmaMapMemory(allocator, frame.drawBuffer.allocation, &drawData);
+	VkDrawIndexedIndirectCommand* draws = static_cast<VkDrawIndexedIndirectCommand*>(drawData);
+
+	objects += firstObject;
+	draws += firstObject;
+
+	jobs.parallelFor(count, 1024, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const DrawItem& item = items[i];
+
+			objects[i].boundsMin = glm::vec4(item.bounds.min, 0.f);
+			objects[i].boundsMax = glm::vec4(item.bounds.max, 0.f);
+			objects[i].visibilityIndex = item.visibilityIndex;
+			objects[i].viewMask = item.viewMask;
+
+			// instanceCount is filled in by the cull shader
+			VkDrawIndexedIndirectCommand command{};
+			command.indexCount = item.indexCount;
+			command.instanceCount = 1;
+			command.firstIndex = 0;
+			command.vertexOffset = 0;
+			command.firstInstance = 0;
+
+			for (uint32_t section = 0; section < sectionCount; section++)
+				draws[section * maxCullObjects + i] = command;
+		}
+	});
+
+	vmaUnmapMemory(allocator, frame.drawBuffer.allocation);
+	vmaUnmapMemory(allocator, frame.objectBuffer.allocation);
+}
+
+void VulkanEngine::dispatchCull(VkCommandBuffer cmd, const FrameSnapshot& snapshot, uint32_t cullCount, bool latePass)
+{
+	CullPushConstants constants;
+	constants.pyramidViewport = snapshot.pyramidViewport;
+	constants.pyramidSize = glm::vec2(static_cast<float>(windowExtent.width), static_cast<float>(windowExtent.height));
+	constants.objectCount = cullCount;
+	constants.latePass = latePass ? 1 : 0;
+	constants.drawStride = maxCullObjects;
+	constants.pyramidLevels = depthPyramidLevels;
+	constants.groupCount = snapshot.groupCount;
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, snapshot.cullPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &getCurrentFrame().cullDescriptor, 0, nullptr);
+	vkCmdPushConstants(cmd, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &constants);
+	vkCmdDispatch(cmd, (cullCount + cullGroupSize - 1) / cullGroupSize, 1, 1);
+
+	VkBufferMemoryBarrier barriers[2] = {
+		vkinit::bufferBarrier(getCurrentFrame().drawBuffer.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT),
+		vkinit::bufferBarrier(visibilityBuffer.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 2, barriers, 0, nullptr);
+}
+
+void VulkanEngine::buildDepthPyramid(VkCommandBuffer cmd, const FrameSnapshot& snapshot)
+{
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, snapshot.depthReducePipeline);
+
+	glm::ivec2 srcSize = glm::ivec2(windowExtent.width, windowExtent.height);
 
-		glm::mat4 meshMatrix = projection * view * model;
-		
+	for (uint32_t i = 0; i < depthPyramidLevels; i++)
+	{
+		DepthReducePushConstants constants;
+		constants.srcSize = srcSize;
+		constants.dstSize = i == 0 ? srcSize : glm::ivec2(std::max(srcSize.x / 2, 1), std::max(srcSize.y / 2, 1));
+		constants.srcLod = i == 0 ? 0 : i - 1;
+		constants.fromDepth = i == 0 ? 1 : 0;
+
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipelineLayout, 0, 1, &depthReduceDescriptors[i], 0, nullptr);
+		vkCmdPushConstants(cmd, depthReducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthReducePushConstants), &constants);
+		vkCmdDispatch(cmd, (constants.dstSize.x + 7) / 8, (constants.dstSize.y + 7) / 8, 1);
+
+		VkImageMemoryBarrier barrier = vkinit::imageBarrier(depthPyramid.image, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		srcSize = constants.dstSize;
+	}
+}
+
+void VulkanEngine::drawObjects(VkCommandBuffer cmd, const DrawGroup& group, uint32_t section, const DrawItem* items, uint32_t count, uint32_t firstDraw, uint32_t cullCount)
+{
+	VkBuffer drawBuffer = getCurrentFrame().drawBuffer.buffer;
+	VkDeviceSize drawOffset = section * maxCullObjects + firstDraw;
+	if (section == 1)
+		count = cullCount;
+
+	bool multiview = group.target == VIEW_OFFSCREEN;
+	uint32_t cameraOffset = group.cameraSlot * cameraStride;
+
+	vkCmdSetViewport(cmd, 0, 1, &group.viewport);
+	vkCmdSetScissor(cmd, 0, 1, &group.scissor);
+
+	// Extra swapchain views draw over the main view after the late pass, so
+	// they start from a cleared rect of their own.
+	if (group.target == VIEW_SWAPCHAIN && section > 1)
+	{
+		VkClearAttachment clears[2] = {};
+		clears[0].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		clears[0].colorAttachment = 0;
+		clears[0].clearValue.color = { { 0.f, 0.f, 0.f, 1.f } };
+		clears[1].aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		clears[1].clearValue.depthStencil.depth = 1.f;
+
+		VkClearRect rect{};
+		rect.rect = group.scissor;
+		rect.baseArrayLayer = 0;
+		rect.layerCount = 1;
+
+		vkCmdClearAttachments(cmd, 2, clears, 1, &rect);
+	}
+
+	VkPipeline lastPipeline = VK_NULL_HANDLE;
+	VkBuffer lastVertexBuffer = VK_NULL_HANDLE;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const DrawItem& item = items[i];
+		VkPipeline pipeline = multiview ? item.multiviewPipeline : item.pipeline;
+
+		if (pipeline == VK_NULL_HANDLE || (i >= cullCount && (item.viewMask & group.viewMask) == 0))
+			continue;
+
+		if (pipeline != lastPipeline)
+		{
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			lastPipeline = pipeline;
+
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, item.pipelineLayout, 0, 1, &getCurrentFrame().globalDescriptor, 1, &cameraOffset);
+		}
 
 		MeshPushConstants constants;
-		constants.renderMatrix = object.transformMatrix;
+		constants.renderMatrix = item.transform;
 
-		vkCmdPushConstants(cmd, object.material->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
+		vkCmdPushConstants(cmd, item.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
 
-		if (object.mesh != lastMesh)
+		if (item.vertexBuffer != lastVertexBuffer)
 		{
 			VkDeviceSize offset = 0;
-			vkCmdBindVertexBuffers(cmd, 0, 1, &object.mesh->vertexBuffer.buffer, &offset);
-			lastMesh = object.mesh;
+			vkCmdBindVertexBuffers(cmd, 0, 1, &item.vertexBuffer, &offset);
+			vkCmdBindIndexBuffer(cmd, item.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			lastVertexBuffer = item.vertexBuffer;
 		}
 
-		vkCmdDraw(cmd, object.mesh->vertices.size(), 1, 0, 0);
+		if (i < cullCount)
+			vkCmdDrawIndexedIndirect(cmd, drawBuffer, (drawOffset + i) * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+		else
+			vkCmdDrawIndexed(cmd, item.indexCount, 1, 0, 0, 0);
 	}
 }
 
+void VulkanEngine::recordDraws(VkCommandBuffer cmd, VkCommandBufferUsageFlags usage, const DrawGroup& group, uint32_t section, const DrawItem* items, uint32_t count, uint32_t firstDraw, uint32_t cullCount)
+{
+	// Both swapchain passes use compatible render passes, the framebuffer is
+	// left open so the buffer works with every swapchain image. Only the main
+	// view's early draws run in the first one.
+	VkRenderPass pass = group.target == VIEW_OFFSCREEN ? offscreenPass : (section == 0 ? renderPass : latePass);
+	VkCommandBufferInheritanceInfo inheritanceInfo = vkinit::commandBufferInheritanceInfo(pass, 0);
+	VkCommandBufferBeginInfo beginInfo = vkinit::commandBufferBeginInfo(usage | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, &inheritanceInfo);
+
+	VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+	drawObjects(cmd, group, section, items, count, firstDraw, cullCount);
+	VK_CHECK(vkEndCommandBuffer(cmd));
+}
+
 void VulkanEngine::init()
 {
+	jobs.init();
+
 	SDL_Init(SDL_INIT_VIDEO);
 
 	SDL_WindowFlags windowFlags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
@@ -625,25 +1263,56 @@ void VulkanEngine::init()
 		windowFlags
 	);
 
-	SDL_SetRelativeMouseMode(SDL_TRUE);
+	// Replays don't take the mouse, live input is ignored anyway.
+	if (replayPath.empty())
+		SDL_SetRelativeMouseMode(SDL_TRUE);
 
 	initVulkan();
+	meshBuffers.init(allocator, 256 << 20);
 	initSwapchain();
 	initRenderpass();
 	initFramebuffers();
+	initOffscreenTarget();
 	initCommands();
 	initSyncStructures();
 	initDescriptors();
+	assets.init(this, &jobs, assetRoot);
+	world.init(this, &jobs, assets.resolvePath(worldRoot));
+	shaders.init(this, &jobs, assets.resolvePath(shaderRoot));
 	initPipelines();
+	initOcclusionCulling();
 	loadMeshes();
 	initScene();
 	
 	cam.init(&input);
-	audio.init();
-
+	views.insert(views.begin(), RenderView());
+	views[0].camera = &cam;
+	if (!cameraPathFile.empty() && camPath.load(cameraPathFile.c_str()))
+		camPath.play();
+	audio.init(audioOutput);
+
+	audioOcclusion.init(&jobs, [this](glm::vec3 from, glm::vec3 to) {
+		glm::vec3 path = to - from;
+		float distance = glm::length(path);
+		if (distance < 0.01f)
+			return false;
+
+		// Stops a little short, so the object an emitter sits on doesn't
+		// block it.
+		Ray ray;
+		ray.origin = from;
+		ray.direction = path / distance;
+		ray.tMax = distance * 0.98f;
+
+		RaycastHit hit;
+		return spatialIndex.raycast(scene, ray, hit, &meshes);
+	});
 
-	s.loadSound((char*)"E:\\Code\\atlas\\assets\\newtankog.wav");
-	s.play();
+	// Decoded in the background, playback starts once the first chunks are in.
+	std::string soundPath = assets.resolvePath("newtankog.wav");
+	music.open(soundPath.c_str());
+	audio.addStream(&music);
+	audio.playStream(&music);
 
 	isInitialized = true;
 }
@@ -652,11 +1321,31 @@ void VulkanEngine::cleanup()
 {
 	if (isInitialized)
 	{
+		audio.removeStream(&music);
+		audio.finish();
+		music.close();
 		audio.cleanup();
+		world.cleanup();
+		assets.cleanup();
 		for(int i = 0; i < frameOverlap; i++)
 			vkWaitForFences(device, 1, &frames[i].renderFence, true, UINT64_MAX);
 
-		mainDeletionQueue.flush();
+		for (int i = 0; i < frameOverlap; i++)
+			frames[i].deletionQueue.flush(device, allocator);
+
+		for (uint32_t i = 0; i < 3; i++)
+			snapshots.slot(i).retired.flush(device, allocator);
+		retiredResources.flush(device, allocator);
+
+		shaders.cleanup();
+
+		meshes.forEach([&](MeshHandle, Mesh& mesh) {
+			vmaDestroyBuffer(allocator, mesh.vertexBuffer.buffer, mesh.vertexBuffer.allocation);
+			vmaDestroyBuffer(allocator, mesh.indexBuffer.buffer, mesh.indexBuffer.allocation);
+		});
+		meshBuffers.cleanup();
+
+		mainDeletionQueue.flush(device, allocator);
 
 		vkDestroySurfaceKHR(instance, surface, nullptr);
 		vkDestroyDevice(device, nullptr);
@@ -664,32 +1353,381 @@ void VulkanEngine::cleanup()
 		vkDestroyInstance(instance, nullptr);
 		SDL_DestroyWindow(window);
 	}
+
+	jobs.cleanup();
 }
 
-void VulkanEngine::draw()
+void VulkanEngine::tick(float dt)
 {
-	//audio.setListenerPos(cam.getPos());
-	
-	s.setPos(cam.getPos());
+	scene.beginTick();
+
+	input.onFrame();
+
+	if (camPath.isPlaying() && camPath.clock == PATH_TIME)
+	{
+		camPath.advance(dt);
+		followCameraPath(true);
+	}
+	else if (!camPath.isPlaying())
+	{
+		cam.update(dt);
+	}
+}
+
+void VulkanEngine::followCameraPath(bool interpolate)
+{
+	if (camPath.hasPos())
+		cam.updatePos(camPath.getPos(), interpolate);
+	if (camPath.hasRot())
+		cam.updateDir(camPath.getRot());
+}
+
+static GPUCameraData viewCamera(Camera& camera, float fov, float aspect, float alpha)
+{
+	GPUCameraData data;
+	data.proj = glm::perspective(glm::radians(fov), aspect, 0.1f, 200.0f);
+	data.proj[1][1] *= -1;
+	data.view = camera.getView(alpha);
+	data.viewproj = data.proj * data.view;
+	return data;
+}
+
+void VulkanEngine::buildViews(FrameSnapshot& snapshot, float alpha)
+{
+	snapshot.cameraCount = 0;
+	snapshot.groupCount = 0;
+	snapshot.pyramidViewport = glm::vec4(0.f, 0.f, 1.f, 1.f);
+
+	// Swapchain views take the first slots, the main view first, offscreen
+	// layers follow in layer order.
+	uint32_t layers = offscreenPass != VK_NULL_HANDLE ? offscreenLayers : 0;
+	const RenderView* layerViews[maxViews] = {};
+	bool hasOffscreen = false;
+
+	for (const RenderView& view : views)
+	{
+		if (view.active && view.camera && view.target == VIEW_OFFSCREEN && view.layer < layers && !layerViews[view.layer])
+		{
+			layerViews[view.layer] = &view;
+			hasOffscreen = true;
+		}
+	}
+
+	uint32_t swapchainSlots = hasOffscreen ? maxViews - layers : maxViews;
+
+	for (const RenderView& view : views)
+	{
+		if (!view.active || !view.camera || view.target != VIEW_SWAPCHAIN || snapshot.cameraCount >= swapchainSlots)
+			continue;
+
+		glm::vec4 rect = glm::clamp(view.viewport, glm::vec4(0.f), glm::vec4(1.f));
+		VkRect2D scissor;
+		scissor.offset.x = static_cast<int32_t>(rect.x * windowExtent.width);
+		scissor.offset.y = static_cast<int32_t>(rect.y * windowExtent.height);
+		scissor.extent.width = std::max(static_cast<uint32_t>(rect.z * windowExtent.width), 1u);
+		scissor.extent.height = std::max(static_cast<uint32_t>(rect.w * windowExtent.height), 1u);
+
+		uint32_t slot = snapshot.cameraCount++;
+		snapshot.cameras[slot] = viewCamera(*view.camera, view.fov, static_cast<float>(scissor.extent.width) / static_cast<float>(scissor.extent.height), alpha);
+
+		DrawGroup& group = snapshot.groups[snapshot.groupCount++];
+		group.target = VIEW_SWAPCHAIN;
+		group.viewMask = 1u << slot;
+		group.cameraSlot = slot;
+		group.viewport = { static_cast<float>(scissor.offset.x), static_cast<float>(scissor.offset.y), static_cast<float>(scissor.extent.width), static_cast<float>(scissor.extent.height), 0.f, 1.f };
+		group.scissor = scissor;
+
+		if (slot == 0)
+			snapshot.pyramidViewport = rect;
+	}
+
+	// Culling needs a main view.
+	if (!hasOffscreen || snapshot.cameraCount == 0)
+		return;
+
+	DrawGroup& group = snapshot.groups[snapshot.groupCount++];
+	group.target = VIEW_OFFSCREEN;
+	group.viewMask = 0;
+	group.cameraSlot = snapshot.cameraCount;
+	group.viewport = { 0.f, 0.f, static_cast<float>(offscreenExtent.width), static_cast<float>(offscreenExtent.height), 0.f, 1.f };
+	group.scissor = { { 0, 0 }, offscreenExtent };
+
+	// Every layer is drawn, layers without a view get a camera that clips
+	// everything away.
+	float aspect = static_cast<float>(offscreenExtent.width) / static_cast<float>(offscreenExtent.height);
+	for (uint32_t layer = 0; layer < layers; layer++)
+	{
+		uint32_t slot = snapshot.cameraCount++;
+		if (layerViews[layer])
+		{
+			snapshot.cameras[slot] = viewCamera(*layerViews[layer]->camera, layerViews[layer]->fov, aspect, alpha);
+			group.viewMask |= 1u << slot;
+		}
+		else
+		{
+			snapshot.cameras[slot] = { glm::mat4(0.f), glm::mat4(0.f), glm::mat4(0.f) };
+		}
+	}
+}
+
+void VulkanEngine::buildSnapshot(FrameSnapshot& snapshot, float alpha)
+{
+	snapshot.sequence = ++snapshotSequence;
+	buildViews(snapshot, alpha);
+	snapshot.occlusionCulling = occlusionCulling;
+	snapshot.cullPipeline = shaders.getPipeline(cullPipeline);
+	snapshot.depthReducePipeline = shaders.getPipeline(depthReducePipeline);
+
+	spatialIndex.commit(scene);
+	updateStaticDraws();
+
+	snapshot.staticDraws = staticDraws;
+	snapshot.staticVersion = staticDrawsVersion;
 
-	VK_CHECK(vkWaitForFences(device, 1, &getCurrentFrame().renderFence, VK_TRUE, UINT64_MAX));
-	VK_CHECK(vkResetFences(device, 1, &getCurrentFrame().renderFence));
+	// Objects are gathered once for all views, each remembers which views
+	// it touches.
+	visibleObjects.clear();
+	objectViewMasks.resize(scene.size(), 0);
 
-	VK_CHECK(vkResetCommandBuffer(getCurrentFrame().mainCommandBuffer, 0));
+	for (uint32_t slot = 0; slot < snapshot.cameraCount; slot++)
+	{
+		if (snapshot.cameras[slot].viewproj == glm::mat4(0.f))
+			continue;
+
+		viewObjects.clear();
+		spatialIndex.queryFrustum(scene, Frustum::fromMatrix(snapshot.cameras[slot].viewproj), viewObjects);
+
+		for (uint32_t index : viewObjects)
+		{
+			if (objectViewMasks[index] == 0)
+				visibleObjects.push_back(index);
+			objectViewMasks[index] |= 1u << slot;
+		}
+	}
+
+	if (staticDrawsActive)
+	{
+		visibleObjects.erase(std::remove_if(visibleObjects.begin(), visibleObjects.end(), [&](uint32_t index) {
+			bool isStatic = (scene.flags[index] & RENDER_STATIC) != 0;
+			if (isStatic)
+				objectViewMasks[index] = 0;
+			return isStatic;
+		}), visibleObjects.end());
+	}
+
+	snapshot.draws.resize(visibleObjects.size());
+	jobs.parallelFor(static_cast<uint32_t>(visibleObjects.size()), 1024, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+		{
+			uint32_t index = visibleObjects[i];
+			uint32_t slot = scene.handles[index].index();
+			const Mesh& mesh = meshes[scene.meshIds[index]];
+			const Material& material = materials[scene.materialIds[index]];
+
+			DrawItem& item = snapshot.draws[i];
+			item.transform = scene.interpolatedTransform(index, alpha);
+			item.bounds = scene.bounds[index];
+			item.vertexBuffer = mesh.vertexBuffer.buffer;
+			item.indexBuffer = mesh.indexBuffer.buffer;
+			item.indexCount = static_cast<uint32_t>(mesh.indices.size());
+			item.visibilityIndex = slot < maxVisibilityEntries ? slot : noVisibilityEntry;
+			item.viewMask = objectViewMasks[index];
+			item.pipeline = material.pipeline;
+			item.multiviewPipeline = material.multiviewPipeline;
+			item.pipelineLayout = material.pipelineLayout;
+		}
+	});
+
+	for (size_t i = 0; i < visibleObjects.size(); i++)
+		objectViewMasks[visibleObjects[i]] = 0;
+
+	// A slot that was never rendered still holds its retired resources, so
+	// this appends rather than replaces.
+	snapshot.retired.append(retiredResources);
+}
+
+void VulkanEngine::updateStaticDraws()
+{
+	if (staticDraws && staticSceneVersion == scene.staticVersion && staticDrawsCulled == occlusionCulling)
+		return;
+
+	staticSceneVersion = scene.staticVersion;
+	staticDrawsCulled = occlusionCulling;
+	staticDrawsVersion++;
+
+	std::shared_ptr<std::vector<DrawItem>> draws = std::make_shared<std::vector<DrawItem>>();
+	staticDrawsActive = false;
+
+	// Without the cull shader static objects would skip frustum culling.
+	if (occlusionCulling)
+	{
+		std::vector<uint32_t> indices;
+		for (uint32_t i = 0; i < scene.size(); i++)
+			if ((scene.flags[i] & RENDER_STATIC) && (scene.flags[i] & RENDER_VISIBLE) && assets.isReady(scene.meshIds[i]))
+				indices.push_back(i);
+
+		if (indices.size() <= maxStaticDraws)
+		{
+			staticDrawsActive = true;
+			draws->resize(indices.size());
+
+			for (size_t i = 0; i < indices.size(); i++)
+			{
+				uint32_t index = indices[i];
+				uint32_t slot = scene.handles[index].index();
+				const Mesh& mesh = meshes[scene.meshIds[index]];
+				const Material& material = materials[scene.materialIds[index]];
+
+				DrawItem& item = (*draws)[i];
+				item.transform = scene.transforms[index];
+				item.bounds = scene.bounds[index];
+				item.vertexBuffer = mesh.vertexBuffer.buffer;
+				item.indexBuffer = mesh.indexBuffer.buffer;
+				item.indexCount = static_cast<uint32_t>(mesh.indices.size());
+				item.visibilityIndex = slot < maxVisibilityEntries ? slot : noVisibilityEntry;
+				// Culled against every view on the GPU.
+				item.viewMask = ~0u;
+				item.pipeline = material.pipeline;
+				item.multiviewPipeline = material.multiviewPipeline;
+				item.pipelineLayout = material.pipelineLayout;
+			}
+
+			// Recorded once, so sorting for fewer binds pays off every frame.
+			std::sort(draws->begin(), draws->end(), [](const DrawItem& a, const DrawItem& b) {
+				if (a.pipeline != b.pipeline)
+					return a.pipeline < b.pipeline;
+				return a.vertexBuffer < b.vertexBuffer;
+			});
+		}
+	}
+
+	staticDraws = std::move(draws);
+}
+
+void VulkanEngine::publishSnapshot()
+{
+	std::unique_lock<std::mutex> lock(renderMutex);
+	renderSignal.wait(lock, [&] { return !snapshots.hasFresh() || renderQuit.load(); });
+	snapshots.publish();
+	lock.unlock();
+
+	renderSignal.notify_all();
+}
+
+void VulkanEngine::renderLoop()
+{
+	while (true)
+	{
+		std::unique_lock<std::mutex> lock(renderMutex);
+		renderSignal.wait(lock, [&] { return snapshots.hasFresh() || renderQuit.load(); });
+		if (renderQuit)
+			return;
+
+		snapshots.acquire();
+		lock.unlock();
+
+		renderSignal.notify_all();
+
+		draw(snapshots.front());
+	}
+}
+
+void VulkanEngine::draw(FrameSnapshot& snapshot)
+{
+	FrameData& frame = getCurrentFrame();
+
+	VK_CHECK(vkWaitForFences(device, 1, &frame.renderFence, VK_TRUE, UINT64_MAX));
+	frame.deletionQueue.flush(device, allocator);
+	frame.deletionQueue.append(snapshot.retired);
+
+	// Submissions finish in order, so every snapshot up to the one this frame
+	// drew last is done.
+	completedSequence.store(frame.sequence, std::memory_order_release);
+	frame.sequence = snapshot.sequence;
+
+	VK_CHECK(vkResetFences(device, 1, &frame.renderFence));
+
+	VK_CHECK(vkResetCommandBuffer(frame.mainCommandBuffer, 0));
 
 	uint32_t swapchainImageIndex;
-	VK_CHECK(vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, getCurrentFrame().presentSemaphore, nullptr, &swapchainImageIndex));
+	VK_CHECK(vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, frame.presentSemaphore, nullptr, &swapchainImageIndex));
 
-	VkCommandBuffer cmd = getCurrentFrame().mainCommandBuffer;
+	VkCommandBuffer cmd = frame.mainCommandBuffer;
 
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.pNext = nullptr;
-	beginInfo.pInheritanceInfo = nullptr;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	void* data;
+	vmaMapMemory(allocator, frame.camInfo.allocation, &data);
+	for (uint32_t i = 0; i < snapshot.cameraCount; i++)
+		memcpy(static_cast<char*>(data) + i * cameraStride, &snapshot.cameras[i], sizeof(GPUCameraData));
+	vmaUnmapMemory(allocator, frame.camInfo.allocation);
+
+	uint32_t groupCount = snapshot.groupCount;
+	uint32_t sectionCount = groupCount > 0 ? groupSection(groupCount - 1) + 1 : 0;
+
+	// Calls record(group, section) for every section the groups draw from.
+	auto forEachSection = [&](auto&& record) {
+		for (uint32_t i = 0; i < groupCount; i++)
+		{
+			record(snapshot.groups[i], groupSection(i));
+			if (i == 0)
+				record(snapshot.groups[i], 1);
+		}
+	};
+
+	// Static objects fill the start of the cull buffers. Their object data and
+	// secondaries stay valid for this frame slot until the static set or the
+	// view layout changes; cameras moving doesn't matter.
+	const std::vector<DrawItem>& staticItems = *snapshot.staticDraws;
+	uint32_t staticCount = static_cast<uint32_t>(staticItems.size());
+
+	bool groupsChanged = frame.staticGroupCount != groupCount || memcmp(frame.staticGroups, snapshot.groups, groupCount * sizeof(DrawGroup)) != 0;
+	if (frame.staticVersion != snapshot.staticVersion || groupsChanged)
+	{
+		writeCullData(staticItems.data(), staticCount, 0, sectionCount);
+		forEachSection([&](const DrawGroup& group, uint32_t section) {
+			recordDraws(frame.staticCommands[section], 0, group, section, staticItems.data(), staticCount, 0, staticCount);
+		});
+
+		frame.staticVersion = snapshot.staticVersion;
+		memcpy(frame.staticGroups, snapshot.groups, groupCount * sizeof(DrawGroup));
+		frame.staticGroupCount = groupCount;
+	}
+
+	uint32_t dynamicCount = static_cast<uint32_t>(snapshot.draws.size());
+	uint32_t dynamicCull = snapshot.occlusionCulling ? std::min(dynamicCount, maxCullObjects - staticCount) : 0;
+	writeCullData(snapshot.draws.data(), dynamicCull, staticCount, sectionCount);
+
+	forEachSection([&](const DrawGroup& group, uint32_t section) {
+		recordDraws(frame.dynamicCommands[section], VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, group, section, snapshot.draws.data(), dynamicCount, staticCount, dynamicCull);
+	});
+
+	uint32_t cullCount = groupCount > 0 ? staticCount + dynamicCull : 0;
+
+	if (cullCount > 0)
+	{
+		GPUViewData viewData{};
+		for (uint32_t i = 0; i < snapshot.cameraCount; i++)
+			viewData.viewproj[i] = snapshot.cameras[i].viewproj;
+		for (uint32_t i = 0; i < groupCount; i++)
+			viewData.groupViews[i] = snapshot.groups[i].viewMask;
+
+		vmaMapMemory(allocator, frame.viewBuffer.allocation, &data);
+		memcpy(data, &viewData, sizeof(GPUViewData));
+		vmaUnmapMemory(allocator, frame.viewBuffer.allocation);
+	}
+
+	VkCommandBufferBeginInfo beginInfo = vkinit::commandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
 	VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
 
+	if (cullCount > 0)
+	{
+		// Visibility was written by the previous frame's late cull
+		VkBufferMemoryBarrier visibilityBarrier = vkinit::bufferBarrier(visibilityBuffer.buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &visibilityBarrier, 0, nullptr);
+
+		dispatchCull(cmd, snapshot, cullCount, false);
+	}
+
 	VkClearValue color;
 	color.color = { { 0.f, 0.f, 0.f, 1.f } };
 
@@ -702,12 +1740,65 @@ void VulkanEngine::draw()
 	renderPassBeginInfo.clearValueCount = 2;
 	renderPassBeginInfo.pClearValues = &clearValues[0];
 
-	vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-	drawObjects(cmd, renderables.data(), renderables.size());
+	if (groupCount > 0)
+	{
+		VkCommandBuffer earlyCommands[] = { frame.staticCommands[0], frame.dynamicCommands[0] };
+		vkCmdExecuteCommands(cmd, 2, earlyCommands);
+	}
 
 	vkCmdEndRenderPass(cmd);
 
+	// Only the main view has drawn so far, the pyramid holds its depth alone.
+	if (cullCount > 0)
+	{
+		buildDepthPyramid(cmd, snapshot);
+		dispatchCull(cmd, snapshot, cullCount, true);
+	}
+
+	VkRenderPassBeginInfo latePassBeginInfo = vkinit::renderPassBeginInfo(latePass, windowExtent, framebuffers[swapchainImageIndex]);
+	latePassBeginInfo.clearValueCount = 0;
+
+	vkCmdBeginRenderPass(cmd, &latePassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	// The main view's late draws, then every other swapchain view on top.
+	VkCommandBuffer lateCommands[2 * maxViews];
+	uint32_t lateCount = 0;
+	for (uint32_t i = 0; i < groupCount; i++)
+	{
+		if (snapshot.groups[i].target != VIEW_SWAPCHAIN)
+			continue;
+
+		uint32_t section = i == 0 ? 1 : groupSection(i);
+		lateCommands[lateCount++] = frame.staticCommands[section];
+		lateCommands[lateCount++] = frame.dynamicCommands[section];
+	}
+
+	if (lateCount > 0)
+		vkCmdExecuteCommands(cmd, lateCount, lateCommands);
+
+	vkCmdEndRenderPass(cmd);
+
+	// Offscreen views share a single multiview pass, one draw covers every
+	// layer.
+	for (uint32_t i = 0; i < groupCount; i++)
+	{
+		if (snapshot.groups[i].target != VIEW_OFFSCREEN)
+			continue;
+
+		VkRenderPassBeginInfo offscreenBeginInfo = vkinit::renderPassBeginInfo(offscreenPass, offscreenExtent, offscreenFramebuffer);
+		offscreenBeginInfo.clearValueCount = 2;
+		offscreenBeginInfo.pClearValues = &clearValues[0];
+
+		vkCmdBeginRenderPass(cmd, &offscreenBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		VkCommandBuffer offscreenCommands[] = { frame.staticCommands[groupSection(i)], frame.dynamicCommands[groupSection(i)] };
+		vkCmdExecuteCommands(cmd, 2, offscreenCommands);
+
+		vkCmdEndRenderPass(cmd);
+	}
+
 	VK_CHECK(vkEndCommandBuffer(cmd));
 
 	VkSubmitInfo submit{};
@@ -719,15 +1810,15 @@ void VulkanEngine::draw()
 	submit.pWaitDstStageMask = &waitStage;
 	
 	submit.waitSemaphoreCount = 1;
-	submit.pWaitSemaphores = &getCurrentFrame().presentSemaphore;
+	submit.pWaitSemaphores = &frame.presentSemaphore;
 
 	submit.signalSemaphoreCount = 1;
-	submit.pSignalSemaphores = &getCurrentFrame().renderSemaphore;
+	submit.pSignalSemaphores = &frame.renderSemaphore;
 
 	submit.commandBufferCount = 1;
 	submit.pCommandBuffers = &cmd;
 
-	VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, getCurrentFrame().renderFence));
+	VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, frame.renderFence));
 
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -736,7 +1827,7 @@ void VulkanEngine::draw()
 	presentInfo.pSwapchains = &swapchain;
 	presentInfo.swapchainCount = 1;
 
-	presentInfo.pWaitSemaphores = &getCurrentFrame().renderSemaphore;
+	presentInfo.pWaitSemaphores = &frame.renderSemaphore;
 	presentInfo.waitSemaphoreCount = 1;
 
 	presentInfo.pImageIndices = &swapchainImageIndex;
@@ -751,17 +1842,109 @@ void VulkanEngine::run()
 	SDL_Event e;
 	bool quit = false;
 
+	renderQuit = false;
+	renderThread = std::thread(&VulkanEngine::renderLoop, this);
+
+	if (!replayPath.empty())
+		input.startReplay(replayPath.c_str());
+	else if (!recordPath.empty())
+		input.startRecording(recordPath.c_str());
+
+	auto startTime = std::chrono::steady_clock::now();
+	auto previousTime = startTime;
+	double accumulator = 0.0;
+	uint32_t frames = 0;
+
 	while (!quit)
 	{
 		while (SDL_PollEvent(&e) != 0)
 		{
 			if (e.type == SDL_QUIT) quit = true;
 
-			input.onEventLoop(&e);
+			if (!input.isReplaying())
+				input.onEventLoop(&e);
 		}
 
-		input.onFrame();
+		auto currentTime = std::chrono::steady_clock::now();
+		double frameTime = std::chrono::duration<double>(currentTime - previousTime).count();
+		previousTime = currentTime;
 
-		draw();
+		if (input.isReplaying())
+		{
+			if (!input.replayFrame(frameTime))
+				quit = true;
+		}
+		else
+		{
+			input.endFrame(frameTime);
+		}
+
+		accumulator += frameTime;
+
+		uint32_t ticks = 0;
+		while (accumulator >= tickInterval && ticks < maxTicksPerFrame)
+		{
+			tick(static_cast<float>(tickInterval));
+			accumulator -= tickInterval;
+			ticks++;
+		}
+
+		// Too far behind to catch up, drop the backlog instead of spending
+		// ever longer frames on simulation.
+		if (accumulator >= tickInterval)
+			accumulator = std::fmod(accumulator, tickInterval);
+
+		// Frame locked paths step once per frame, whatever the ticks did.
+		if (camPath.isPlaying() && camPath.clock == PATH_FRAME)
+		{
+			followCameraPath(false);
+			camPath.advance(camPath.frameStep);
+		}
+
+		world.update(cam.getPos());
+
+		if (assets.update(uploadBudget) > 0)
+			addWaitingRenderables();
+
+		if (shaders.update() > 0)
+			refreshPipelines();
+
+		jobs.runMainThreadJobs();
+
+		// Listener and source changes are queued for the audio thread, update()
+		// ends the frame and the audio thread commits them in one batch.
+		audio.setListenerPos(cam.getPos());
+		audio.setListenerOrientation(cam.getFront(), cam.getUp());
+		audio.setStreamPos(&music, cam.getPos());
+		spatialIndex.commit(scene);
+		audioOcclusion.update(audio, cam.getPos());
+		audio.update(static_cast<float>(frameTime));
+
+		// Builds frame N + 1 while the render thread is still recording frame N.
+		buildSnapshot(snapshots.back(), static_cast<float>(accumulator / tickInterval));
+		publishSnapshot();
+
+		frames++;
+		if (maxFrames != 0 && frames >= maxFrames)
+			quit = true;
+	}
+
+	input.stopRecording();
+	input.stopReplay();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	if (frames > 0)
+		std::cout << frames << " frames in " << seconds << " s, " << seconds * 1000.0 / frames << " ms per frame" << std::endl;
+
+	if (audio.getOutput() != AUDIO_OUTPUT_DEVICE && audio.getMixer().getRealtimeVoices() > 0.0)
+		std::cout << "Mixer: " << audio.getMixer().getRealtimeVoices() << " voices in real time per core" << std::endl;
+	if (audio.getStreamUnderruns() > 0 || music.getLateChunks() > 0)
+		std::cout << "Audio: " << audio.getStreamUnderruns() << " underruns, " << music.getLateChunks() << " late chunks" << std::endl;
+
+	{
+		std::lock_guard<std::mutex> lock(renderMutex);
+		renderQuit = true;
 	}
+	renderSignal.notify_all();
+	renderThread.join();
 }
\ No newline at end of file
@@ -2,27 +2,42 @@
 
 #include "vkTypes.h"
 #include "vkMesh.h"
+#include "vkDeletion.h"
+#include "shaderCache.h"
+#include "bufferPool.h"
 #include "vma/vk_mem_alloc.h"
-#include <deque>
 #include <functional>
+#include <memory>
 #include <unordered_map>
 #include "glm/glm.hpp"
 #include "../input/input.h"
 #include "../camera/camera.h"
+#include "../camera/cameraPath.h"
 #include "../audio/speaker.h"
 #include "../audio/audio.h"
+#include "../audio/stream.h"
+#include "../audio/occlusion.h"
+#include "../scene/handle.h"
+#include "../scene/renderScene.h"
+#include "../scene/spatialIndex.h"
+#include "../scene/worldPartition.h"
+#include "../asset/assetManager.h"
+#include "../core/jobSystem.h"
+#include "../core/tripleBuffer.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 struct Material
 {
 	VkPipeline pipeline;
 	VkPipelineLayout pipelineLayout;
-};
-
-struct RenderObject
-{
-	Mesh* mesh;
-	Material* material;
-	glm::mat4 transformMatrix;
+	// Source of pipeline, which is refreshed when its shaders are reloaded.
+	PipelineID shaderPipeline;
+	// Variant for the offscreen multiview pass, null when there is none.
+	VkPipeline multiviewPipeline;
+	PipelineID shaderMultiviewPipeline;
 };
 
 struct MeshPushConstants
@@ -31,22 +46,68 @@ struct MeshPushConstants
 	glm::mat4 renderMatrix;
 };
 
-struct DeletionQueue
+struct UploadContext
+{
+	VkFence uploadFence;
+	VkCommandPool commandPool;
+	VkCommandBuffer commandBuffer;
+};
+
+constexpr unsigned int frameOverlap = 2;
+
+// Objects past this count in a frame are drawn without occlusion culling.
+constexpr uint32_t maxCullObjects = 65536;
+// Renderable slots past this count have no visibility history.
+constexpr uint32_t maxVisibilityEntries = 1 << 20;
+constexpr uint32_t noVisibilityEntry = 0xFFFFFFFF;
+constexpr uint32_t maxPyramidLevels = 16;
+// Workgroup size of cull.comp, passed as a specialization constant.
+constexpr uint32_t cullGroupSize = 64;
+// Static objects take at most half of the cull buffers.
+constexpr uint32_t maxStaticDraws = maxCullObjects / 2;
+
+// Cameras drawn per frame, matches MAX_VIEWS in cull.comp and
+// triMeshMultiview.vert.
+constexpr uint32_t maxViews = 4;
+// Cameras are padded to the largest uniform offset alignment Vulkan allows,
+// so every camera can be bound with a dynamic offset.
+constexpr uint32_t cameraStride = 256;
+// Indirect command sections: the early and late pass of the main view, then
+// one per further draw group.
+constexpr uint32_t maxDrawSections = maxViews + 1;
+
+enum ViewTarget
+{
+	VIEW_SWAPCHAIN,
+	VIEW_OFFSCREEN
+};
+
+// A camera drawn into part of a target. Swapchain views are drawn one after
+// another, each into its viewport of the window. Offscreen views each own a
+// layer of the offscreen target and are drawn together in one multiview pass.
+struct RenderView
+{
+	Camera* camera = nullptr;
+	ViewTarget target = VIEW_SWAPCHAIN;
+	// x, y, width and height as fractions of the window, swapchain only.
+	glm::vec4 viewport = glm::vec4(0.f, 0.f, 1.f, 1.f);
+	// Offscreen only.
+	uint32_t layer = 0;
+	float fov = 70.f;
+	bool active = true;
+};
+
+// Views drawn by one set of secondary command buffers.
+struct DrawGroup
 {
-	std::deque<std::function<void()>> deletors;
-	
-	void pushFunction(std::function<void()>&& function)
-	{
-		deletors.push_back(function);
-	}
-
-	void flush()
-	{
-		for (auto it = deletors.rbegin(); it != deletors.rend(); it++)
-			(*it)();
-
-		deletors.clear();
-	}
+	ViewTarget target;
+	// Bit per camera slot drawn by the group.
+	uint32_t viewMask;
+	// Camera bound for the group. Multiview groups read one camera per layer
+	// starting at this slot.
+	uint32_t cameraSlot;
+	VkViewport viewport;
+	VkRect2D scissor;
 };
 
 struct FrameData
@@ -59,6 +120,31 @@ struct FrameData
 
 	AllocatedBuffer camInfo;
 	VkDescriptorSet globalDescriptor;
+
+	AllocatedBuffer objectBuffer;
+	AllocatedBuffer drawBuffer;
+	VkDescriptorSet cullDescriptor;
+
+	// Secondary buffers for the early and late pass. The static ones are only
+	// re-recorded when the snapshot's static draws change, the dynamic ones
+	// every frame.
+	VkCommandBuffer staticCommands[maxDrawSections];
+	VkCommandBuffer dynamicCommands[maxDrawSections];
+	uint64_t staticVersion = 0;
+
+	// Groups the static secondaries were recorded for.
+	DrawGroup staticGroups[maxViews];
+	uint32_t staticGroupCount = 0;
+
+	// View matrices and group masks for cull.comp.
+	AllocatedBuffer viewBuffer;
+
+	// Snapshot drawn by the last submission from this frame.
+	uint64_t sequence = 0;
+
+	// Resources released while this frame was in flight, destroyed once its
+	// renderFence has signaled.
+	DeletionQueue deletionQueue;
 };
 
 struct GPUCameraData 
@@ -68,7 +154,87 @@ struct GPUCameraData
 	glm::mat4 viewproj;
 };
 
-constexpr unsigned int frameOverlap = 2;
+// Matches ObjectData in cull.comp
+struct GPUObjectData
+{
+	glm::vec4 boundsMin;
+	glm::vec4 boundsMax;
+	uint32_t visibilityIndex;
+	uint32_t viewMask;
+	uint32_t pad[2];
+};
+
+// Matches ViewBuffer in cull.comp
+struct GPUViewData
+{
+	glm::mat4 viewproj[maxViews];
+	uint32_t groupViews[maxViews];
+};
+
+struct CullPushConstants
+{
+	// Offset and size of the main view in the depth pyramid, in uv.
+	glm::vec4 pyramidViewport;
+	glm::vec2 pyramidSize;
+	uint32_t objectCount;
+	uint32_t latePass;
+	uint32_t drawStride;
+	uint32_t pyramidLevels;
+	uint32_t groupCount;
+};
+
+struct DepthReducePushConstants
+{
+	glm::ivec2 srcSize;
+	glm::ivec2 dstSize;
+	int srcLod;
+	int fromDepth;
+};
+
+// Everything the render thread needs to draw one object, resolved on the
+// simulation thread so rendering never touches the scene or the pools.
+struct DrawItem
+{
+	glm::mat4 transform;
+	AABB bounds;
+	VkBuffer vertexBuffer;
+	VkBuffer indexBuffer;
+	uint32_t indexCount;
+	uint32_t visibilityIndex;
+	// Camera slots whose frustum the object touches.
+	uint32_t viewMask;
+	VkPipeline pipeline;
+	VkPipeline multiviewPipeline;
+	VkPipelineLayout pipelineLayout;
+};
+
+// Immutable once published, handed from the simulation thread to the render thread.
+struct FrameSnapshot
+{
+	uint64_t sequence = 0;
+	// Slot 0 is the main view, occlusion culling only runs for it.
+	GPUCameraData cameras[maxViews];
+	uint32_t cameraCount;
+	// Group 0 draws the main view.
+	DrawGroup groups[maxViews];
+	uint32_t groupCount;
+	glm::vec4 pyramidViewport;
+	bool occlusionCulling;
+	VkPipeline cullPipeline;
+	VkPipeline depthReducePipeline;
+	std::vector<DrawItem> draws;
+
+	// RENDER_STATIC objects, shared between snapshots until the static set
+	// changes. They are culled on the GPU only and come first in the cull
+	// buffers, draws follows them. Empty while occlusion culling is off.
+	std::shared_ptr<const std::vector<DrawItem>> staticDraws;
+	uint64_t staticVersion = 0;
+
+	// Resources released since the previous snapshot. This snapshot no longer
+	// references them but older ones may, so the render thread destroys them
+	// once the frame that draws this snapshot has finished.
+	DeletionQueue retired;
+};
 
 class VulkanEngine
 {
@@ -83,21 +249,27 @@ class VulkanEngine
 	void initScene();
 	void initImGui();
 	void initDescriptors();
+	void initOcclusionCulling();
+	void initOffscreenTarget();
 	AllocatedBuffer createBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
 
-	void uploadMesh(Mesh& mesh);
+	void immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function);
 
-	bool loadShaderModule(const char* filePath, VkShaderModule* outShaderModule);
+	void writeCullData(const DrawItem* items, uint32_t count, uint32_t firstObject, uint32_t sectionCount);
+	void dispatchCull(VkCommandBuffer cmd, const FrameSnapshot& snapshot, uint32_t cullCount, bool latePass);
+	void buildDepthPyramid(VkCommandBuffer cmd, const FrameSnapshot& snapshot);
 
 public:
-	Speaker s;
+	AudioStream music;
 	Audio audio;
+	AudioOcclusion audioOcclusion;
 
 	VkPhysicalDeviceProperties gpuProps;
 
 	VkDescriptorSetLayout globalSetLayout;
 	VkDescriptorPool descriptorPool;
 
+	// Owned by the render thread.
 	FrameData frames[frameOverlap];
 
 	FrameData& getCurrentFrame();
@@ -107,34 +279,162 @@ public:
 	Input input;
 	Camera cam;
 
-	std::vector<RenderObject> renderables;
+	// views[0] is the main view of cam, further views may be added at any
+	// time. Views past maxViews cameras are not drawn.
+	std::vector<RenderView> views;
+
+	// Layered color and depth target of the offscreen views, created by
+	// init() when offscreenLayers is set.
+	uint32_t offscreenLayers = 0;
+	VkExtent2D offscreenExtent = { 512, 512 };
+	VkRenderPass offscreenPass = VK_NULL_HANDLE;
+	AllocatedImage offscreenColor;
+	AllocatedImage offscreenDepth;
+	// 2D array views, the color one can be sampled after the frame.
+	VkImageView offscreenColorView;
+	VkImageView offscreenDepthView;
+	VkFramebuffer offscreenFramebuffer;
+	// Flythrough loaded from cameraPathFile, drives cam instead of input
+	// while it plays.
+	CameraPath camPath;
+	std::string cameraPathFile;
+
+	JobSystem jobs;
+
+	RenderScene scene;
+	SpatialIndex spatialIndex;
+	std::vector<uint32_t> visibleObjects;
+	// Scratch for buildSnapshot(), camera slots per scene index and the
+	// objects a single view sees.
+	std::vector<uint32_t> objectViewMasks;
+	std::vector<uint32_t> viewObjects;
+
+	// Draw items of the static renderables, rebuilt by updateStaticDraws()
+	// when scene.staticVersion moves. Static objects past maxStaticDraws
+	// disable the cache and are drawn like any other object.
+	std::shared_ptr<const std::vector<DrawItem>> staticDraws;
+	uint64_t staticDrawsVersion = 0;
+	uint64_t staticSceneVersion = 0;
+	bool staticDrawsCulled = false;
+	bool staticDrawsActive = false;
+
+	HandlePool<Material> materials;
+	HandlePool<Mesh> meshes;
+	std::unordered_map<AssetID, MaterialHandle> materialsById;
+
+	// Directory that asset paths are relative to, set before init().
+	std::string assetRoot = "assets/";
+	AssetManager assets;
+
+	// Compiled SPIR-V, relative to assetRoot.
+	std::string shaderRoot = "shaders/";
+	ShaderCache shaders;
+
+	// Loaded by initScene() when present, relative to assetRoot.
+	std::string scenePath = "scenes/main.scene";
+
+	// Cells are relative to assetRoot.
+	std::string worldRoot = "world/";
+	WorldPartition world;
+
+	// Mesh bytes uploaded per frame at most, further loads wait for the next
+	// frame.
+	size_t uploadBudget = 32 << 20;
+
+	// Vertex and index buffers of unloaded meshes, reused by later uploads.
+	BufferPool meshBuffers;
+
+	// Renderables whose mesh is still loading, added to the spatial index
+	// once it is ready.
+	std::vector<RenderableHandle> waitingRenderables;
+
+	MaterialHandle createMaterial(PipelineID pipeline, VkPipelineLayout layout, AssetID id, PipelineID multiviewPipeline = noPipeline);
+
+	// Points materials at the current pipelines after shaders were reloaded.
+	void refreshPipelines();
+
+	MaterialHandle getMaterial(AssetID id);
+
+	MeshHandle getMesh(AssetID id);
+
+	void uploadMesh(Mesh& mesh);
+
+	RenderableHandle addRenderable(MeshHandle mesh, MaterialHandle material, const glm::mat4& transform, uint32_t flags = RENDER_VISIBLE);
 
-	std::unordered_map<std::string, Material> materials;
-	std::unordered_map<std::string, Mesh> meshes;
+	// Adds every object of a scene file, path relative to assetRoot. Mesh
+	// paths in the file double as asset IDs, so meshes already registered
+	// under that name are shared. Returns false when the file is missing,
+	// malformed or names an unknown material.
+	bool loadScene(const std::string& path);
+	void removeRenderable(RenderableHandle handle);
 
-	Material* createMaterial(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name);
+	// Releases the buffers of a mesh once the GPU is done with the current
+	// frame. Renderables using it must be removed first. Meshes owned by the
+	// asset manager are unloaded through assets.release().
+	void unloadMesh(MeshHandle handle);
 
-	Material* getMaterial(const std::string& name);
+	void addWaitingRenderables();
 
-	Mesh* getMesh(const std::string& name);
+	// Destroys the buffer once no snapshot in flight can reference it.
+	void retireBuffer(AllocatedBuffer buffer);
+	void setTransform(RenderableHandle handle, const glm::mat4& transform);
 
-	void drawObjects(VkCommandBuffer cmd, RenderObject* first, int count);
+	// Draws count items for a group. The first cullCount use the indirect
+	// commands the cull shader wrote into section starting at firstDraw, the
+	// rest are drawn for the group's views they touch. The late pass, section
+	// 1, only draws culled items.
+	void drawObjects(VkCommandBuffer cmd, const DrawGroup& group, uint32_t section, const DrawItem* items, uint32_t count, uint32_t firstDraw, uint32_t cullCount);
+
+	// Records a secondary command buffer for one section.
+	void recordDraws(VkCommandBuffer cmd, VkCommandBufferUsageFlags usage, const DrawGroup& group, uint32_t section, const DrawItem* items, uint32_t count, uint32_t firstDraw, uint32_t cullCount);
+
+	UploadContext uploadContext;
+
+	bool occlusionCulling = true;
+	VkRenderPass latePass;
+	VkSampler depthSampler;
+	AllocatedImage depthPyramid;
+	VkImageView depthPyramidView;
+	VkImageView depthPyramidMips[maxPyramidLevels];
+	uint32_t depthPyramidLevels;
+	AllocatedBuffer visibilityBuffer;
+
+	VkDescriptorSetLayout depthReduceSetLayout;
+	VkDescriptorSet depthReduceDescriptors[maxPyramidLevels];
+	VkPipelineLayout depthReducePipelineLayout;
+	PipelineID depthReducePipeline = noPipeline;
+
+	VkDescriptorSetLayout cullSetLayout;
+	VkPipelineLayout cullPipelineLayout;
+	PipelineID cullPipeline = noPipeline;
 
 	VkImageView depthImageView;
 	AllocatedImage depthImage;
 
 	VkFormat depthFormat;
 
-	Mesh monkeyMesh;
-
 	VkPipelineLayout meshPipelineLayout;
-	VkPipeline meshPipeline;
-	Mesh triangleMesh;
+	PipelineID meshPipeline = noPipeline;
+	PipelineID meshMultiviewPipeline = noPipeline;
 
 	VmaAllocator allocator;
 
 	DeletionQueue mainDeletionQueue;
 
+	// Released on the simulation thread, travels with the next snapshot.
+	DeletionQueue retiredResources;
+
+	TripleBuffer<FrameSnapshot> snapshots;
+	uint64_t snapshotSequence = 0;
+	// Highest snapshot sequence the GPU has finished drawing, written by the
+	// render thread.
+	std::atomic<uint64_t> completedSequence{ 0 };
+
+	std::thread renderThread;
+	std::mutex renderMutex;
+	std::condition_variable renderSignal;
+	std::atomic<bool> renderQuit{ false };
+
 	VkPipelineLayout trianglePipelineLayot;
 	VkPipeline trianglePipeline;
 	VkPipeline redTrianglePipeline;
@@ -159,6 +459,22 @@ public:
 	bool isInitialized = false;
 	int frameNumber = 0;
 
+	// Simulation runs at a fixed rate independent of the frame rate, frames
+	// interpolate between the last two ticks.
+	double tickInterval = 1.0 / 60.0;
+	// Ticks run per frame before the loop gives up catching up.
+	uint32_t maxTicksPerFrame = 5;
+
+	// Input log written or played back by run(), replay takes precedence.
+	// Replays also reuse the recorded frame times, so a run ticks exactly like
+	// the recording did.
+	std::string recordPath;
+	std::string replayPath;
+	// run() returns after this many frames, 0 runs until quit.
+	uint32_t maxFrames = 0;
+	// Set before init(), AUDIO_OUTPUT_NULL runs without a sound card.
+	AudioOutput audioOutput = AUDIO_OUTPUT_DEVICE;
+
 	VkExtent2D windowExtent = { 1700, 900 };
 
 	struct SDL_Window* window = nullptr;
@@ -167,7 +483,26 @@ public:
 
 	void cleanup();
 
-	void draw();
+	// Advances the simulation by one fixed step.
+	void tick(float dt);
+
+	void followCameraPath(bool interpolate);
+
+	// Simulation thread. alpha is how far the frame lies between the previous
+	// tick and the last one.
+	void buildSnapshot(FrameSnapshot& snapshot, float alpha);
+	// Fills in the cameras and draw groups of the active views.
+	void buildViews(FrameSnapshot& snapshot, float alpha);
+	void updateStaticDraws();
+
+	// Hands the back snapshot to the render thread, waiting until it has
+	// picked up the previous one so simulation stays at most a frame ahead.
+	void publishSnapshot();
+
+	void renderLoop();
+
+	// Render thread, records and submits one frame.
+	void draw(FrameSnapshot& snapshot);
 
 	void run();
 };
\ No newline at end of file
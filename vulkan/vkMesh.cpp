@@ -1,7 +1,5 @@
 #include "vkMesh.h"
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader/tiny_obj_loader.h"
-#include <iostream>
+#include "../asset/objParser.h"
 
 VertexInputDescription Vertex::getVertexDescription()
 {
@@ -39,62 +37,61 @@ VertexInputDescription Vertex::getVertexDescription()
 	return description;
 }
 
-bool Mesh::loadFromOBJ(const char* fileName, const char* directory)
+bool Mesh::loadFromOBJ(const char* fileName, JobSystem* jobs)
 {
-	tinyobj::attrib_t attrib;
+	vertices.clear();
+	indices.clear();
 
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-
-	std::string warn;
-	std::string err;
+	return parseOBJ(fileName, *this, jobs);
+}
 
-	tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, fileName, directory);
+void Mesh::computeBounds()
+{
+	bounds = AABB();
+	for (const Vertex& vertex : vertices)
+		bounds.expand(vertex.position);
+}
 
-	if (!warn.empty())
-		std::cout << "OBJ Warning: " << warn << std::endl;
+void Mesh::buildBVH()
+{
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
 
-	if (!err.empty())
+	std::vector<AABB> triangleBounds(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; i++)
 	{
-		std::cerr << "OBJ Error: " << err << std::endl;
-		return false;
+		triangleBounds[i].expand(vertices[indices[i * 3 + 0]].position);
+		triangleBounds[i].expand(vertices[indices[i * 3 + 1]].position);
+		triangleBounds[i].expand(vertices[indices[i * 3 + 2]].position);
 	}
 
-	for (size_t s = 0; s < shapes.size(); s++)
-	{
-		size_t indexOffset = 0;
-		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
-		{
-			int fv = 3;
-
-			for (size_t v = 0; v < fv; v++)
-			{
-				tinyobj::index_t idx = shapes[s].mesh.indices[indexOffset + v];
-
-				tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-				tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-				tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
-				
-				tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
-				tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
-				tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
-
-				Vertex new_vert;
-				new_vert.position.x = vx;
-				new_vert.position.y = vy;
-				new_vert.position.z = vz;
-
-				new_vert.normal.x = nx;
-				new_vert.normal.y = ny;
-				new_vert.normal.z = nz;
-
-				new_vert.color = new_vert.normal;
-
-				vertices.push_back(new_vert);
-			}
-			indexOffset += fv;
-		}
-	}
+	bvh.build(triangleBounds.data(), triangleCount);
+}
 
-	return true;
+float Mesh::raycast(const Ray& ray) const
+{
+	return bvh.raycast(ray, [&](uint32_t triangle, float tMax) {
+		// Moller-Trumbore, both faces count as hits.
+		glm::vec3 v0 = vertices[indices[triangle * 3 + 0]].position;
+		glm::vec3 e1 = vertices[indices[triangle * 3 + 1]].position - v0;
+		glm::vec3 e2 = vertices[indices[triangle * 3 + 2]].position - v0;
+
+		glm::vec3 p = glm::cross(ray.direction, e2);
+		float det = glm::dot(e1, p);
+		if (fabsf(det) < 1e-8f)
+			return FLT_MAX;
+
+		float invDet = 1.f / det;
+		glm::vec3 s = ray.origin - v0;
+		float u = glm::dot(s, p) * invDet;
+		if (u < 0.f || u > 1.f)
+			return FLT_MAX;
+
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(ray.direction, q) * invDet;
+		if (v < 0.f || u + v > 1.f)
+			return FLT_MAX;
+
+		float t = glm::dot(e2, q) * invDet;
+		return (t >= 0.f && t < tMax) ? t : FLT_MAX;
+	});
 }
@@ -3,6 +3,8 @@
 #include "vkTypes.h"
 #include <vector>
 #include "glm/vec3.hpp"
+#include "../scene/bounds.h"
+#include "../scene/bvh.h"
 
 struct VertexInputDescription
 {
@@ -21,10 +23,25 @@ struct Vertex
 	static VertexInputDescription getVertexDescription();
 };
 
+class JobSystem;
+
 struct Mesh
 {
 	std::vector<Vertex> vertices;
+	// Three per triangle.
+	std::vector<uint32_t> indices;
 	AllocatedBuffer vertexBuffer;
+	AllocatedBuffer indexBuffer;
+	AABB bounds;
+
+	// Optional triangle hierarchy for precise ray queries, empty until buildBVH().
+	BVH bvh;
+
+	// Parses in parallel on jobs when given, see parseOBJ().
+	bool loadFromOBJ(const char* fileName, JobSystem* jobs = nullptr);
+	void computeBounds();
+	void buildBVH();
 
-	bool loadFromOBJ(const char* fileName, const char* directory);
+	// Closest triangle hit in object space, FLT_MAX on a miss.
+	float raycast(const Ray& ray) const;
 };
\ No newline at end of file